@@ -0,0 +1,56 @@
+#ifndef API_REPLY_H
+#define API_REPLY_H
+
+#include <cstdint>
+#include <string>
+
+struct ApiUsage {
+    uint64_t input_tokens = 0;
+    uint64_t output_tokens = 0;
+    uint64_t cache_creation_input_tokens = 0;
+    uint64_t cache_read_input_tokens = 0;
+};
+
+// The API's error object ("overloaded_error", "rate_limit_error", ...).
+// Failures that never produced one use "transport_error" (network),
+// "http_error" (non-JSON error body) or "parse_error".
+struct ApiError {
+    std::string type;
+    std::string message;
+};
+
+// Where the time and bytes of one call went. The network phases come from
+// curl and are cumulative from the start of the transfer; the rest is local
+// work on either side of it. All times are in microseconds.
+struct RequestMetrics {
+    uint64_t namelookup_us = 0;
+    uint64_t connect_us = 0;
+    uint64_t appconnect_us = 0;
+    uint64_t starttransfer_us = 0;
+    uint64_t total_us = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    uint64_t serialize_us = 0;      // building the request body
+    uint64_t parse_us = 0;          // decoding the response as it arrived
+    uint64_t persist_us = 0;        // storing the turn and queuing it for the journal
+    uint64_t queue_us = 0;          // held back by the rate limits, all attempts
+    uint32_t attempts = 0;          // requests sent, retries included
+    bool connection_reused = false;
+    bool cache_hit = false;         // answered by the response cache, nothing sent
+};
+
+// Outcome of one Messages API call.
+struct ApiReply {
+    long status = 0;            // HTTP status, 0 if the request never completed
+    std::string id;
+    std::string model;
+    std::string text;           // all text content blocks, in order
+    std::string stop_reason;    // "end_turn", "max_tokens", ...
+    ApiUsage usage;
+    ApiError error;             // empty type on success
+    RequestMetrics metrics;
+
+    bool ok() const { return error.type.empty(); }
+};
+
+#endif // API_REPLY_H
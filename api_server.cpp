@@ -0,0 +1,510 @@
+#include "api_server.h"
+#include "chatbot.h"
+#include "json.h"
+#include "json_parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#ifdef PLATFORM_WINDOWS
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+static const size_t DEFAULT_PAGE = 50;
+static const size_t MAX_PAGE = 1000;
+static const size_t MAX_TENANT_NAME = 64;
+static const char JSON_TYPE[] = "application/json";
+static const char ERROR_PREFIX[] = "Error: ";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static std::string percent_decode(const std::string& text, bool plus_is_space) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && hex_value(text[i + 1]) >= 0 && hex_value(text[i + 2]) >= 0) {
+            out += static_cast<char>(hex_value(text[i + 1]) * 16 + hex_value(text[i + 2]));
+            i += 2;
+        } else if (text[i] == '+' && plus_is_space) {
+            out += ' ';
+        } else {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+static std::vector<std::string> path_segments(const std::string& path) {
+    std::vector<std::string> segments;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        if (end > pos) segments.push_back(percent_decode(path.substr(pos, end - pos), false));
+        pos = end + 1;
+    }
+    return segments;
+}
+
+static std::map<std::string, std::string> query_params(const std::string& query) {
+    std::map<std::string, std::string> params;
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        size_t equals = query.find('=', pos);
+        if (equals == std::string::npos || equals > end) equals = end;
+        params[percent_decode(query.substr(pos, equals - pos), true)] =
+            equals < end ? percent_decode(query.substr(equals + 1, end - equals - 1), true) : "";
+        pos = end + 1;
+    }
+    return params;
+}
+
+static size_t size_param(const std::map<std::string, std::string>& params, const char* name,
+                         size_t fallback, size_t max) {
+    auto it = params.find(name);
+    if (it == params.end() || it->second.empty()) return fallback;
+    return std::min<size_t>(std::strtoull(it->second.c_str(), nullptr, 10), max);
+}
+
+static bool valid_tenant(const std::string& name) {
+    if (name.empty() || name.size() > MAX_TENANT_NAME || name[0] == '.') return false;
+    for (char c : name) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                  c == '_' || c == '-' || c == '.';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static std::string error_json(const std::string& type, const std::string& message) {
+    return "{\"type\":\"error\",\"error\":{\"type\":\"" + json_escape(type) + "\",\"message\":\"" +
+           json_escape(message) + "\"}}";
+}
+
+static void respond_error(const std::shared_ptr<ServerExchange>& exchange, int status,
+                          const std::string& type, const std::string& message) {
+    exchange->respond(status, JSON_TYPE, error_json(type, message) + "\n");
+}
+
+// Turns report failures in-band as "Error: <message>"
+static bool is_error_reply(const std::string& reply) {
+    return reply.compare(0, sizeof(ERROR_PREFIX) - 1, ERROR_PREFIX) == 0;
+}
+
+// Reads a request body as a JSON object, answering 400 if it is not one.
+// An empty body counts as {} where allow_empty says so.
+static bool read_body(const std::shared_ptr<ServerExchange>& exchange, bool allow_empty,
+                      std::map<std::string, JsonField>& fields) {
+    const std::string& body = exchange->request().body;
+    if (allow_empty && body.find_first_not_of(" \t\r\n") == std::string::npos) {
+        fields.clear();
+        return true;
+    }
+    if (!parse_json_object(body, fields)) {
+        respond_error(exchange, 400, "invalid_request_error", "Request body must be a JSON object");
+        return false;
+    }
+    return true;
+}
+
+// The member named key if present with the given type. A member of any
+// other type is answered with a 400, leaving ok false.
+static const JsonField* body_field(const std::map<std::string, JsonField>& fields, const char* key,
+                                   JsonField::Type type, const char* type_name,
+                                   const std::shared_ptr<ServerExchange>& exchange, bool& ok) {
+    auto it = fields.find(key);
+    ok = true;
+    if (it == fields.end()) return nullptr;
+    if (it->second.type != type) {
+        respond_error(exchange, 400, "invalid_request_error",
+                      std::string("\"") + key + "\" must be a " + type_name);
+        ok = false;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+static std::string sse_event(const char* event, const std::string& data) {
+    return std::string("event: ") + event + "\ndata: " + data + "\n\n";
+}
+
+ApiServer::ApiServer(const ApiServerOptions& options)
+    : options(options), scheduler(std::make_shared<RequestScheduler>()), use_clock(0) {}
+
+ApiServer::~ApiServer() {
+    stop();
+}
+
+bool ApiServer::start(std::string& error) {
+#ifdef PLATFORM_WINDOWS
+    bool created = _mkdir(options.data_root.c_str()) == 0;
+#else
+    bool created = mkdir(options.data_root.c_str(), 0755) == 0;
+#endif
+    if (!created && errno != EEXIST) {
+        error = "Cannot create " + options.data_root;
+        return false;
+    }
+    return http.start(options.http, [this](std::shared_ptr<ServerExchange> exchange) { handle(exchange); },
+                      error);
+}
+
+// Fails the requests still in flight first, so closing a tenant does not
+// wait for its replies.
+void ApiServer::stop() {
+    http.stop();
+    scheduler->shutdown();
+    std::lock_guard<std::mutex> lock(tenants_mutex);
+    tenants.clear();
+}
+
+uint16_t ApiServer::port() const {
+    return http.port();
+}
+
+ServerStats ApiServer::stats() const {
+    return http.stats();
+}
+
+size_t ApiServer::tenant_count() {
+    std::lock_guard<std::mutex> lock(tenants_mutex);
+    return tenants.size();
+}
+
+static bool is_ready(const std::shared_future<std::shared_ptr<ClaudeChatbot>>& future) {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// Opens the tenant's chatbot on first use, closing the least recently
+// used idle tenant if max_tenants are open. Idle means open, held by no
+// handler and with nothing in flight, so nothing can start on it once it
+// is out of the map. Opening (which loads and may compact the tenant's
+// data) and closing (which flushes its journal) happen with the lock
+// released. Null, with error set, if every open tenant is busy or the
+// tenant cannot be opened.
+std::shared_ptr<ClaudeChatbot> ApiServer::tenant(const std::string& name, std::string& error) {
+    OpenTenant open;
+    std::promise<std::shared_ptr<ClaudeChatbot>> opening;
+    bool opener = false;
+    std::shared_future<void> previous_closed;
+    std::shared_ptr<ClaudeChatbot> evicted;
+    std::string evicted_name;
+    uint64_t evicted_id = 0;
+    std::promise<void> evicted_closed;
+    {
+        std::lock_guard<std::mutex> lock(tenants_mutex);
+        auto it = tenants.find(name);
+        if (it == tenants.end()) {
+            if (options.max_tenants > 0 && tenants.size() >= options.max_tenants) {
+                auto victim = tenants.end();
+                for (auto candidate = tenants.begin(); candidate != tenants.end(); ++candidate) {
+                    const Tenant& other = candidate->second;
+                    if (!is_ready(other.bot)) continue;
+                    const std::shared_ptr<ClaudeChatbot>& bot = other.bot.get();
+                    if (bot && bot.use_count() == 1 && bot->is_idle() &&
+                        (victim == tenants.end() || other.last_used < victim->second.last_used)) {
+                        victim = candidate;
+                    }
+                }
+                if (victim == tenants.end()) {
+                    error = "Too many tenants are busy";
+                    return nullptr;
+                }
+                evicted = victim->second.bot.get();
+                evicted_name = victim->first;
+                evicted_id = ++use_clock;
+                closing[evicted_name] = Closing{evicted_id, evicted_closed.get_future().share()};
+                tenants.erase(victim);
+            }
+            auto closed = closing.find(name);
+            if (closed != closing.end()) previous_closed = closed->second.closed;
+            it = tenants.emplace(name, Tenant{opening.get_future().share(), 0}).first;
+            opener = true;
+        }
+        it->second.last_used = ++use_clock;
+        open = it->second.bot;
+    }
+
+    if (evicted) {
+        // Last reference: closes it
+        evicted.reset();
+        evicted_closed.set_value();
+        std::lock_guard<std::mutex> lock(tenants_mutex);
+        auto closed = closing.find(evicted_name);
+        if (closed != closing.end() && closed->second.id == evicted_id) closing.erase(closed);
+    }
+
+    if (opener) {
+        if (previous_closed.valid()) previous_closed.wait();
+        std::shared_ptr<ClaudeChatbot> bot;
+        try {
+            bot = std::make_shared<ClaudeChatbot>(options.api_key, options.model, options.max_tokens,
+                                                  options.data_root + "/" + name, scheduler);
+            if (!options.api_url.empty()) bot->set_api_url(options.api_url);
+            bot->set_system_prompt(options.system_prompt);
+        } catch (const std::exception&) {
+            bot.reset();
+        }
+        if (!bot) {
+            // Forget it, so a later request tries again
+            std::lock_guard<std::mutex> lock(tenants_mutex);
+            tenants.erase(name);
+        }
+        opening.set_value(bot);
+    }
+
+    std::shared_ptr<ClaudeChatbot> bot = open.get();
+    if (!bot) error = "Tenant could not be opened";
+    return bot;
+}
+
+static void list_conversations(ClaudeChatbot& bot, const std::shared_ptr<ServerExchange>& exchange) {
+    auto params = query_params(exchange->request().query);
+    size_t offset = size_param(params, "offset", 0, SIZE_MAX);
+    size_t limit = size_param(params, "limit", DEFAULT_PAGE, MAX_PAGE);
+
+    std::string body = "{\"conversations\":[";
+    const char* separator = "";
+    for (const ConversationSummary& conv : bot.list_conversations(offset, limit)) {
+        body += separator;
+        body += "{\"id\":\"" + json_escape(conv.id) + "\",\"title\":\"" + json_escape(conv.title) +
+                "\",\"created_at\":" + std::to_string(conv.created_at) +
+                ",\"updated_at\":" + std::to_string(conv.last_modified) +
+                ",\"message_count\":" + std::to_string(conv.message_count) + "}";
+        separator = ",";
+    }
+    body += "],\"total\":" + std::to_string(bot.get_conversation_count()) + "}\n";
+    exchange->respond(200, JSON_TYPE, body);
+}
+
+static void create_conversation(ClaudeChatbot& bot, const std::shared_ptr<ServerExchange>& exchange) {
+    std::map<std::string, JsonField> fields;
+    if (!read_body(exchange, true, fields)) return;
+    bool ok;
+    const JsonField* title_field = body_field(fields, "title", JsonField::Type::String, "string", exchange, ok);
+    if (!ok) return;
+    std::string title = title_field ? title_field->text : "";
+    std::string id = bot.create_conversation(title);
+    exchange->respond(201, JSON_TYPE, "{\"id\":\"" + json_escape(id) + "\",\"title\":\"" +
+                                      json_escape(title.empty() ? "New Chat" : title) + "\"}\n");
+}
+
+static void list_messages(ClaudeChatbot& bot, const std::string& conversation_id,
+                          const std::shared_ptr<ServerExchange>& exchange) {
+    auto params = query_params(exchange->request().query);
+    size_t offset = size_param(params, "offset", 0, SIZE_MAX);
+    size_t limit = size_param(params, "limit", DEFAULT_PAGE, MAX_PAGE);
+
+    std::string body = "{\"messages\":[";
+    const char* separator = "";
+    bool found = bot.for_each_message(conversation_id, [&](size_t index, const MessageView& message) {
+        body += separator;
+        body += "{\"index\":" + std::to_string(index) + ",\"role\":\"" + role_name(message.role) +
+                "\",\"content\":\"";
+        append_json_escaped(body, message.content.data(), message.content.size());
+        body += "\",\"timestamp\":" + std::to_string(message.timestamp) + "}";
+        separator = ",";
+    }, offset, limit);
+    if (!found) {
+        respond_error(exchange, 404, "not_found_error", "No such conversation");
+        return;
+    }
+    exchange->respond(200, JSON_TYPE, body + "]}\n");
+}
+
+static void send_message(ClaudeChatbot& bot, const std::string& conversation_id,
+                         const std::shared_ptr<ServerExchange>& exchange) {
+    const ServerRequest& request = exchange->request();
+    std::map<std::string, JsonField> fields;
+    if (!read_body(exchange, false, fields)) return;
+    bool ok;
+    const JsonField* content_field = body_field(fields, "content", JsonField::Type::String, "string", exchange, ok);
+    if (!ok) return;
+    if (!content_field || content_field->text.empty()) {
+        respond_error(exchange, 400, "invalid_request_error", "\"content\" must be a non-empty string");
+        return;
+    }
+    const JsonField* stream_field = body_field(fields, "stream", JsonField::Type::Bool, "boolean", exchange, ok);
+    if (!ok) return;
+    const std::string& content = content_field->text;
+    if (!bot.has_conversation(conversation_id)) {
+        respond_error(exchange, 404, "not_found_error", "No such conversation");
+        return;
+    }
+    bool stream = stream_field && stream_field->flag;
+    const std::string* accept = request.header("accept");
+    if (accept && accept->find("text/event-stream") != std::string::npos) stream = true;
+
+    std::string id_json = "\"conversation_id\":\"" + json_escape(conversation_id) + "\"";
+    if (!stream) {
+        bot.send_message_async(conversation_id, content, nullptr, [exchange, id_json](const std::string& reply) {
+            if (is_error_reply(reply)) {
+                respond_error(exchange, 502, "api_error", reply.substr(sizeof(ERROR_PREFIX) - 1));
+            } else {
+                exchange->respond(200, JSON_TYPE, "{" + id_json + ",\"reply\":\"" + json_escape(reply) + "\"}\n");
+            }
+        });
+        return;
+    }
+
+    exchange->start_stream(200, "text/event-stream");
+    bot.send_message_async(conversation_id, content,
+        [exchange](const std::string& delta) {
+            exchange->write(sse_event("delta", "{\"text\":\"" + json_escape(delta) + "\"}"));
+        },
+        [exchange, id_json](const std::string& reply) {
+            if (is_error_reply(reply)) {
+                exchange->write(sse_event("error", error_json("api_error", reply.substr(sizeof(ERROR_PREFIX) - 1))));
+            } else {
+                exchange->write(sse_event("done", "{" + id_json + ",\"reply\":\"" + json_escape(reply) + "\"}"));
+            }
+            exchange->finish();
+        });
+}
+
+static void search(ClaudeChatbot& bot, const std::shared_ptr<ServerExchange>& exchange) {
+    auto params = query_params(exchange->request().query);
+    auto query = params.find("q");
+    if (query == params.end() || query->second.empty()) {
+        respond_error(exchange, 400, "invalid_request_error", "Missing query parameter q");
+        return;
+    }
+    size_t limit = size_param(params, "limit", 10, MAX_PAGE);
+
+    std::ostringstream body;
+    body << "{\"hits\":[";
+    const char* separator = "";
+    for (const SearchHit& hit : bot.search_ranked(query->second, limit)) {
+        Message message;
+        if (!bot.get_message(hit.conversation_id, hit.message_index, message)) continue;
+        body << separator << "{\"conversation_id\":\"" << json_escape(hit.conversation_id)
+             << "\",\"index\":" << hit.message_index << ",\"score\":" << hit.score
+             << ",\"role\":\"" << role_name(message.role) << "\",\"content\":\""
+             << json_escape(message.content) << "\"}";
+        separator = ",";
+    }
+    body << "]}\n";
+    exchange->respond(200, JSON_TYPE, body.str());
+}
+
+enum class Route {
+    ListConversations,
+    CreateConversation,
+    DeleteConversation,
+    ListMessages,
+    SendMessage,
+    Search,
+    Metrics
+};
+
+// Resolves the part of the path after the tenant name, and the method,
+// without touching the tenant. status is 404 or 405 when it fails.
+static bool resolve_route(const std::vector<std::string>& path, const std::string& method,
+                          Route& route, int& status) {
+    const std::string& resource = path[3];
+    size_t depth = path.size() - 4;
+    bool get = method == "GET";
+    bool post = method == "POST";
+
+    status = 405;
+    if (resource == "conversations" && depth == 0) {
+        route = get ? Route::ListConversations : Route::CreateConversation;
+        return get || post;
+    }
+    if (resource == "conversations" && depth == 1) {
+        route = Route::DeleteConversation;
+        return method == "DELETE";
+    }
+    if (resource == "conversations" && depth == 2 && path[5] == "messages") {
+        route = get ? Route::ListMessages : Route::SendMessage;
+        return get || post;
+    }
+    if (resource == "search" && depth == 0) {
+        route = Route::Search;
+        return get;
+    }
+    if (resource == "metrics" && depth == 0) {
+        route = Route::Metrics;
+        return get;
+    }
+    status = 404;
+    return false;
+}
+
+void ApiServer::handle(const std::shared_ptr<ServerExchange>& exchange) {
+    const ServerRequest& request = exchange->request();
+    std::vector<std::string> path = path_segments(request.path);
+
+    if (path.size() == 1 && path[0] == "healthz") {
+        exchange->respond(200, "text/plain", "ok\n");
+        return;
+    }
+    if (path.size() < 4 || path[0] != "v1" || path[1] != "tenants") {
+        respond_error(exchange, 404, "not_found_error", "No such endpoint");
+        return;
+    }
+    if (!valid_tenant(path[2])) {
+        respond_error(exchange, 400, "invalid_request_error", "Invalid tenant name");
+        return;
+    }
+    Route route;
+    int status;
+    if (!resolve_route(path, request.method, route, status)) {
+        if (status == 405) respond_error(exchange, 405, "invalid_request_error", "Method not allowed");
+        else respond_error(exchange, 404, "not_found_error", "No such endpoint");
+        return;
+    }
+    std::string error;
+    std::shared_ptr<ClaudeChatbot> tenant_bot = tenant(path[2], error);
+    if (!tenant_bot) {
+        respond_error(exchange, 503, "overloaded_error", error);
+        return;
+    }
+    ClaudeChatbot& bot = *tenant_bot;
+
+    switch (route) {
+        case Route::ListConversations:
+            list_conversations(bot, exchange);
+            break;
+        case Route::CreateConversation:
+            create_conversation(bot, exchange);
+            break;
+        case Route::DeleteConversation:
+            if (!bot.has_conversation(path[4])) {
+                respond_error(exchange, 404, "not_found_error", "No such conversation");
+            } else {
+                bot.delete_conversation(path[4]);
+                exchange->respond(204, "", "");
+            }
+            break;
+        case Route::ListMessages:
+            list_messages(bot, path[4], exchange);
+            break;
+        case Route::SendMessage:
+            send_message(bot, path[4], exchange);
+            break;
+        case Route::Search:
+            search(bot, exchange);
+            break;
+        case Route::Metrics:
+            if (query_params(request.query)["format"] == "json") {
+                exchange->respond(200, JSON_TYPE, bot.export_metrics(MetricsFormat::Json));
+            } else {
+                exchange->respond(200, "text/plain; version=0.0.4", bot.export_metrics(MetricsFormat::Prometheus));
+            }
+            break;
+    }
+}
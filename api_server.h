@@ -0,0 +1,102 @@
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "http_server.h"
+
+class ClaudeChatbot;
+class RequestScheduler;
+
+struct ApiServerOptions {
+    std::string api_key;
+    std::string api_url;                    // empty = DEFAULT_API_URL
+    std::string model = "claude-sonnet-4-20250514";
+    int max_tokens = 1000;
+    std::string system_prompt;              // for every tenant's requests
+    std::string data_root = "tenants";      // one subdirectory per tenant
+    size_t max_tenants = 256;               // open at once, 0 = no limit
+    ServerOptions http;
+};
+
+// Serves ClaudeChatbot over a local REST API, streaming replies as
+// server-sent events. Every tenant gets a ClaudeChatbot of its own, opened
+// on first use with data_root/<tenant> as its data directory. Routes:
+//
+//   GET    /v1/tenants/{t}/conversations?offset=&limit=
+//   POST   /v1/tenants/{t}/conversations                {"title": ...}
+//   DELETE /v1/tenants/{t}/conversations/{id}
+//   GET    /v1/tenants/{t}/conversations/{id}/messages?offset=&limit=
+//   POST   /v1/tenants/{t}/conversations/{id}/messages   {"content": ..., "stream": bool}
+//   GET    /v1/tenants/{t}/search?q=&limit=
+//   GET    /v1/tenants/{t}/metrics?format=json
+//   GET    /healthz
+//
+// Bodies are JSON objects whose top-level members named above are read;
+// malformed JSON or a member of the wrong type gets a 400. Errors come
+// back as {"type":"error","error":{"type": ...,"message": ...}}. A
+// message is answered with {"conversation_id": ...,"reply": ...}, or with
+// "stream":true (or Accept: text/event-stream) as "delta" events carrying
+// {"text": ...} followed by a "done" or "error" event. Tenant names are
+// 1-64 of [A-Za-z0-9_.-], not starting with a dot.
+//
+// A tenant is opened on its first request to a valid route, without
+// holding up requests to other tenants; requests to the same tenant wait
+// for it. Once max_tenants are open, the least recently used idle one is
+// closed to make room; if none is idle the request gets a 503.
+//
+// Handlers never wait on the Messages API: a reply is written to its
+// client from the transport thread when it lands. Tenants share one
+// request scheduler, so the API key's rate limits and connections are
+// shared between them too.
+class ApiServer {
+private:
+    ApiServerOptions options;
+    std::shared_ptr<RequestScheduler> scheduler;
+
+    // Ready once the thread that inserted it has opened the chatbot
+    using OpenTenant = std::shared_future<std::shared_ptr<ClaudeChatbot>>;
+
+    struct Tenant {
+        OpenTenant bot;
+        uint64_t last_used = 0;
+    };
+
+    // Guards the maps below. Chatbots are opened and closed without it.
+    std::mutex tenants_mutex;
+    std::map<std::string, Tenant> tenants;
+    // Evicted tenants still flushing; reopening one waits for that first,
+    // so two chatbots never share a data directory.
+    struct Closing {
+        uint64_t id;
+        std::shared_future<void> closed;
+    };
+    std::map<std::string, Closing> closing;
+    uint64_t use_clock;
+
+    // Declared last so it stops first; handlers use the tenants above.
+    HttpServer http;
+
+    std::shared_ptr<ClaudeChatbot> tenant(const std::string& name, std::string& error);
+    void handle(const std::shared_ptr<ServerExchange>& exchange);
+
+public:
+    explicit ApiServer(const ApiServerOptions& options);
+    ~ApiServer();
+    ApiServer(const ApiServer&) = delete;
+    ApiServer& operator=(const ApiServer&) = delete;
+
+    bool start(std::string& error);
+    // Stops serving, then closes every tenant, flushing its journal.
+    void stop();
+
+    uint16_t port() const;
+    ServerStats stats() const;
+    size_t tenant_count();
+};
+
+#endif // API_SERVER_H
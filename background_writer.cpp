@@ -0,0 +1,261 @@
+#include "background_writer.h"
+#include <algorithm>
+#include <cstdio>
+
+static uint64_t micros_since(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+BackgroundWriter::BackgroundWriter()
+    : metrics(nullptr), queued_sequence(0), written_sequence(0), synced_sequence(0), compaction_threshold(UINT64_MAX),
+      compactions_requested(0), compactions_done(0), sync_requested(false),
+      policy(FsyncPolicy::Interval), interval(1000), last_sync(std::chrono::steady_clock::now()),
+      running(false), stopping(false) {}
+
+BackgroundWriter::~BackgroundWriter() {
+    stop();
+}
+
+void BackgroundWriter::set_journal_path(const std::string& path) {
+    journal.set_path(path);
+}
+
+void BackgroundWriter::set_compaction(Compaction compact) {
+    compaction = std::move(compact);
+}
+
+void BackgroundWriter::set_metrics(Metrics* registry) {
+    metrics = registry;
+}
+
+size_t BackgroundWriter::replay(const std::function<void(const JournalRecord&)>& apply) {
+    return journal.replay(apply);
+}
+
+uint64_t BackgroundWriter::journal_size() const {
+    return journal.size();
+}
+
+void BackgroundWriter::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    running = true;
+    stopping = false;
+    thread = std::thread(&BackgroundWriter::run, this);
+}
+
+void BackgroundWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    stopping = false;
+    progress.notify_all();
+}
+
+void BackgroundWriter::set_compaction_threshold(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    compaction_threshold = bytes;
+}
+
+void BackgroundWriter::set_fsync_policy(FsyncPolicy new_policy, uint64_t interval_ms) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        policy = new_policy;
+        interval = std::chrono::milliseconds(interval_ms);
+    }
+    wake.notify_one();
+}
+
+FsyncPolicy BackgroundWriter::get_fsync_policy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+}
+
+uint64_t BackgroundWriter::get_fsync_interval_ms() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<uint64_t>(interval.count());
+}
+
+uint64_t BackgroundWriter::append(JournalRecord record) {
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(record));
+        sequence = ++queued_sequence;
+    }
+    wake.notify_one();
+    return sequence;
+}
+
+uint64_t BackgroundWriter::last_sequence() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued_sequence;
+}
+
+void BackgroundWriter::unlink_after_commit(std::string path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        unlinks.emplace_back(queued_sequence, std::move(path));
+    }
+    wake.notify_one();
+}
+
+void BackgroundWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t target = queued_sequence;
+    if (!running || synced_sequence >= target) return;
+    sync_requested = true;
+    wake.notify_one();
+    progress.wait(lock, [&] { return synced_sequence >= target || !running; });
+}
+
+void BackgroundWriter::compact() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running) {
+        lock.unlock();
+        run_compaction();
+        return;
+    }
+    uint64_t target = ++compactions_requested;
+    wake.notify_one();
+    progress.wait(lock, [&] { return compactions_done >= target || !running; });
+}
+
+WriterStats BackgroundWriter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+bool BackgroundWriter::sync_journal() {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = journal.sync();
+    if (metrics) metrics->observe("chatbot_journal_sync_microseconds", micros_since(start));
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ok) counters.syncs++;
+    last_sync = std::chrono::steady_clock::now();
+    return ok;
+}
+
+void BackgroundWriter::run() {
+    std::vector<JournalRecord> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        bool unsynced = synced_sequence < written_sequence;
+        bool interval_due = policy == FsyncPolicy::Interval && now >= last_sync + interval;
+        bool sync_due = unsynced && (sync_requested || stopping || interval_due);
+        bool compaction_due = compactions_requested > compactions_done;
+        bool unlink_due = !unlinks.empty() && unlinks.front().first <= written_sequence;
+
+        if (queue.empty() && !sync_due && !compaction_due && !unlink_due) {
+            if (stopping) break;
+            if (unsynced && policy == FsyncPolicy::Interval) {
+                wake.wait_until(lock, last_sync + interval);
+            } else {
+                wake.wait(lock);
+            }
+            continue;
+        }
+
+        // Everything queued since the last pass goes out as one write
+        batch.swap(queue);
+        uint64_t batch_end = queued_sequence;
+        bool want_sync = policy != FsyncPolicy::Never &&
+                         (sync_requested || stopping || interval_due || policy == FsyncPolicy::EveryCommit);
+        sync_requested = false;
+        uint64_t threshold = compaction_threshold;
+        lock.unlock();
+
+        bool written = true;
+        if (!batch.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            written = journal.append(batch);
+            if (metrics) {
+                metrics->observe("chatbot_journal_write_microseconds", micros_since(start));
+                metrics->observe("chatbot_journal_commit_records", batch.size());
+            }
+        }
+        if (want_sync) sync_journal();
+        bool oversized = journal.size() > threshold;
+
+        lock.lock();
+        if (!batch.empty()) {
+            counters.records += batch.size();
+            counters.commits++;
+        }
+        batch.clear();
+        // A failed append still counts as processed; the compaction it
+        // triggers captures those changes from memory instead.
+        written_sequence = batch_end;
+        if (want_sync || policy == FsyncPolicy::Never) {
+            synced_sequence = written_sequence;
+        }
+
+        if (compactions_requested == compactions_done && (!written || (oversized && !stopping))) {
+            compactions_requested++;
+        }
+        if (compactions_requested > compactions_done) {
+            uint64_t target = compactions_requested;
+            lock.unlock();
+            run_compaction();
+            lock.lock();
+            compactions_done = target;
+        }
+        if (!unlinks.empty()) {
+            lock.unlock();
+            remove_unlinked();
+            lock.lock();
+        }
+        progress.notify_all();
+    }
+}
+
+void BackgroundWriter::remove_unlinked() {
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Queued in sequence order
+        auto ready = std::find_if(unlinks.begin(), unlinks.end(),
+            [&](const std::pair<uint64_t, std::string>& unlink) { return unlink.first > written_sequence; });
+        for (auto it = unlinks.begin(); it != ready; ++it) {
+            paths.push_back(std::move(it->second));
+        }
+        unlinks.erase(unlinks.begin(), ready);
+    }
+    for (const std::string& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+void BackgroundWriter::run_compaction() {
+    uint64_t covered = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (!compaction || !compaction(covered)) return;
+    if (metrics) metrics->observe("chatbot_compaction_microseconds", micros_since(start));
+
+    FsyncPolicy sync_policy;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Records up to covered are in the snapshot; the rest stay queued
+        // for the emptied journal.
+        uint64_t first_queued = queued_sequence - queue.size() + 1;
+        if (covered >= first_queued) {
+            size_t dropped = static_cast<size_t>(std::min<uint64_t>(queue.size(), covered - first_queued + 1));
+            queue.erase(queue.begin(), queue.begin() + dropped);
+        }
+        written_sequence = std::max(written_sequence, covered);
+        synced_sequence = std::max(synced_sequence, covered);
+        counters.compactions++;
+        sync_policy = policy;
+    }
+    journal.reset();
+    if (sync_policy != FsyncPolicy::Never) sync_journal();
+}
@@ -0,0 +1,120 @@
+#ifndef BACKGROUND_WRITER_H
+#define BACKGROUND_WRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "journal.h"
+#include "metrics.h"
+
+// When journal appends and snapshots are forced to stable storage.
+enum class FsyncPolicy {
+    EveryCommit,    // after every group commit
+    Interval,       // at most once per interval, if anything was written
+    Never           // left to the operating system
+};
+
+struct WriterStats {
+    uint64_t records = 0;
+    uint64_t commits = 0;       // group commits (one write each)
+    uint64_t syncs = 0;
+    uint64_t compactions = 0;
+};
+
+// Owns the conversation journal and writes it from a thread of its own.
+// Callers queue records and return at once; each pass of the thread appends
+// everything queued since the last one with a single write, syncs according
+// to the fsync policy, and compacts the journal into a fresh snapshot
+// (through the Compaction callback) once it outgrows the threshold.
+//
+// Records are numbered in the order they are queued. A compaction reports
+// the last record its snapshot includes; queued records up to it are
+// dropped and the rest go into the emptied journal.
+class BackgroundWriter {
+public:
+    // Writes a snapshot and sets covered to the sequence number of the last
+    // record reflected in it. Runs on the writer thread. Returns false if
+    // no snapshot was written.
+    using Compaction = std::function<bool(uint64_t& covered)>;
+
+private:
+    ConversationJournal journal;
+    Compaction compaction;
+    Metrics* metrics;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;       // the writer thread waits on this
+    std::condition_variable progress;   // flush() and compact() wait on this
+    std::vector<JournalRecord> queue;
+    std::vector<std::pair<uint64_t, std::string>> unlinks;  // removed once record n is written
+    uint64_t queued_sequence;           // last record queued
+    uint64_t written_sequence;          // last record in the journal
+    uint64_t synced_sequence;           // last record on stable storage
+    uint64_t compaction_threshold;
+    uint64_t compactions_requested;
+    uint64_t compactions_done;
+    bool sync_requested;
+    FsyncPolicy policy;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point last_sync;
+    WriterStats counters;
+    bool running;
+    bool stopping;
+    std::thread thread;
+
+    void run();
+    void remove_unlinked();
+    bool sync_journal();
+    void run_compaction();
+
+public:
+    BackgroundWriter();
+    ~BackgroundWriter();
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+    // Only while stopped.
+    void set_journal_path(const std::string& path);
+    void set_compaction(Compaction compact);
+    // Receives journal write, sync and compaction times; must outlive the
+    // writer.
+    void set_metrics(Metrics* registry);
+    size_t replay(const std::function<void(const JournalRecord&)>& apply);
+    uint64_t journal_size() const;
+
+    void start();
+    // Writes out everything still queued, then joins the thread.
+    void stop();
+
+    // Compacts once the journal grows past bytes.
+    void set_compaction_threshold(uint64_t bytes);
+    void set_fsync_policy(FsyncPolicy new_policy, uint64_t interval_ms);
+    FsyncPolicy get_fsync_policy() const;
+    uint64_t get_fsync_interval_ms() const;
+
+    // Queues a record and returns its sequence number. Never touches disk.
+    uint64_t append(JournalRecord record);
+    uint64_t last_sequence() const;
+
+    // Removes path on the writer thread once every record queued so far
+    // is in the journal.
+    void unlink_after_commit(std::string path);
+
+    // Both block until done, so never call them while holding a lock the
+    // compaction callback takes. flush() waits until every record queued
+    // so far is written and synced (unless the policy is Never); compact()
+    // until a compaction has run.
+    void flush();
+    void compact();
+
+    WriterStats stats() const;
+};
+
+#endif // BACKGROUND_WRITER_H
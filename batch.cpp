@@ -0,0 +1,164 @@
+#include "batch.h"
+#include "chatbot.h"
+#include "json.h"
+#include "json_parser.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+using BatchClock = std::chrono::steady_clock;
+
+// Indices of lines already answered successfully by an earlier run
+static std::unordered_set<uint64_t> read_finished(const std::string& path, bool& ends_with_newline) {
+    std::unordered_set<uint64_t> finished;
+    ends_with_newline = true;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return finished;
+    
+    std::string line;
+    std::map<std::string, JsonField> fields;
+    while (std::getline(file, line)) {
+        ends_with_newline = !file.eof();
+        // Records torn by a crash fail to parse and are simply redone
+        if (!parse_json_object(line, fields)) continue;
+        auto index = fields.find("index");
+        auto ok = fields.find("ok");
+        if (index == fields.end() || index->second.type != JsonField::Type::Number ||
+            index->second.text.find_first_not_of("0123456789") != std::string::npos ||
+            ok == fields.end() || ok->second.type != JsonField::Type::Bool || !ok->second.flag) {
+            continue;
+        }
+        finished.insert(std::strtoull(index->second.text.c_str(), nullptr, 10));
+    }
+    return finished;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > sorted.size()) rank = sorted.size();
+    return sorted[rank - 1];
+}
+
+int run_batch(ClaudeChatbot& bot, const BatchOptions& options) {
+    std::ifstream input(options.input_path, std::ios::binary);
+    if (!input) {
+        std::cerr << "Cannot open " << options.input_path << "\n";
+        return 1;
+    }
+    
+    bool ends_with_newline;
+    std::unordered_set<uint64_t> finished = read_finished(options.output_path, ends_with_newline);
+    std::ofstream output(options.output_path, std::ios::binary | std::ios::app);
+    if (!output) {
+        std::cerr << "Cannot open " << options.output_path << "\n";
+        return 1;
+    }
+    // A crash can leave half a record behind; start on a fresh line so it
+    // stays an unparseable line of its own.
+    if (!ends_with_newline) output << "\n";
+    
+    unsigned concurrency = std::max(1u, options.concurrency);
+    std::mutex mutex;
+    std::condition_variable slot_free;
+    unsigned in_flight = 0;
+    uint64_t succeeded = 0;
+    uint64_t failed = 0;
+    uint64_t skipped = 0;
+    std::vector<double> latencies;
+    
+    auto write_record = [&](uint64_t index, const ApiReply& reply, double latency_ms) {
+        // Called with mutex held
+        output << "{\"index\":" << index
+               << ",\"ok\":" << (reply.ok() ? "true" : "false")
+               << ",\"status\":" << reply.status
+               << ",\"latency_ms\":" << latency_ms;
+        if (reply.ok()) {
+            output << ",\"reply\":\"" << json_escape(reply.text) << "\"}\n";
+            succeeded++;
+        } else {
+            output << ",\"error\":\"" << json_escape(reply.error.message) << "\"}\n";
+            failed++;
+        }
+        output.flush();
+    };
+    
+    auto started = BatchClock::now();
+    std::string line;
+    std::map<std::string, JsonField> fields;
+    uint64_t index = 0;
+    for (; std::getline(input, line); index++) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        if (finished.count(index)) {
+            skipped++;
+            continue;
+        }
+        
+        // Only the line's own top-level "prompt" counts, and it must say something
+        std::string problem;
+        auto prompt = fields.end();
+        if (!parse_json_object(line, fields)) {
+            problem = "Input line is not a JSON object";
+        } else if ((prompt = fields.find("prompt")) == fields.end() ||
+                   prompt->second.type != JsonField::Type::String) {
+            problem = "Input line has no \"prompt\" string";
+        } else if (prompt->second.text.empty()) {
+            problem = "Input line has an empty \"prompt\"";
+        }
+        if (!problem.empty()) {
+            ApiReply invalid;
+            invalid.error.type = "invalid_request_error";
+            invalid.error.message = problem;
+            std::lock_guard<std::mutex> lock(mutex);
+            write_record(index, invalid, 0);
+            continue;
+        }
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slot_free.wait(lock, [&] { return in_flight < concurrency; });
+            in_flight++;
+        }
+        
+        auto sent = BatchClock::now();
+        bot.complete_async(prompt->second.text, [&, index, sent](ApiReply&& reply) {
+            double latency_ms = std::chrono::duration<double, std::milli>(BatchClock::now() - sent).count();
+            std::lock_guard<std::mutex> lock(mutex);
+            write_record(index, reply, latency_ms);
+            latencies.push_back(latency_ms);
+            in_flight--;
+            slot_free.notify_all();
+        });
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_free.wait(lock, [&] { return in_flight == 0; });
+    }
+    double elapsed = std::chrono::duration<double>(BatchClock::now() - started).count();
+    
+    std::sort(latencies.begin(), latencies.end());
+    char summary[512];
+    snprintf(summary, sizeof(summary),
+             "Batch complete: %llu lines, %llu ok, %llu failed, %llu already done\n"
+             "Elapsed %.2f s, %.2f requests/s at concurrency %u\n"
+             "Latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+             static_cast<unsigned long long>(succeeded + failed + skipped),
+             static_cast<unsigned long long>(succeeded),
+             static_cast<unsigned long long>(failed),
+             static_cast<unsigned long long>(skipped),
+             elapsed, elapsed > 0 ? latencies.size() / elapsed : 0.0, concurrency,
+             percentile(latencies, 50), percentile(latencies, 90),
+             percentile(latencies, 99), latencies.empty() ? 0.0 : latencies.back());
+    std::cerr << summary;
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,28 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+
+class ClaudeChatbot;
+
+struct BatchOptions {
+    std::string input_path;
+    std::string output_path;
+    unsigned concurrency = 8;
+};
+
+// Headless batch run. Each input line is a JSON object with a "prompt"
+// string; each prompt is sent as a one-off request with at most
+// `concurrency` in flight. Results are appended to the output file as JSON
+// lines in completion order, tagged with the input line index:
+//
+//   {"index":3,"ok":true,"status":200,"latency_ms":812.4,"reply":"..."}
+//   {"index":4,"ok":false,"status":529,"latency_ms":95.0,"error":"..."}
+//
+// Lines that already have an ok record in the output file are skipped, so
+// rerunning after a crash picks up where it stopped; failed lines are
+// retried. Prints throughput and latency percentiles when done. Returns the
+// process exit code.
+int run_batch(ClaudeChatbot& bot, const BatchOptions& options);
+
+#endif // BATCH_H
@@ -0,0 +1,370 @@
+// Hot paths of the chatbot core on a synthetic corpus: saving and loading
+// conversations, search, request JSON encoding, response parsing and the
+// deep-copy listing.
+//
+// Usage: core_bench [conversations] [messages per conversation] [message bytes]
+//                   [--runs N] [--dir PATH] [--json]
+//
+// Each case reports the best of N runs (default 3). --json prints one JSON
+// object per case instead of the table, for tracking results over time. The
+// corpus is written to PATH (default core_bench_data), which is emptied
+// before and removed after the run.
+
+#include "chatbot.h"
+#include "conversation_files.h"
+#include "json.h"
+#include "response_parser.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifdef PLATFORM_WINDOWS
+    #include <direct.h>
+    #define rmdir(path) _rmdir(path)
+#else
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+struct Corpus {
+    size_t conversations;
+    size_t messages;
+    size_t message_bytes;
+};
+
+struct Options {
+    Corpus corpus = {200, 100, 1024};
+    int runs = 3;
+    std::string dir = "core_bench_data";
+    bool json = false;
+};
+
+static std::string random_text(std::mt19937& gen, size_t length) {
+    // Prose with the odd quote, newline and tab so escaping has work to do
+    static const char* words[] = {
+        "the", "Quick", "brown", "fox", "JUMPS", "over", "lazy", "dog", "function",
+        "return", "value", "Memory", "thread", "index", "search", "message", "Claude",
+        "\"quoted\"", "line\n", "tab\t", "path\\to"
+    };
+    std::uniform_int_distribution<size_t> pick(0, sizeof(words) / sizeof(words[0]) - 1);
+    std::string text;
+    text.reserve(length + 16);
+    while (text.size() < length) {
+        text += words[pick(gen)];
+        text += ' ';
+    }
+    text.resize(length);
+    return text;
+}
+
+static std::vector<Conversation> make_corpus(const Corpus& shape) {
+    std::mt19937 gen(42);
+    std::vector<Conversation> corpus(shape.conversations);
+    int64_t now = 1700000000;
+    for (size_t c = 0; c < shape.conversations; c++) {
+        Conversation& conv = corpus[c];
+        conv.id = "bench" + std::to_string(c);
+        conv.title = "Conversation " + std::to_string(c);
+        conv.created_at = now;
+        conv.last_modified = now + static_cast<int64_t>(shape.messages);
+        for (size_t m = 0; m < shape.messages; m++) {
+            Message msg;
+            msg.role = m % 2 ? Role::Assistant : Role::User;
+            msg.content = random_text(gen, shape.message_bytes);
+            if ((c * shape.messages + m) % 97 == 0 && shape.message_bytes >= 32) {
+                msg.content.replace(shape.message_bytes / 2, 14, "Needle In Hay!");
+            }
+            msg.timestamp = now + static_cast<int64_t>(m);
+            conv.messages.push_back(msg);
+        }
+        conv.message_count = conv.messages.size();
+    }
+    return corpus;
+}
+
+// Everything a chatbot or a previous run may have left in dir
+static void clear_directory(const std::string& dir) {
+    ConversationFiles files;
+    files.set_directory(dir);
+    files.remove_orphans(std::unordered_set<std::string>());
+    rmdir(files.block_directory().c_str());
+    for (const char* name : {"catalog.dat", "conversations.journal", "search.idx",
+                             "search.idx.tmp", "catalog.dat.tmp"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+}
+
+class Reporter {
+private:
+    const Options& options;
+    uint64_t corpus_bytes;
+
+public:
+    Reporter(const Options& options, uint64_t corpus_bytes) : options(options), corpus_bytes(corpus_bytes) {
+        if (options.json) return;
+        const Corpus& shape = options.corpus;
+        std::cout << "Corpus: " << shape.conversations << " conversations x " << shape.messages
+                  << " messages x " << shape.message_bytes << " bytes = "
+                  << std::setprecision(1) << std::fixed << corpus_bytes / 1e6 << " MB, best of "
+                  << options.runs << "\n\n";
+        std::cout << std::left << std::setw(40) << "case" << std::right
+                  << std::setw(12) << "ms" << std::setw(12) << "MB/s" << std::setw(14) << "ops/s" << "\n";
+    }
+
+    // fn runs one iteration and returns how many operations it performed;
+    // setup, if given, runs untimed before each iteration.
+    template <typename Fn, typename Setup>
+    void run(const std::string& name, uint64_t bytes, Setup setup, Fn fn) {
+        double best = 1e30;
+        uint64_t ops = 0;
+        for (int run = 0; run < options.runs; run++) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            ops = fn();
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end - start).count());
+        }
+        best = std::max(best, 1e-9);
+        print(name, bytes, ops, best);
+    }
+
+    template <typename Fn>
+    void run(const std::string& name, uint64_t bytes, Fn fn) {
+        run(name, bytes, [] {}, fn);
+    }
+
+private:
+    void print(const std::string& name, uint64_t bytes, uint64_t ops, double seconds) const {
+        if (options.json) {
+            const Corpus& shape = options.corpus;
+            std::cout << std::setprecision(6) << std::fixed
+                      << "{\"bench\":\"core\",\"case\":\"" << json_escape(name) << "\""
+                      << ",\"conversations\":" << shape.conversations
+                      << ",\"messages\":" << shape.messages
+                      << ",\"message_bytes\":" << shape.message_bytes
+                      << ",\"runs\":" << options.runs
+                      << ",\"ops\":" << ops
+                      << ",\"bytes\":" << bytes
+                      << ",\"best_ms\":" << seconds * 1000
+                      << ",\"mb_per_s\":" << bytes / seconds / 1e6
+                      << ",\"ops_per_s\":" << ops / seconds << "}\n";
+            return;
+        }
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << seconds * 1000
+                  << std::setprecision(1) << std::setw(12) << bytes / seconds / 1e6
+                  << std::setprecision(0) << std::setw(14) << ops / seconds << "\n";
+    }
+};
+
+// Mirrors ClaudeChatbot::build_messages_json for a whole conversation: the
+// cost of the first request after it is paged in.
+static size_t messages_json(const MessageLog& messages, std::string& json) {
+    json.clear();
+    for (size_t i = 0; i < messages.size(); i++) {
+        MessageView msg = messages[i];
+        if (i > 0) json += ',';
+        json += "{\"role\":\"";
+        json += role_name(msg.role);
+        json += "\",\"content\":\"";
+        append_json_escaped(json, msg.content.data(), msg.content.size());
+        json += "\"}";
+    }
+    return json.size();
+}
+
+static std::string reply_json(const std::string& text) {
+    return "{\"id\":\"msg_bench\",\"type\":\"message\",\"role\":\"assistant\",\"model\":\"bench\","
+           "\"content\":[{\"type\":\"text\",\"text\":\"" + json_escape(text) + "\"}],"
+           "\"stop_reason\":\"end_turn\",\"usage\":{\"input_tokens\":100,\"output_tokens\":" +
+           std::to_string(text.size() / 4) + "}}";
+}
+
+// The same reply as an event stream, a few words per delta
+static std::string reply_stream(const std::string& text) {
+    std::string out =
+        "event: message_start\ndata: {\"type\":\"message_start\",\"message\":{\"id\":\"msg_bench\","
+        "\"model\":\"bench\",\"usage\":{\"input_tokens\":100,\"output_tokens\":1}}}\n\n"
+        "event: content_block_start\ndata: {\"type\":\"content_block_start\",\"index\":0,"
+        "\"content_block\":{\"type\":\"text\",\"text\":\"\"}}\n\n";
+    const size_t chunk = 24;
+    for (size_t pos = 0; pos < text.size(); pos += chunk) {
+        out += "event: content_block_delta\ndata: {\"type\":\"content_block_delta\",\"index\":0,"
+               "\"delta\":{\"type\":\"text_delta\",\"text\":\"";
+        out += json_escape(text.substr(pos, chunk));
+        out += "\"}}\n\n";
+    }
+    out += "event: content_block_stop\ndata: {\"type\":\"content_block_stop\",\"index\":0}\n\n"
+           "event: message_delta\ndata: {\"type\":\"message_delta\",\"delta\":{\"stop_reason\":"
+           "\"end_turn\"},\"usage\":{\"output_tokens\":" + std::to_string(text.size() / 4) + "}}\n\n"
+           "event: message_stop\ndata: {\"type\":\"message_stop\"}\n\n";
+    return out;
+}
+
+// Fed in 16 KB pieces, the way curl delivers a body
+static size_t parse_reply(const std::string& body, bool stream) {
+    ApiResponseParser parser(stream, [](const std::string&) {});
+    const size_t piece = 16 * 1024;
+    for (size_t pos = 0; pos < body.size(); pos += piece) {
+        parser.feed(body.data() + pos, std::min(piece, body.size() - pos));
+    }
+    parser.finish(200, "");
+    return parser.reply().ok() ? 1 : 0;
+}
+
+static bool parse_options(int argc, char** argv, Options& options) {
+    size_t* shape[] = {&options.corpus.conversations, &options.corpus.messages,
+                       &options.corpus.message_bytes};
+    size_t positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dir = argv[++i];
+        } else if (arg[0] != '-' && positional < 3) {
+            *shape[positional++] = std::strtoul(arg.c_str(), nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return options.corpus.conversations > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: core_bench [conversations] [messages] [message bytes]"
+                     " [--runs N] [--dir PATH] [--json]\n";
+        return 1;
+    }
+
+    std::vector<Conversation> corpus = make_corpus(options.corpus);
+    uint64_t corpus_bytes = 0;
+    uint64_t message_count = 0;
+    for (const auto& conv : corpus) {
+        for (const MessageView& msg : conv.messages) {
+            corpus_bytes += msg.content.size();
+        }
+        message_count += conv.messages.size();
+    }
+    Reporter report(options, corpus_bytes);
+
+#ifdef PLATFORM_WINDOWS
+    _mkdir(options.dir.c_str());
+#else
+    mkdir(options.dir.c_str(), 0755);
+#endif
+    clear_directory(options.dir);
+
+    // What a compaction does when every conversation changed: serialize and
+    // write each block in parallel, then the catalog
+    ConversationFiles files;
+    files.set_directory(options.dir);
+    report.run("save_conversations (all changed)", corpus_bytes, [&] {
+        files.parallel_for(corpus.size(), [&](size_t i) {
+            std::string block;
+            serialize_message_block(corpus[i].messages, block);
+            corpus[i].block_size = block.size();
+            corpus[i].block_raw_size = message_block_raw_size(block.data(), block.size());
+            files.write_block(corpus[i].id, block, true);
+        });
+        std::vector<const Conversation*> order;
+        for (const auto& conv : corpus) order.push_back(&conv);
+        files.write_catalog(order, 1, true);
+        sync_directory(files.block_directory());
+        sync_directory(options.dir);
+        return corpus.size();
+    });
+
+    // Without search.idx the index is rebuilt from every block
+    report.run("load_conversations (index rebuild)", corpus_bytes,
+        [&] { std::remove((options.dir + "/search.idx").c_str()); },
+        [&] {
+            ClaudeChatbot bot("bench", "bench", 1000, options.dir);
+            return bot.get_conversation_count();
+        });
+
+    // Destroyed before the directory is cleared: its writer flushes on exit
+    {
+        ClaudeChatbot bot("bench", "bench", 1000, options.dir);
+        report.run("save_conversations (unchanged)", 0, [&] {
+            bot.save_conversations();
+            return static_cast<size_t>(1);
+        });
+        report.run("load_conversations", 0, [&] {
+            bot.load_conversations();
+            return bot.get_conversation_count();
+        });
+
+        std::vector<ConversationSummary> listed = bot.list_conversations();
+        report.run("list_conversations", 0, [&] { return bot.list_conversations().size(); });
+
+        report.run("search_messages (from disk)", corpus_bytes,
+            [&] { bot.set_memory_budget(0); },
+            [&] { return bot.search_messages("needle in hay").size(); });
+
+        // Page everything in and keep it resident
+        bot.set_memory_budget(UINT64_MAX);
+        Message first;
+        for (const auto& summary : listed) {
+            bot.get_message(summary.id, 0, first);
+        }
+        report.run("search_messages (resident)", corpus_bytes,
+            [&] { return bot.search_messages("needle in hay").size(); });
+        report.run("search_ranked", 0, [&] { return bot.search_ranked("quick brown fox", 10).size(); });
+        report.run("get_all_conversations", corpus_bytes, [&] { return bot.get_all_conversations().size(); });
+    }
+
+    std::string json;
+    report.run("build_messages_json", corpus_bytes, [&] {
+        for (const auto& conv : corpus) messages_json(conv.messages, json);
+        return corpus.size();
+    });
+    report.run("escape_json", corpus_bytes, [&] {
+        size_t escaped = 0;
+        for (const auto& conv : corpus) {
+            for (const MessageView& msg : conv.messages) {
+                if (!json_escape(std::string(msg.content)).empty()) escaped++;
+            }
+        }
+        return escaped;
+    });
+
+    // One reply per assistant message in the corpus
+    std::vector<std::string> replies, streams;
+    uint64_t reply_bytes = 0, stream_bytes = 0;
+    for (const auto& conv : corpus) {
+        for (const MessageView& msg : conv.messages) {
+            if (msg.role != Role::Assistant) continue;
+            replies.push_back(reply_json(std::string(msg.content)));
+            streams.push_back(reply_stream(std::string(msg.content)));
+            reply_bytes += replies.back().size();
+            stream_bytes += streams.back().size();
+        }
+    }
+    report.run("parse_response (json)", reply_bytes, [&] {
+        size_t parsed = 0;
+        for (const auto& body : replies) parsed += parse_reply(body, false);
+        return parsed;
+    });
+    report.run("parse_response (sse)", stream_bytes, [&] {
+        size_t parsed = 0;
+        for (const auto& body : streams) parsed += parse_reply(body, true);
+        return parsed;
+    });
+
+    clear_directory(options.dir);
+    rmdir(options.dir.c_str());
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Drives ClaudeChatbot against a Messages API endpoint (normally
+// mock_api_server) and reports turn latency and throughput.
+//
+// Usage: loadgen [--url URL] [--conversations N] [--turns N]
+//                [--message-bytes N] [--stream] [--dir PATH] [--json]
+//                [--metrics FILE] [--rpm N] [--tpm N] [--max-attempts N]
+//                [--system-bytes N] [--no-prompt-cache]
+//
+// Each conversation runs its turns one after another on a thread of its
+// own, so --conversations is the number of requests in flight. Latency is
+// measured from queuing a turn to its reply; with --stream, time to the
+// first text delta is reported too. Replies that come back as errors are
+// counted but left out of the latency figures. Conversations are stored in
+// PATH (default loadgen_data), which is emptied before and after the run.
+// --metrics writes the chatbot's own request metrics at the end, as JSON if
+// FILE ends in .json and as Prometheus text otherwise. --rpm and --tpm set
+// the client's rate limits (default: whatever the server's headers say)
+// and --max-attempts how often a failing request is tried. --system-bytes
+// sends a system prompt of that size with every turn; --no-prompt-cache
+// leaves out the cache_control breakpoints, for comparing input token
+// counts with and without prompt caching.
+
+#include "chatbot.h"
+#include "conversation_files.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifdef PLATFORM_WINDOWS
+    #include <direct.h>
+    #define rmdir(path) _rmdir(path)
+#else
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string url = "http://127.0.0.1:8080/v1/messages";
+    size_t conversations = 8;
+    size_t turns = 20;
+    size_t message_bytes = 200;
+    bool stream = false;
+    std::string dir = "loadgen_data";
+    bool json = false;
+    std::string metrics_path;
+    SchedulerOptions scheduler;
+    size_t system_bytes = 0;
+    bool prompt_cache = true;
+};
+
+struct TurnResults {
+    std::vector<double> latency_ms;
+    std::vector<double> first_text_ms;
+    size_t errors = 0;
+};
+
+static void clear_directory(const std::string& dir) {
+    ConversationFiles files;
+    files.set_directory(dir);
+    files.remove_orphans(std::unordered_set<std::string>());
+    rmdir(files.block_directory().c_str());
+    for (const char* name : {"catalog.dat", "conversations.journal", "search.idx",
+                             "search.idx.tmp", "catalog.dat.tmp"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static void run_conversation(ClaudeChatbot& bot, const std::string& conversation_id,
+                             const Options& options, TurnResults& results) {
+    for (size_t turn = 0; turn < options.turns; turn++) {
+        std::string message = "turn " + std::to_string(turn) + " ";
+        message.append(options.message_bytes > message.size() ? options.message_bytes - message.size() : 0, 'x');
+
+        Clock::time_point start = Clock::now();
+        std::atomic<int64_t> first_text_us(-1);
+        std::future<std::string> reply;
+        if (options.stream) {
+            reply = bot.send_message_async(conversation_id, message, [&](const std::string&) {
+                int64_t unset = -1;
+                int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - start).count();
+                first_text_us.compare_exchange_strong(unset, elapsed);
+            }, CachePolicy::Bypass);
+        } else {
+            reply = bot.send_message_async(conversation_id, message, CachePolicy::Bypass);
+        }
+        std::string text = reply.get();
+        double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        if (text.compare(0, 6, "Error:") == 0) {
+            results.errors++;
+            continue;
+        }
+        results.latency_ms.push_back(elapsed);
+        if (first_text_us >= 0) {
+            results.first_text_ms.push_back(first_text_us / 1000.0);
+        }
+    }
+}
+
+static bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--stream") options.stream = true;
+        else if (arg == "--no-prompt-cache") options.prompt_cache = false;
+        else if (arg == "--json") options.json = true;
+        else if (arg == "--url" && has_value) options.url = argv[++i];
+        else if (arg == "--dir" && has_value) options.dir = argv[++i];
+        else if (arg == "--metrics" && has_value) options.metrics_path = argv[++i];
+        else if (arg == "--conversations" && has_value) options.conversations = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--turns" && has_value) options.turns = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--message-bytes" && has_value) options.message_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--system-bytes" && has_value) options.system_bytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--rpm" && has_value) options.scheduler.requests_per_minute = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--tpm" && has_value) options.scheduler.tokens_per_minute = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--max-attempts" && has_value) {
+            options.scheduler.max_attempts = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else return false;
+    }
+    return options.conversations > 0 && options.turns > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: loadgen [--url URL] [--conversations N] [--turns N]\n"
+                     "               [--message-bytes N] [--stream] [--dir PATH] [--json]\n"
+                     "               [--metrics FILE] [--rpm N] [--tpm N] [--max-attempts N]\n"
+                     "               [--system-bytes N] [--no-prompt-cache]\n";
+        return 1;
+    }
+
+#ifdef PLATFORM_WINDOWS
+    _mkdir(options.dir.c_str());
+#else
+    mkdir(options.dir.c_str(), 0755);
+#endif
+    clear_directory(options.dir);
+
+    TurnResults total;
+    double wall_seconds;
+    SchedulerStats scheduled;
+    MetricsSnapshot measured;
+    {
+        ClaudeChatbot bot("loadgen", "claude-sonnet-4-20250514", 1000, options.dir);
+        bot.set_api_url(options.url);
+        bot.set_scheduler_options(options.scheduler);
+        bot.set_prompt_caching(options.prompt_cache);
+        if (options.system_bytes > 0) {
+            std::string system = "You are a load test. ";
+            while (system.size() < options.system_bytes) system += "Answer briefly and precisely. ";
+            bot.set_system_prompt(system.substr(0, options.system_bytes));
+        }
+        bot.prewarm_connection();
+
+        std::vector<std::string> ids;
+        for (size_t c = 0; c < options.conversations; c++) {
+            bot.start_new_conversation("load " + std::to_string(c));
+            ids.push_back(bot.get_current_conversation_id());
+        }
+
+        std::vector<TurnResults> results(options.conversations);
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (size_t c = 0; c < options.conversations; c++) {
+            threads.emplace_back(run_conversation, std::ref(bot), std::cref(ids[c]),
+                                 std::cref(options), std::ref(results[c]));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        scheduled = bot.get_scheduler_stats();
+        measured = bot.get_metrics();
+
+        for (const auto& result : results) {
+            total.latency_ms.insert(total.latency_ms.end(), result.latency_ms.begin(), result.latency_ms.end());
+            total.first_text_ms.insert(total.first_text_ms.end(), result.first_text_ms.begin(),
+                                       result.first_text_ms.end());
+            total.errors += result.errors;
+        }
+        if (!options.metrics_path.empty()) {
+            const std::string& path = options.metrics_path;
+            bool as_json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+            if (!bot.dump_metrics(path, as_json ? MetricsFormat::Json : MetricsFormat::Prometheus)) {
+                std::cerr << "Could not write metrics to " << path << "\n";
+            }
+        }
+    }
+    clear_directory(options.dir);
+    rmdir(options.dir.c_str());
+
+    std::sort(total.latency_ms.begin(), total.latency_ms.end());
+    std::sort(total.first_text_ms.begin(), total.first_text_ms.end());
+    size_t ok = total.latency_ms.size();
+    double rps = ok / wall_seconds;
+    uint64_t input_tokens = measured.counters["chatbot_input_tokens_total"];
+    uint64_t cache_read_tokens = measured.counters["chatbot_cache_read_input_tokens_total"];
+    uint64_t cache_write_tokens = measured.counters["chatbot_cache_creation_input_tokens_total"];
+
+    if (options.json) {
+        std::cout << std::fixed << std::setprecision(3)
+                  << "{\"bench\":\"loadgen\",\"conversations\":" << options.conversations
+                  << ",\"turns\":" << options.turns
+                  << ",\"stream\":" << (options.stream ? "true" : "false")
+                  << ",\"ok\":" << ok << ",\"errors\":" << total.errors
+                  << ",\"seconds\":" << wall_seconds << ",\"rps\":" << rps
+                  << ",\"p50_ms\":" << percentile(total.latency_ms, 50)
+                  << ",\"p90_ms\":" << percentile(total.latency_ms, 90)
+                  << ",\"p99_ms\":" << percentile(total.latency_ms, 99)
+                  << ",\"max_ms\":" << (ok ? total.latency_ms.back() : 0.0)
+                  << ",\"attempts\":" << scheduled.attempts << ",\"retries\":" << scheduled.retries
+                  << ",\"rate_limited\":" << scheduled.rate_limited
+                  << ",\"overloaded\":" << scheduled.overloaded
+                  << ",\"throttled\":" << scheduled.throttled
+                  << ",\"input_tokens\":" << input_tokens
+                  << ",\"cache_read_input_tokens\":" << cache_read_tokens
+                  << ",\"cache_creation_input_tokens\":" << cache_write_tokens;
+        if (options.stream) {
+            std::cout << ",\"first_text_p50_ms\":" << percentile(total.first_text_ms, 50)
+                      << ",\"first_text_p99_ms\":" << percentile(total.first_text_ms, 99);
+        }
+        std::cout << "}\n";
+        return 0;
+    }
+
+    std::cout << "Endpoint: " << options.url << "\n"
+              << "Load: " << options.conversations << " conversations x " << options.turns << " turns"
+              << (options.stream ? ", streaming" : "") << "\n\n"
+              << std::fixed << std::setprecision(1)
+              << "Turns:        " << ok << " ok, " << total.errors << " errors in " << wall_seconds << " s\n"
+              << "Throughput:   " << rps << " requests/s\n"
+              << "Latency:      p50 " << percentile(total.latency_ms, 50)
+              << " ms, p90 " << percentile(total.latency_ms, 90)
+              << " ms, p99 " << percentile(total.latency_ms, 99)
+              << " ms, max " << (ok ? total.latency_ms.back() : 0.0) << " ms\n"
+              << "Requests:     " << scheduled.attempts << " sent, " << scheduled.retries << " retries ("
+              << scheduled.rate_limited << " rate-limited, " << scheduled.overloaded << " overloaded), "
+              << scheduled.throttled << " held back by the limits\n";
+    uint64_t all_input = input_tokens + cache_read_tokens + cache_write_tokens;
+    std::cout << "Input tokens: " << all_input << ", " << cache_read_tokens << " read from the prompt cache ("
+              << (all_input ? 100.0 * cache_read_tokens / all_input : 0.0) << "%), "
+              << cache_write_tokens << " written to it\n";
+    if (scheduled.requests_per_minute || scheduled.tokens_per_minute) {
+        std::cout << "Limits:       " << scheduled.requests_per_minute << " requests/min, "
+                  << scheduled.tokens_per_minute << " tokens/min\n";
+    }
+    if (options.stream) {
+        std::cout << "First text:   p50 " << percentile(total.first_text_ms, 50)
+                  << " ms, p99 " << percentile(total.first_text_ms, 99) << " ms\n";
+    }
+    return 0;
+}
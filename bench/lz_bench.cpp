@@ -0,0 +1,131 @@
+// Compression ratio and throughput of the message block codec, on
+// synthetic chat text (prose and code) or on any file, split into blocks
+// the size of a conversation's message block.
+//
+// Usage: lz_bench [corpus MB | file] [block KB]
+
+#include "lz_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::string synthetic_corpus(size_t bytes) {
+    static const char* words[] = {
+        "the", "a", "is", "to", "of", "and", "in", "that", "it", "you", "for", "this",
+        "function", "value", "returns", "memory", "thread", "should", "can", "when",
+        "error", "request", "response", "because", "example", "conversation", "message",
+        "would", "like", "file", "data", "each", "which", "then", "use", "your", "code"
+    };
+    static const char* code[] = {
+        "    for (size_t i = 0; i < items.size(); i++) {\n",
+        "        total += items[i].value;\n",
+        "    }\n",
+        "    if (!result.ok()) return result.error();\n",
+        "std::vector<std::string> lines;\n",
+        "def parse(path):\n    with open(path) as f:\n        return json.load(f)\n",
+        "    const auto it = index.find(key);\n",
+        "```cpp\n", "```\n"
+    };
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<size_t> word(0, sizeof(words) / sizeof(words[0]) - 1);
+    std::uniform_int_distribution<size_t> line(0, sizeof(code) / sizeof(code[0]) - 1);
+    std::uniform_int_distribution<int> roll(0, 99);
+
+    std::string text;
+    text.reserve(bytes + 256);
+    while (text.size() < bytes) {
+        if (roll(gen) < 25) {
+            for (int n = roll(gen) % 8 + 2; n > 0; n--) text += code[line(gen)];
+        } else {
+            for (int n = roll(gen) % 60 + 10; n > 0; n--) {
+                text += words[word(gen)];
+                text += roll(gen) < 8 ? ". " : " ";
+            }
+            text += "\n\n";
+        }
+        // Numbers and ids keep it from being unrealistically repetitive
+        text += std::to_string(gen() % 100000);
+        text += ' ';
+    }
+    text.resize(bytes);
+    return text;
+}
+
+template <typename Fn>
+static double best_seconds(Fn fn) {
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    std::string corpus;
+    std::string source = "synthetic";
+    if (argc > 1 && std::strtoul(argv[1], nullptr, 10) == 0) {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open " << argv[1] << "\n";
+            return 1;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        corpus = contents.str();
+        source = argv[1];
+    } else {
+        size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+        corpus = synthetic_corpus(megabytes * 1024 * 1024);
+    }
+    size_t block_bytes = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 256) * 1024;
+    if (corpus.empty() || block_bytes == 0) return 1;
+
+    std::vector<std::string> compressed((corpus.size() + block_bytes - 1) / block_bytes);
+    uint64_t compressed_bytes = 0;
+    double compress_time = best_seconds([&] {
+        compressed_bytes = 0;
+        for (size_t b = 0; b < compressed.size(); b++) {
+            size_t offset = b * block_bytes;
+            compressed[b].clear();
+            lz_compress(corpus.data() + offset, std::min(block_bytes, corpus.size() - offset), compressed[b]);
+            compressed_bytes += compressed[b].size();
+        }
+    });
+
+    std::string output(corpus.size(), '\0');
+    bool intact = true;
+    double decompress_time = best_seconds([&] {
+        for (size_t b = 0; b < compressed.size(); b++) {
+            size_t offset = b * block_bytes;
+            intact &= lz_decompress(compressed[b].data(), compressed[b].size(), &output[offset],
+                                    std::min(block_bytes, corpus.size() - offset));
+        }
+    });
+    intact &= output == corpus;
+
+    std::cout << "Corpus: " << source << ", " << std::fixed << std::setprecision(1)
+              << corpus.size() / 1e6 << " MB in " << compressed.size() << " blocks of "
+              << block_bytes / 1024 << " KB\n\n";
+    std::cout << std::left << std::setw(14) << "ratio" << std::right << std::setprecision(2)
+              << std::setw(10) << static_cast<double>(corpus.size()) / compressed_bytes << "x"
+              << std::setw(12) << compressed_bytes / 1e6 << " MB\n";
+    std::cout << std::left << std::setw(14) << "compress" << std::right
+              << std::setw(10) << corpus.size() / compress_time / 1e6 << " MB/s\n";
+    std::cout << std::left << std::setw(14) << "decompress" << std::right
+              << std::setw(10) << corpus.size() / decompress_time / 1e6 << " MB/s\n";
+    if (!intact) {
+        std::cout << "\nround trip FAILED\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,490 @@
+// Stand-in for the Messages API, for end-to-end latency and throughput tests
+// of the client stack without the real service. Accepts the same requests
+// and answers in the same shapes: a JSON message, or an event stream when
+// the request has "stream":true, plus rate_limit_error (429) and
+// overloaded_error (529) responses.
+//
+// Usage: mock_api_server [--port N] [--latency MS] [--tokens-per-sec N]
+//                        [--reply-tokens N] [--rate-429 P] [--rate-529 P]
+//                        [--rpm N] [--tpm N] [--seed N]
+//
+//   --latency         delay before the response starts (default 200 ms)
+//   --tokens-per-sec  generation speed; streamed deltas are paced by it and
+//                     plain replies wait for the whole reply (default 200,
+//                     0 = instant)
+//   --reply-tokens    length of each reply (default 100)
+//   --rate-429/529    fraction of requests answered with that error
+//   --rpm, --tpm      requests / tokens allowed per minute before answering
+//                     429 (default unlimited); remaining budget is reported
+//                     in anthropic-ratelimit-* headers
+//
+// A user message containing [429] or [529] always gets that error. The
+// reply starts with "echo: " and the last user message.
+//
+// Prompt caching is simulated: a request prefix that ends at a
+// cache_control breakpoint is remembered, and later requests starting with
+// it (checked at the breakpoints and up to 20 blocks before each) are
+// billed as cache reads. The rest of the prefix is billed as a cache write.
+//
+// POSIX only; one thread per connection, keep-alive supported.
+
+#include "json.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int port = 8080;
+    int latency_ms = 200;
+    double tokens_per_sec = 200;
+    int reply_tokens = 100;
+    double rate_429 = 0;
+    double rate_529 = 0;
+    uint64_t rpm = 0;
+    uint64_t tpm = 0;
+    unsigned seed = 1;
+};
+
+static Options options;
+
+// Requests and tokens admitted in the last minute
+class RateWindow {
+private:
+    std::mutex mutex;
+    std::deque<std::pair<Clock::time_point, uint64_t>> admitted;
+    uint64_t tokens = 0;
+    std::mt19937 gen;
+
+    void expire(Clock::time_point now) {
+        while (!admitted.empty() && now - admitted.front().first >= std::chrono::seconds(60)) {
+            tokens -= admitted.front().second;
+            admitted.pop_front();
+        }
+    }
+
+public:
+    explicit RateWindow(unsigned seed) : gen(seed) {}
+
+    // 0 if admitted, else the status to answer with. Fills in the budget
+    // left for the rate limit headers.
+    int admit(uint64_t request_tokens, uint64_t& requests_left, uint64_t& tokens_left, int& retry_after) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        expire(now);
+        retry_after = 0;
+        bool over = (options.rpm && admitted.size() >= options.rpm) ||
+                    (options.tpm && tokens + request_tokens > options.tpm);
+        if (over && !admitted.empty()) {
+            auto wait = std::chrono::seconds(60) - (now - admitted.front().first);
+            retry_after = static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(wait).count()) + 1;
+        }
+        int status = 0;
+        std::uniform_real_distribution<double> roll(0, 1);
+        if (over || roll(gen) < options.rate_429) {
+            status = 429;
+        } else if (roll(gen) < options.rate_529) {
+            status = 529;
+        } else {
+            admitted.emplace_back(now, request_tokens);
+            tokens += request_tokens;
+        }
+        requests_left = options.rpm ? options.rpm - std::min<uint64_t>(options.rpm, admitted.size()) : 0;
+        tokens_left = options.tpm ? options.tpm - std::min(options.tpm, tokens) : 0;
+        return status;
+    }
+};
+
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool send_chunk(int fd, const std::string& data) {
+    char size[32];
+    std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return send_all(fd, size + data + "\r\n");
+}
+
+static std::string header_value(const std::string& head, const char* name) {
+    std::string lower = head;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    std::string key = std::string("\r\n") + name + ":";
+    size_t pos = lower.find(key);
+    if (pos == std::string::npos) return "";
+    pos += key.size();
+    size_t end = head.find("\r\n", pos);
+    std::string value = head.substr(pos, end - pos);
+    value.erase(0, value.find_first_not_of(' '));
+    return value;
+}
+
+// End of a request block (system block or message) in the normalized
+// request, and whether it carried a cache breakpoint
+struct Block {
+    size_t end;
+    bool breakpoint;
+};
+
+// Index just past the JSON string starting at body[begin]
+static size_t string_end(const std::string& body, size_t begin) {
+    size_t i = begin + 1;
+    while (i < body.size() && body[i] != '"') {
+        i += body[i] == '\\' ? 2 : 1;
+    }
+    return std::min(i + 1, body.size());
+}
+
+// The request as the prompt cache sees it: breakpoint markers dropped and
+// single text blocks written as plain string content, which is what the
+// API treats as the same prompt. Collects where each block ends.
+static std::string normalize_request(const std::string& body, std::vector<Block>& blocks) {
+    static const std::string MARK = ",\"cache_control\":{\"type\":\"ephemeral\"}";
+    static const std::string TEXT_BLOCK = "\"content\":[{\"type\":\"text\",\"text\":";
+    std::string out;
+    out.reserve(body.size());
+    int depth = 0;
+    bool marked = false;
+    for (size_t i = 0; i < body.size();) {
+        char c = body[i];
+        if (c == '"') {
+            if (body.compare(i, TEXT_BLOCK.size(), TEXT_BLOCK) == 0) {
+                out += "\"content\":";
+                i += TEXT_BLOCK.size();
+                size_t end = string_end(body, i);
+                out.append(body, i, end - i);
+                i = end;
+                if (body.compare(i, MARK.size(), MARK) == 0) {
+                    marked = true;
+                    i += MARK.size();
+                }
+                if (body.compare(i, 2, "}]") == 0) i += 2;
+                continue;
+            }
+            size_t end = string_end(body, i);
+            out.append(body, i, end - i);
+            i = end;
+            continue;
+        }
+        if (body.compare(i, MARK.size(), MARK) == 0) {
+            marked = true;
+            i += MARK.size();
+            continue;
+        }
+        out += c;
+        i++;
+        if (c == '{' || c == '[') depth++;
+        if (c == '}' || c == ']') depth--;
+        // Objects inside "system" or "messages"
+        if (c == '}' && depth == 2) {
+            blocks.push_back({out.size(), marked});
+            marked = false;
+        }
+    }
+    return out;
+}
+
+class PromptCache {
+private:
+    static const size_t LOOKBACK_BLOCKS = 20;
+    static const size_t MAX_ENTRIES = 1000000;
+
+    std::mutex mutex;
+    std::unordered_set<size_t> prefixes;
+
+    static size_t prefix_hash(const std::string& request, size_t end) {
+        return std::hash<std::string_view>()(std::string_view(request.data(), end));
+    }
+
+public:
+    // Bytes of the longest cached prefix, and of the prefix up to the last
+    // breakpoint (0 without breakpoints)
+    void lookup(const std::string& request, const std::vector<Block>& blocks, size_t& read, size_t& marked) {
+        std::lock_guard<std::mutex> lock(mutex);
+        read = 0;
+        marked = 0;
+        for (size_t b = blocks.size(); b-- > 0;) {
+            if (!blocks[b].breakpoint) continue;
+            if (marked == 0) marked = blocks[b].end;
+            for (size_t k = b + 1; k-- > 0 && b - k <= LOOKBACK_BLOCKS;) {
+                if (blocks[k].end <= read) break;
+                if (prefixes.count(prefix_hash(request, blocks[k].end))) {
+                    read = blocks[k].end;
+                    break;
+                }
+            }
+        }
+    }
+
+    void store(const std::string& request, const std::vector<Block>& blocks) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (prefixes.size() > MAX_ENTRIES) prefixes.clear();
+        for (const Block& block : blocks) {
+            if (block.breakpoint) prefixes.insert(prefix_hash(request, block.end));
+        }
+    }
+};
+
+// Content of the last message in the request
+static std::string last_message(const std::string& body) {
+    size_t pos = body.rfind("\"content\":\"");
+    std::string content;
+    if (pos == std::string::npos) return content;
+    pos += std::strlen("\"content\":\"");
+    json_decode_string(body.data(), body.size(), pos, content);
+    return content;
+}
+
+static std::string reply_text(const std::string& prompt) {
+    static const char* words[] = {"lorem ", "ipsum ", "dolor ", "sit ", "amet, ", "consectetur ",
+                                  "adipiscing ", "elit. "};
+    std::string text = "echo: " + prompt.substr(0, 200);
+    // About four characters a token
+    size_t target = static_cast<size_t>(options.reply_tokens) * 4;
+    for (size_t i = 0; text.size() < target; i++) {
+        text += words[i % (sizeof(words) / sizeof(words[0]))];
+    }
+    return text;
+}
+
+static std::string error_body(int status) {
+    if (status == 429) {
+        return "{\"type\":\"error\",\"error\":{\"type\":\"rate_limit_error\","
+               "\"message\":\"Number of requests has exceeded your rate limit\"}}";
+    }
+    return "{\"type\":\"error\",\"error\":{\"type\":\"overloaded_error\",\"message\":\"Overloaded\"}}";
+}
+
+static std::string rate_limit_headers(uint64_t requests_left, uint64_t tokens_left, int retry_after) {
+    std::string headers;
+    if (options.rpm) {
+        headers += "anthropic-ratelimit-requests-limit: " + std::to_string(options.rpm) + "\r\n";
+        headers += "anthropic-ratelimit-requests-remaining: " + std::to_string(requests_left) + "\r\n";
+    }
+    if (options.tpm) {
+        headers += "anthropic-ratelimit-tokens-limit: " + std::to_string(options.tpm) + "\r\n";
+        headers += "anthropic-ratelimit-tokens-remaining: " + std::to_string(tokens_left) + "\r\n";
+    }
+    if (retry_after > 0) {
+        headers += "retry-after: " + std::to_string(retry_after) + "\r\n";
+    }
+    return headers;
+}
+
+static const char* status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        default: return "Overloaded";
+    }
+}
+
+// Sleeps until token i of the reply would have been generated
+static void pace(Clock::time_point start, size_t token) {
+    if (options.tokens_per_sec <= 0) return;
+    std::this_thread::sleep_until(start + std::chrono::microseconds(
+        static_cast<int64_t>(token * 1e6 / options.tokens_per_sec)));
+}
+
+static bool respond(int fd, const std::string& head, const std::string& raw_body, RateWindow& window,
+                    PromptCache& cache, uint64_t request_id) {
+    std::string first_line = head.substr(0, head.find("\r\n"));
+    bool keep_alive = header_value(head, "connection") != "close";
+    std::string connection = keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    if (first_line.compare(0, 5, "POST ") != 0 || first_line.find("/v1/messages") == std::string::npos) {
+        std::string error = "{\"type\":\"error\",\"error\":{\"type\":\"not_found_error\",\"message\":\"Not found\"}}";
+        send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\nContent-Length: " +
+                     std::to_string(error.size()) + "\r\n" + connection + "\r\n" + error);
+        return keep_alive;
+    }
+
+    std::vector<Block> blocks;
+    std::string body = normalize_request(raw_body, blocks);
+    std::string prompt = last_message(body);
+    bool stream = body.find("\"stream\":true") != std::string::npos;
+
+    // Cache reads are billed separately and do not count against the limits
+    size_t read_bytes, marked_bytes;
+    cache.lookup(body, blocks, read_bytes, marked_bytes);
+    uint64_t cache_read_tokens = read_bytes / 4;
+    uint64_t cache_write_tokens = marked_bytes > read_bytes ? (marked_bytes - read_bytes) / 4 : 0;
+    uint64_t input_tokens = body.size() / 4 + 1 - cache_read_tokens - cache_write_tokens;
+    std::string usage_in = "\"input_tokens\":" + std::to_string(input_tokens) +
+                           ",\"cache_creation_input_tokens\":" + std::to_string(cache_write_tokens) +
+                           ",\"cache_read_input_tokens\":" + std::to_string(cache_read_tokens);
+
+    uint64_t requests_left, tokens_left;
+    int retry_after;
+    int status = window.admit(input_tokens + cache_write_tokens + options.reply_tokens, requests_left,
+                              tokens_left, retry_after);
+    if (prompt.find("[429]") != std::string::npos) status = 429;
+    if (prompt.find("[529]") != std::string::npos) status = 529;
+    if (status == 0) cache.store(body, blocks);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.latency_ms));
+    std::string limits = rate_limit_headers(requests_left, tokens_left, status == 429 ? std::max(retry_after, 1) : 0);
+    std::string message_id = "msg_mock_" + std::to_string(request_id);
+
+    if (status != 0) {
+        std::string error = error_body(status);
+        return send_all(fd, "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) +
+                            "\r\nContent-Type: application/json\r\nContent-Length: " +
+                            std::to_string(error.size()) + "\r\nrequest-id: " + message_id + "\r\n" +
+                            limits + connection + "\r\n" + error) && keep_alive;
+    }
+
+    std::string text = reply_text(prompt);
+    size_t tokens = std::max<size_t>(1, text.size() / 4);
+    std::string usage_out = std::to_string(tokens);
+    Clock::time_point start = Clock::now();
+
+    if (!stream) {
+        pace(start, tokens);
+        std::string reply = "{\"id\":\"" + message_id + "\",\"type\":\"message\",\"role\":\"assistant\","
+                            "\"model\":\"mock\",\"content\":[{\"type\":\"text\",\"text\":\"" +
+                            json_escape(text) + "\"}],\"stop_reason\":\"end_turn\",\"stop_sequence\":null,"
+                            "\"usage\":{" + usage_in + ",\"output_tokens\":" + usage_out + "}}";
+        return send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                            std::to_string(reply.size()) + "\r\nrequest-id: " + message_id + "\r\n" +
+                            limits + connection + "\r\n" + reply) && keep_alive;
+    }
+
+    if (!send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                      "Transfer-Encoding: chunked\r\nrequest-id: " + message_id + "\r\n" +
+                      limits + connection + "\r\n")) {
+        return false;
+    }
+    bool ok = send_chunk(fd,
+        "event: message_start\ndata: {\"type\":\"message_start\",\"message\":{\"id\":\"" + message_id +
+        "\",\"type\":\"message\",\"role\":\"assistant\",\"model\":\"mock\",\"content\":[],"
+        "\"stop_reason\":null,\"usage\":{" + usage_in + ",\"output_tokens\":1}}}\n\n"
+        "event: content_block_start\ndata: {\"type\":\"content_block_start\",\"index\":0,"
+        "\"content_block\":{\"type\":\"text\",\"text\":\"\"}}\n\n");
+    // One delta per token
+    for (size_t token = 0; ok && token * 4 < text.size(); token++) {
+        pace(start, token);
+        ok = send_chunk(fd, "event: content_block_delta\ndata: {\"type\":\"content_block_delta\",\"index\":0,"
+                            "\"delta\":{\"type\":\"text_delta\",\"text\":\"" +
+                            json_escape(text.substr(token * 4, 4)) + "\"}}\n\n");
+    }
+    ok = ok && send_chunk(fd,
+        "event: content_block_stop\ndata: {\"type\":\"content_block_stop\",\"index\":0}\n\n"
+        "event: message_delta\ndata: {\"type\":\"message_delta\",\"delta\":{\"stop_reason\":\"end_turn\","
+        "\"stop_sequence\":null},\"usage\":{\"output_tokens\":" + usage_out + "}}\n\n"
+        "event: message_stop\ndata: {\"type\":\"message_stop\"}\n\n");
+    ok = ok && send_all(fd, "0\r\n\r\n");
+    return ok && keep_alive;
+}
+
+static void serve(int fd, RateWindow& window, PromptCache& cache, std::atomic<uint64_t>& requests) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::string buffer;
+    char chunk[16384];
+    while (true) {
+        size_t head_end;
+        while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        std::string head = "\r\n" + buffer.substr(0, head_end);
+        size_t length = std::strtoul(header_value(head, "content-length").c_str(), nullptr, 10);
+        if (header_value(head, "expect") == "100-continue" && buffer.size() < head_end + 4 + length) {
+            send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n");
+        }
+        while (buffer.size() < head_end + 4 + length) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        std::string body = buffer.substr(head_end + 4, length);
+        buffer.erase(0, head_end + 4 + length);
+        if (!respond(fd, head.substr(2), body, window, cache, ++requests)) break;
+    }
+    close(fd);
+}
+
+static bool parse_options(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--port") options.port = std::atoi(value);
+        else if (arg == "--latency") options.latency_ms = std::atoi(value);
+        else if (arg == "--tokens-per-sec") options.tokens_per_sec = std::atof(value);
+        else if (arg == "--reply-tokens") options.reply_tokens = std::max(1, std::atoi(value));
+        else if (arg == "--rate-429") options.rate_429 = std::atof(value);
+        else if (arg == "--rate-529") options.rate_529 = std::atof(value);
+        else if (arg == "--rpm") options.rpm = std::strtoull(value, nullptr, 10);
+        else if (arg == "--tpm") options.tpm = std::strtoull(value, nullptr, 10);
+        else if (arg == "--seed") options.seed = static_cast<unsigned>(std::atoi(value));
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        std::cerr << "Usage: mock_api_server [--port N] [--latency MS] [--tokens-per-sec N]\n"
+                     "                       [--reply-tokens N] [--rate-429 P] [--rate-529 P]\n"
+                     "                       [--rpm N] [--tpm N] [--seed N]\n";
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 512) != 0) {
+        std::cerr << "Cannot listen on port " << options.port << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::cout << "Mock Messages API on http://127.0.0.1:" << options.port << "/v1/messages" << std::endl;
+
+    RateWindow window(options.seed);
+    PromptCache cache;
+    std::atomic<uint64_t> requests(0);
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::thread(serve, fd, std::ref(window), std::ref(cache), std::ref(requests)).detach();
+    }
+}
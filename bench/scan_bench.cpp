@@ -0,0 +1,137 @@
+// Throughput of case-insensitive substring search: the original
+// lowercase-copy + std::string::find loop against the scan engine.
+//
+// Usage: scan_bench [conversations] [messages per conversation] [message bytes]
+
+#include "scan_engine.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string random_text(std::mt19937& gen, size_t length) {
+    static const char* words[] = {
+        "the", "Quick", "brown", "fox", "JUMPS", "over", "lazy", "dog", "function",
+        "return", "value", "Memory", "thread", "index", "search", "message", "Claude"
+    };
+    std::uniform_int_distribution<size_t> pick(0, sizeof(words) / sizeof(words[0]) - 1);
+    std::string text;
+    text.reserve(length + 16);
+    while (text.size() < length) {
+        text += words[pick(gen)];
+        text += ' ';
+    }
+    text.resize(length);
+    return text;
+}
+
+// The search_messages loop this engine replaced
+static size_t baseline_search(const std::vector<MessageLog>& corpus, const std::string& query) {
+    size_t hits = 0;
+    std::string lower_query = query;
+    std::transform(lower_query.begin(), lower_query.end(), lower_query.begin(), ::tolower);
+    for (const auto& conv : corpus) {
+        for (const MessageView& msg : conv) {
+            std::string lower_content(msg.content);
+            std::transform(lower_content.begin(), lower_content.end(), lower_content.begin(), ::tolower);
+            if (lower_content.find(lower_query) != std::string::npos) hits++;
+        }
+    }
+    return hits;
+}
+
+static size_t matcher_search(const std::vector<MessageLog>& corpus,
+                             const CaseInsensitiveMatcher& matcher) {
+    size_t hits = 0;
+    for (const auto& conv : corpus) {
+        for (const MessageView& msg : conv) {
+            if (matcher.matches(msg.content.data(), msg.content.size())) hits++;
+        }
+    }
+    return hits;
+}
+
+template <typename Fn>
+static void report(const std::string& name, uint64_t bytes, Fn fn) {
+    // Best of three runs
+    double best = 1e30;
+    size_t hits = 0;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        hits = fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    std::cout << std::left << std::setw(28) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << bytes / best / 1e9 << " GB/s"
+              << std::setw(12) << best * 1000 << " ms"
+              << std::setw(10) << hits << " hits\n";
+}
+
+int main(int argc, char** argv) {
+    size_t conversations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+    size_t message_bytes = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4096;
+
+    std::mt19937 gen(42);
+    std::vector<MessageLog> corpus(conversations);
+    std::vector<std::string> ids(conversations);
+    uint64_t total_bytes = 0;
+    for (size_t c = 0; c < conversations; c++) {
+        ids[c] = "conv" + std::to_string(c);
+        for (size_t m = 0; m < messages; m++) {
+            Message msg;
+            msg.role = m % 2 ? Role::Assistant : Role::User;
+            msg.content = random_text(gen, message_bytes);
+            if ((c * messages + m) % 97 == 0) {
+                msg.content.replace(message_bytes / 2, 14, "Needle In Hay!");
+            }
+            total_bytes += msg.content.size();
+            corpus[c].push_back(msg);
+        }
+    }
+
+    std::vector<ScanSource> sources;
+    for (size_t c = 0; c < conversations; c++) {
+        sources.push_back({&ids[c], &corpus[c], nullptr, 0, SNAPSHOT_VERSION, nullptr});
+    }
+
+    const std::string query = "needle in hay";
+    std::cout << "Corpus: " << conversations << " conversations x " << messages
+              << " messages x " << message_bytes << " bytes = "
+              << std::setprecision(1) << std::fixed << total_bytes / 1e6 << " MB\n\n";
+
+    report("baseline (tolower+find)", total_bytes, [&] { return baseline_search(corpus, query); });
+
+    CaseInsensitiveMatcher matcher(query);
+    matcher.set_isa(ScanIsa::Scalar);
+    report("matcher scalar", total_bytes, [&] { return matcher_search(corpus, matcher); });
+
+    ScanIsa best = CaseInsensitiveMatcher::best_isa();
+    if (best != ScanIsa::Scalar) {
+        matcher.set_isa(ScanIsa::SSE2);
+        report("matcher SSE2", total_bytes, [&] { return matcher_search(corpus, matcher); });
+    }
+    if (best == ScanIsa::AVX2) {
+        matcher.set_isa(ScanIsa::AVX2);
+        report("matcher AVX2", total_bytes, [&] { return matcher_search(corpus, matcher); });
+    }
+
+    ScanEngine engine;
+    std::string name = "engine (" + std::to_string(engine.threads()) + " threads)";
+    report(name, total_bytes, [&] {
+        std::atomic<size_t> hits(0);
+        engine.scan(sources, query, ScanMode::Substring,
+                    [&](const std::string&, size_t, const MessageView&) { hits++; });
+        return hits.load();
+    });
+
+    return 0;
+}
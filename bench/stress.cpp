@@ -0,0 +1,238 @@
+// Concurrency stress test for ClaudeChatbot against a Messages API endpoint
+// (normally mock_api_server).
+//
+// Usage: stress [--url URL] [--threads N] [--seconds N] [--dir PATH]
+//
+// Every thread keeps a few conversations of its own and, at random, chats
+// on one of them (streaming or not), searches, lists, pages through
+// messages, deletes one of its own or deletes someone else's. Meanwhile
+// one more thread forces compactions and squeezes the memory budget so
+// conversations are paged out and back in under the others' feet. Each
+// turn is checked as it completes: unless the conversation was deleted
+// from under it, its last two messages must be the message sent and the
+// reply. At the end the conversations are reopened from disk and must
+// match what was in memory. Exits 1 on any mismatch.
+
+#include "chatbot.h"
+#include "conversation_files.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string url = "http://127.0.0.1:8080/v1/messages";
+    size_t threads = 16;
+    double seconds = 10;
+    std::string dir = "stress_data";
+};
+
+struct Counts {
+    std::atomic<uint64_t> turns{0};
+    std::atomic<uint64_t> lost_turns{0};    // conversation deleted meanwhile
+    std::atomic<uint64_t> searches{0};
+    std::atomic<uint64_t> listings{0};
+    std::atomic<uint64_t> deletes{0};
+    std::atomic<uint64_t> compactions{0};
+    std::atomic<uint64_t> failures{0};
+};
+
+static std::mutex report_mutex;
+
+static void fail(Counts& counts, const std::string& what) {
+    counts.failures++;
+    std::lock_guard<std::mutex> lock(report_mutex);
+    std::cerr << "FAIL: " << what << "\n";
+}
+
+static void clear_directory(const std::string& dir) {
+    ConversationFiles files;
+    files.set_directory(dir);
+    files.remove_orphans(std::unordered_set<std::string>());
+    rmdir(files.block_directory().c_str());
+    for (const char* name : {"catalog.dat", "conversations.journal", "search.idx",
+                             "search.idx.tmp", "catalog.dat.tmp"}) {
+        std::remove((dir + "/" + name).c_str());
+    }
+}
+
+// Sends one message and checks it landed as the last turn of the conversation.
+static void chat(ClaudeChatbot& bot, const std::string& id, bool stream, std::mt19937& rng, Counts& counts) {
+    std::string message = "stress " + std::to_string(rng() % 1000) + " word" + std::to_string(rng() % 50);
+    std::string reply;
+    if (stream) {
+        std::string streamed;
+        reply = bot.send_message_async(id, message, [&](const std::string& text) { streamed += text; },
+                                       CachePolicy::Bypass).get();
+        if (reply.compare(0, 6, "Error:") != 0 && streamed != reply) {
+            fail(counts, "streamed text differs from the reply in " + id);
+        }
+    } else {
+        reply = bot.send_message(id, message, CachePolicy::Bypass);
+    }
+
+    if (!bot.has_conversation(id)) {
+        counts.lost_turns++;
+        return;
+    }
+    if (reply.compare(0, 6, "Error:") == 0) {
+        fail(counts, "turn on " + id + " failed: " + reply);
+        return;
+    }
+
+    std::vector<std::string> last(2);
+    size_t count = 0;
+    bot.for_each_message(id, [&](size_t, const MessageView& view) {
+        last[0] = last[1];
+        last[1] = std::string(view.content);
+        count++;
+    });
+    // Deleted after the check above
+    if (count == 0 && !bot.has_conversation(id)) {
+        counts.lost_turns++;
+        return;
+    }
+    if (count % 2 != 0 || last[0] != message || last[1] != reply) {
+        fail(counts, "conversation " + id + " does not end with the turn just sent");
+        return;
+    }
+    counts.turns++;
+}
+
+static void run_worker(ClaudeChatbot& bot, size_t worker, Clock::time_point deadline, Counts& counts) {
+    std::mt19937 rng(static_cast<unsigned>(worker * 7919 + 1));
+    std::vector<std::string> own;
+
+    while (Clock::now() < deadline) {
+        unsigned op = rng() % 100;
+        if (own.empty() || op < 10) {
+            own.push_back(bot.create_conversation("stress " + std::to_string(worker)));
+        } else if (op < 55) {
+            chat(bot, own[rng() % own.size()], rng() % 2 == 0, rng, counts);
+        } else if (op < 70) {
+            bot.search_ranked("word" + std::to_string(rng() % 50), 10);
+            bot.search_messages("stress " + std::to_string(rng() % 1000));
+            counts.searches++;
+        } else if (op < 85) {
+            std::vector<ConversationSummary> page = bot.list_conversations(rng() % 8, 20);
+            for (const auto& summary : page) {
+                bot.for_each_message(summary.id, [](size_t, const MessageView&) {}, 0, 4);
+            }
+            bot.get_conversation_count();
+            counts.listings++;
+        } else if (op < 95) {
+            size_t victim = rng() % own.size();
+            bot.delete_conversation(own[victim]);
+            own.erase(own.begin() + victim);
+            counts.deletes++;
+        } else {
+            std::vector<ConversationSummary> page = bot.list_conversations(0, 50);
+            if (!page.empty()) {
+                bot.delete_conversation(page[rng() % page.size()].id);
+                counts.deletes++;
+            }
+        }
+        // Forget our conversations that someone else deleted
+        for (size_t i = 0; i < own.size();) {
+            if (bot.has_conversation(own[i])) i++;
+            else own.erase(own.begin() + i);
+        }
+    }
+}
+
+static void run_compactor(ClaudeChatbot& bot, Clock::time_point deadline, Counts& counts) {
+    uint64_t budgets[] = {0, 64 * 1024, 256 * 1024 * 1024};
+    size_t round = 0;
+    while (Clock::now() < deadline) {
+        bot.set_memory_budget(budgets[round++ % 3]);
+        bot.save_conversations();
+        counts.compactions++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+static std::map<std::string, size_t> message_counts(ClaudeChatbot& bot) {
+    std::map<std::string, size_t> result;
+    for (const auto& summary : bot.list_conversations()) {
+        result[summary.id] = summary.message_count;
+    }
+    return result;
+}
+
+static bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--url" && has_value) options.url = argv[++i];
+        else if (arg == "--dir" && has_value) options.dir = argv[++i];
+        else if (arg == "--threads" && has_value) options.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seconds" && has_value) options.seconds = std::strtod(argv[++i], nullptr);
+        else return false;
+    }
+    return options.threads > 0 && options.seconds > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: stress [--url URL] [--threads N] [--seconds N] [--dir PATH]\n";
+        return 1;
+    }
+    mkdir(options.dir.c_str(), 0755);
+    clear_directory(options.dir);
+
+    Counts counts;
+    std::map<std::string, size_t> before;
+    {
+        ClaudeChatbot bot("stress", "claude-sonnet-4-20250514", 1000, options.dir);
+        bot.set_api_url(options.url);
+
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(
+            static_cast<int64_t>(options.seconds * 1000));
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < options.threads; t++) {
+            threads.emplace_back(run_worker, std::ref(bot), t, deadline, std::ref(counts));
+        }
+        threads.emplace_back(run_compactor, std::ref(bot), deadline, std::ref(counts));
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        bot.flush();
+        before = message_counts(bot);
+    }
+    {
+        ClaudeChatbot reopened("stress", "claude-sonnet-4-20250514", 1000, options.dir);
+        std::map<std::string, size_t> after = message_counts(reopened);
+        // Reopening an empty store starts a fresh conversation
+        if (before.empty() && after.size() == 1 && after.begin()->second == 0) after.clear();
+        if (after != before) {
+            fail(counts, "reopened store has " + std::to_string(after.size()) + " conversations, expected " +
+                 std::to_string(before.size()) + " with the same message counts");
+        }
+    }
+    clear_directory(options.dir);
+    rmdir(options.dir.c_str());
+
+    std::cout << "Threads:      " << options.threads << " for " << options.seconds << " s\n"
+              << "Turns:        " << counts.turns << " checked, " << counts.lost_turns
+              << " on conversations deleted meanwhile\n"
+              << "Searches:     " << counts.searches << "\n"
+              << "Listings:     " << counts.listings << "\n"
+              << "Deletes:      " << counts.deletes << "\n"
+              << "Compactions:  " << counts.compactions << "\n"
+              << "Failures:     " << counts.failures << "\n";
+    return counts.failures == 0 ? 0 : 1;
+}
@@ -73,11 +73,11 @@ elif [ -f "Makefile" ]; then
 else
     echo "Using direct compilation..."
     if [[ "$PLATFORM" == "Windows" ]]; then
-        g++ -std=c++17 -Iinclude src/main.cpp src/chatbot.cpp -lcurl -lws2_32 -o claude_chatbot.exe
+        g++ -std=c++17 -I. main.cpp chatbot.cpp journal.cpp mapped_file.cpp snapshot.cpp search_index.cpp scan_engine.cpp http_transport.cpp json.cpp sse_parser.cpp json_parser.cpp response_parser.cpp context_manager.cpp response_cache.cpp conversation_store.cpp conversation.cpp lz_codec.cpp background_writer.cpp conversation_files.cpp metrics.cpp http_server.cpp api_server.cpp request_scheduler.cpp batch.cpp -lcurl -lws2_32 -o claude_chatbot.exe
         echo ""
         echo "✓ Build complete! Executable: claude_chatbot.exe"
     else
-        g++ -std=c++17 -Iinclude src/main.cpp src/chatbot.cpp -lcurl -o claude_chatbot
+        g++ -std=c++17 -I. main.cpp chatbot.cpp journal.cpp mapped_file.cpp snapshot.cpp search_index.cpp scan_engine.cpp http_transport.cpp json.cpp sse_parser.cpp json_parser.cpp response_parser.cpp context_manager.cpp response_cache.cpp conversation_store.cpp conversation.cpp lz_codec.cpp background_writer.cpp conversation_files.cpp metrics.cpp http_server.cpp api_server.cpp request_scheduler.cpp batch.cpp -lcurl -pthread -o claude_chatbot
         chmod +x claude_chatbot
         echo ""
         echo "✓ Build complete! Executable: claude_chatbot"
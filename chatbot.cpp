@@ -1,4 +1,7 @@
 #include "chatbot.h"
+#include "snapshot.h"
+#include "json.h"
+#include "response_parser.h"
 #include <iostream>
 #include <sstream>
 #include <chrono>
@@ -6,6 +9,7 @@
 #include <algorithm>
 #include <ctime>
 #include <random>
+#include <cstdio>
 
 // Platform-specific includes
 #ifdef PLATFORM_WINDOWS
@@ -17,33 +21,58 @@
     #include <unistd.h>
 #endif
 
-// Simple HTTP client using curl (cross-platform)
-#ifdef PLATFORM_WINDOWS
-    #pragma comment(lib, "ws2_32.lib")
-#endif
+// Compact the journal into the conversation files once it reaches this size,
+// so replay cost stays bounded. A compaction rewrites only the conversations
+// that changed, so each turn's I/O stays amortized O(new data).
+static const uint64_t COMPACTION_BYTES = 4 * 1024 * 1024;
+static const uint64_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+const char* const DEFAULT_API_URL = "https://api.anthropic.com/v1/messages";
+static const char STREAM_FIELD[] = ",\"stream\":true";
 
-#include <curl/curl.h>
+// Prompt caching. The API does not cache prefixes shorter than this (2048
+// tokens on Haiku), so shorter requests are sent without breakpoints.
+static const uint64_t PROMPT_CACHE_MIN_TOKENS = 1024;
+static const char CACHE_CONTROL[] = ",\"cache_control\":{\"type\":\"ephemeral\"}";
 
-// Callback for curl to write response
-static size_t write_callback(void* contents, size_t size, size_t nmemb, std::string* userp) {
-    size_t total_size = size * nmemb;
-    userp->append((char*)contents, total_size);
-    return total_size;
+static uint64_t micros_since(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
 }
 
-ClaudeChatbot::ClaudeChatbot(const std::string& api_key, const std::string& model, int max_tokens)
-    : api_key(api_key), model(model), max_tokens(max_tokens) {
-    data_dir = get_data_directory();
+ClaudeChatbot::ClaudeChatbot(const std::string& api_key, const std::string& model, int max_tokens,
+                             const std::string& data_directory, std::shared_ptr<RequestScheduler> scheduler)
+    : api_key(api_key), api_url(DEFAULT_API_URL), model(model), max_tokens(max_tokens), prompt_caching(true),
+      catalog_generation(0),
+      memory_budget(DEFAULT_MEMORY_BUDGET), resident_bytes(0), use_clock(0), summary_jobs(0),
+      outstanding_calls(0), owns_scheduler(!scheduler),
+      scheduler(scheduler ? std::move(scheduler) : std::make_shared<RequestScheduler>()) {
+    data_dir = data_directory.empty() ? get_data_directory() : data_directory;
     create_directory(data_dir);
+    files.set_directory(data_dir);
+    writer.set_journal_path(data_dir + "/conversations.journal");
+    writer.set_compaction([this](uint64_t& covered) { return write_conversation_files(covered); });
+    writer.set_metrics(&metrics);
     load_conversations();
     
-    if (conversations.empty()) {
+    {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        std::lock_guard<std::shared_mutex> lock(store_mutex);
+        if (!conversations.empty()) {
+            current_conversation = conversations.handle(conversations.front()->id);
+        }
+    }
+    if (!current_conversation.valid()) {
         start_new_conversation("New Chat");
-    } else {
-        current_conversation_id = conversations[0].id;
     }
 }
 
+ClaudeChatbot::~ClaudeChatbot() {
+    if (owns_scheduler) scheduler->shutdown();
+    std::unique_lock<std::mutex> lock(calls_mutex);
+    calls_finished.wait(lock, [this] { return outstanding_calls == 0; });
+}
+
 std::string ClaudeChatbot::get_data_directory() {
 #ifdef PLATFORM_WINDOWS
     char* appdata = getenv("APPDATA");
@@ -64,7 +93,7 @@ std::string ClaudeChatbot::get_data_directory() {
 #endif
 }
 
-bool ClaudeChatbot::create_directory(const std::string& path) {
+static bool make_directory(const std::string& path) {
 #ifdef PLATFORM_WINDOWS
     return _mkdir(path.c_str()) == 0 || errno == EEXIST;
 #else
@@ -72,10 +101,20 @@ bool ClaudeChatbot::create_directory(const std::string& path) {
 #endif
 }
 
+// Creates path along with any missing parents
+bool ClaudeChatbot::create_directory(const std::string& path) {
+    for (size_t separator = path.find_first_of("/\\", 1); separator != std::string::npos;
+         separator = path.find_first_of("/\\", separator + 1)) {
+        make_directory(path.substr(0, separator));
+    }
+    return make_directory(path);
+}
+
 std::string ClaudeChatbot::generate_id() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
+    // Per thread: several instances may create conversations at once
+    thread_local std::random_device rd;
+    thread_local std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dis(0, 15);
     
     std::stringstream ss;
     ss << std::hex;
@@ -85,289 +124,1255 @@ std::string ClaudeChatbot::generate_id() {
     return ss.str();
 }
 
-std::string ClaudeChatbot::get_timestamp() {
+int64_t ClaudeChatbot::get_timestamp() {
     auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+    return std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
 }
 
-std::string ClaudeChatbot::escape_json(const std::string& str) {
-    std::string result;
-    for (char c : str) {
-        switch (c) {
-            case '"': result += "\\\""; break;
-            case '\\': result += "\\\\"; break;
-            case '\n': result += "\\n"; break;
-            case '\r': result += "\\r"; break;
-            case '\t': result += "\\t"; break;
-            default: result += c; break;
-        }
+void ClaudeChatbot::build_messages_json(Conversation& conv) {
+    std::string& json = conv.request_json;
+    size_t added = 0;
+    for (size_t i = conv.request_json_count(); i < conv.messages.size(); i++) {
+        added += conv.messages[i].content.size() + 40;
+    }
+    json.reserve(json.size() + added);
+    
+    uint64_t tokens = conv.token_totals.empty() ? 0 : conv.token_totals.back();
+    for (size_t i = conv.request_json_count(); i < conv.messages.size(); i++) {
+        MessageView msg = conv.messages[i];
+        if (i > 0) json += ',';
+        conv.request_json_offsets.push_back(json.size());
+        json += "{\"role\":\"";
+        json += role_name(msg.role);
+        json += "\",\"content\":\"";
+        append_json_escaped(json, msg.content.data(), msg.content.size());
+        json += "\"}";
+        
+        tokens += ContextManager::estimate_tokens(msg);
+        conv.token_totals.push_back(tokens);
     }
-    return result;
 }
 
-std::string ClaudeChatbot::build_messages_json(const std::vector<Message>& messages) {
-    std::stringstream ss;
-    ss << "[";
-    for (size_t i = 0; i < messages.size(); i++) {
-        ss << "{\"role\":\"" << messages[i].role << "\","
-           << "\"content\":\"" << escape_json(messages[i].content) << "\"}";
-        if (i < messages.size() - 1) ss << ",";
+HttpRequest ClaudeChatbot::build_api_request(const std::string& body, bool stream) {
+    HttpRequest request;
+    request.url = get_api_url();
+    request.headers = {
+        "Content-Type: application/json",
+        "x-api-key: " + api_key,
+        "anthropic-version: 2023-06-01"
+    };
+    if (stream) {
+        request.headers.push_back("Accept: text/event-stream");
     }
-    ss << "]";
-    return ss.str();
+    request.body = body;
+    return request;
+}
+
+static void append_system_block(std::string& body, const std::string& text, bool cache) {
+    body += "{\"type\":\"text\",\"text\":\"";
+    append_json_escaped(body, text.data(), text.size());
+    body += '"';
+    if (cache) body += CACHE_CONTROL;
+    body += '}';
+}
+
+// Appends a message as serialized by build_messages_json, {"role":...,
+// "content":"..."}, turned into a single text block carrying a cache
+// breakpoint. The escaped text is copied over as it is.
+static void append_cached_message(std::string& body, const std::string& json, size_t begin) {
+    static const char CONTENT_KEY[] = "\"content\":";
+    size_t content = json.find(CONTENT_KEY, begin) + sizeof(CONTENT_KEY) - 1;
+    size_t text_size = json.size() - 1 - content;
+    // Empty text blocks are rejected, and there would be nothing to cache
+    if (text_size <= 2) {
+        body.append(json, begin, std::string::npos);
+        return;
+    }
+    body.append(json, begin, content - begin);
+    body += "[{\"type\":\"text\",\"text\":";
+    body.append(json, content, text_size);
+    body += CACHE_CONTROL;
+    body += "}]}";
 }
 
-std::string ClaudeChatbot::http_post(const std::string& url, const std::string& json_data) {
-    CURL* curl;
-    CURLcode res;
-    std::string response;
+// Breakpoints go after the system prompt, which is the same for every
+// request; after the summary, which stays put while old turns drop out of
+// the window behind it; and on the newest message, whose prefix the next
+// turn of the conversation starts with. Each only if what comes before it
+// is long enough to be cached.
+std::string ClaudeChatbot::build_request_body(Conversation& conv, bool stream, const ContextPlan& plan,
+                                              bool with_system_prompt) {
+    build_messages_json(conv);
     
-    curl = curl_easy_init();
-    if (!curl) {
-        return "{\"error\":\"Failed to initialize curl\"}";
+    size_t count = conv.request_json_count();
+    size_t first = std::min(plan.first_message, count);
+    size_t messages_start = first < count ? conv.request_json_offsets[first] : 0;
+    
+    std::string summary;
+    if (plan.use_summary) {
+        summary = ContextManager::summary_preamble(conv.summary);
     }
     
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, ("x-api-key: " + api_key).c_str());
-    headers = curl_slist_append(headers, "anthropic-version: 2023-06-01");
+    std::string body;
+    std::string system;
+    bool caching;
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        if (with_system_prompt) system = system_prompt;
+        caching = prompt_caching;
+        body.reserve(conv.request_json.size() - messages_start + model.size() + system.size() +
+                     summary.size() + 160);
+        body += "{\"model\":\"";
+        body += model;
+        body += "\",\"max_tokens\":";
+        body += std::to_string(max_tokens);
+    }
     
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    uint64_t prefix_tokens = ContextManager::estimate_tokens(system.data(), system.size());
+    bool cache_system = caching && prefix_tokens >= PROMPT_CACHE_MIN_TOKENS;
+    prefix_tokens += ContextManager::estimate_tokens(summary.data(), summary.size());
+    bool cache_summary = caching && prefix_tokens >= PROMPT_CACHE_MIN_TOKENS;
+    if (count > first) {
+        prefix_tokens += conv.token_totals.back() - (first ? conv.token_totals[first - 1] : 0);
+    }
+    bool cache_messages = caching && count > first && prefix_tokens >= PROMPT_CACHE_MIN_TOKENS;
+    
+    if (!system.empty() || !summary.empty()) {
+        body += ",\"system\":[";
+        if (!system.empty()) {
+            append_system_block(body, system, cache_system);
+            if (!summary.empty()) body += ',';
+        }
+        if (!summary.empty()) {
+            append_system_block(body, summary, cache_summary);
+        }
+        body += ']';
+    }
+    body += ",\"messages\":[";
+    if (cache_messages) {
+        size_t last = conv.request_json_offsets.back();
+        body.append(conv.request_json, messages_start, last - messages_start);
+        append_cached_message(body, conv.request_json, last);
+    } else {
+        body.append(conv.request_json, messages_start, std::string::npos);
+    }
+    body += ']';
+    // Last, so the rest of the body is the same with or without it and
+    // keys the response cache
+    if (stream) {
+        body += STREAM_FIELD;
+    }
+    body += '}';
+    return body;
+}
+
+// Called with the conversation locked. Claims the next stretch of old turns
+// for folding into the conversation's summary; false if a summary is
+// already in flight or there is nothing to fold.
+bool ClaudeChatbot::plan_summary(Conversation& conv, size_t target, SummaryJob& job) {
+    if (conv.summary_job != 0 || target <= conv.summary_covers) return false;
+    
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        job.end = context.summary_chunk_end(conv, target);
+        job.prompt = context.build_summary_prompt(conv, conv.summary_covers, job.end);
+    }
+    job.conversation_id = conv.id;
+    job.job = ++summary_jobs;
+    conv.summary_job = job.job;
+    return true;
+}
+
+// Sends a claimed summary as a separate request; the result lands on the
+// transport thread and is journaled like any other change.
+void ClaudeChatbot::send_summary(SummaryJob job) {
+    std::string prompt = std::move(job.prompt);
+    send_completion(prompt, false, [this, job](ApiReply&& reply) {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        Locked<WriteLock> conv = lock_conversation<WriteLock>(job.conversation_id);
+        // A clear or delete in the meantime makes the result meaningless
+        if (!conv || conv->summary_job != job.job) return;
+        conv->summary_job = 0;
+        if (!reply.ok() || reply.text.empty()) return;
+        
+        conv->summary = reply.text;
+        conv->summary_covers = job.end;
+        
+        JournalRecord record;
+        record.type = JournalRecordType::SetSummary;
+        record.conversation_id = job.conversation_id;
+        record.message_index = job.end;
+        record.message.content = reply.text;
+        commit(record);
+    }, CachePolicy::Use);
+}
+
+// Called with no locks held. Answers from the response cache when
+// allowed, otherwise hands the request to the scheduler, which paces and
+// retries it; each attempt decodes the reply as curl delivers it, passing
+// streamed deltas straight on to on_text. Once any text has gone to
+// on_text the call is no longer retried. done runs on the transport
+// thread, or right away on a cache hit. serialize_us is how long building
+// body took, for the reply's metrics.
+void ClaudeChatbot::send_request(const std::string& body, uint64_t serialize_us, bool stream,
+                                 const std::function<void(const std::string&)>& on_text,
+                                 CachePolicy cache, std::function<void(const ApiReply&)> done) {
+    bool cached = response_cache.is_open();
+    ResponseCache::Key key;
+    if (cached) {
+        size_t key_length = body.size() - 1 - (stream ? sizeof(STREAM_FIELD) - 1 : 0);
+        key = ResponseCache::make_key(body.data(), key_length);
+        ApiReply hit;
+        if (cache == CachePolicy::Use && response_cache.lookup(key, hit)) {
+            hit.metrics.serialize_us = serialize_us;
+            hit.metrics.cache_hit = true;
+            record_request_metrics(hit);
+            if (on_text) on_text(hit.text);
+            done(hit);
+            return;
+        }
+    }
     
-    res = curl_easy_perform(curl);
+    // The parser of the attempt in flight. The scheduler's dispatch thread
+    // sets it and the transport thread reads it, one after the other.
+    auto parser = std::make_shared<std::shared_ptr<ApiResponseParser>>();
+    auto streamed = std::make_shared<std::atomic<bool>>(false);
+    auto request_body = std::make_shared<const std::string>(body);
     
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    ScheduledCall call;
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        call.tokens = ContextManager::estimate_tokens(body.data(), body.size()) +
+                      static_cast<uint64_t>(std::max(max_tokens, 0));
+    }
+    call.prepare = [this, parser, streamed, request_body, stream, on_text]() {
+        HttpRequest request = build_api_request(*request_body, stream);
+        std::function<void(const std::string&)> forward;
+        if (on_text) {
+            forward = [streamed, on_text](const std::string& text) {
+                *streamed = true;
+                on_text(text);
+            };
+        }
+        auto attempt = std::make_shared<ApiResponseParser>(stream, forward);
+        *parser = attempt;
+        request.on_data = [attempt](const char* data, size_t size) {
+            auto start = std::chrono::steady_clock::now();
+            bool more = attempt->feed(data, size);
+            attempt->reply().metrics.parse_us += micros_since(start);
+            return more;
+        };
+        return request;
+    };
+    call.decode = [parser, serialize_us](HttpResponse&& response) {
+        ApiResponseParser& attempt = **parser;
+        auto start = std::chrono::steady_clock::now();
+        attempt.finish(response.status, response.error);
+        
+        RequestMetrics& request_metrics = attempt.reply().metrics;
+        request_metrics.parse_us += micros_since(start);
+        request_metrics.serialize_us = serialize_us;
+        request_metrics.namelookup_us = response.timing.namelookup_us;
+        request_metrics.connect_us = response.timing.connect_us;
+        request_metrics.appconnect_us = response.timing.appconnect_us;
+        request_metrics.starttransfer_us = response.timing.starttransfer_us;
+        request_metrics.total_us = response.timing.total_us;
+        request_metrics.bytes_sent = response.timing.bytes_sent;
+        request_metrics.bytes_received = response.timing.bytes_received;
+        request_metrics.connection_reused = response.connection_reused;
+        return attempt.reply();
+    };
+    call.can_retry = [streamed]() { return !*streamed; };
+    call.done = [this, cached, key, done](ApiReply&& reply) {
+        record_request_metrics(reply);
+        if (cached) {
+            response_cache.store(key, reply);
+        }
+        done(reply);
+        // Last: once the count drops to zero the destructor may go ahead
+        std::lock_guard<std::mutex> lock(calls_mutex);
+        if (--outstanding_calls == 0) calls_finished.notify_all();
+    };
+    call.metrics = &metrics;
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex);
+        outstanding_calls++;
+    }
+    scheduler->submit(std::move(call));
+}
+
+// Folds one reply into the histograms. Network figures only exist for
+// requests that were actually sent.
+void ClaudeChatbot::record_request_metrics(const ApiReply& reply) {
+    const RequestMetrics& request = reply.metrics;
+    metrics.add("chatbot_requests_total");
+    if (!reply.ok()) metrics.add("chatbot_request_errors_total");
+    metrics.add("chatbot_input_tokens_total", reply.usage.input_tokens);
+    metrics.add("chatbot_output_tokens_total", reply.usage.output_tokens);
+    metrics.add("chatbot_cache_creation_input_tokens_total", reply.usage.cache_creation_input_tokens);
+    metrics.add("chatbot_cache_read_input_tokens_total", reply.usage.cache_read_input_tokens);
+    metrics.observe("chatbot_request_serialize_microseconds", request.serialize_us);
+    if (request.cache_hit) {
+        metrics.add("chatbot_response_cache_hits_total");
+        return;
+    }
     
-    if (res != CURLE_OK) {
-        return "{\"error\":\"" + std::string(curl_easy_strerror(res)) + "\"}";
+    if (request.connection_reused) metrics.add("chatbot_connections_reused_total");
+    metrics.add("chatbot_sent_bytes_total", request.bytes_sent);
+    metrics.add("chatbot_received_bytes_total", request.bytes_received);
+    metrics.observe("chatbot_request_namelookup_microseconds", request.namelookup_us);
+    metrics.observe("chatbot_request_connect_microseconds", request.connect_us);
+    metrics.observe("chatbot_request_appconnect_microseconds", request.appconnect_us);
+    metrics.observe("chatbot_request_starttransfer_microseconds", request.starttransfer_us);
+    metrics.observe("chatbot_request_total_microseconds", request.total_us);
+    metrics.observe("chatbot_request_sent_bytes", request.bytes_sent);
+    metrics.observe("chatbot_request_received_bytes", request.bytes_received);
+    metrics.observe("chatbot_request_parse_microseconds", request.parse_us);
+    metrics.observe("chatbot_request_attempts", request.attempts);
+    if (reply.ok()) {
+        metrics.observe("chatbot_request_input_tokens", reply.usage.input_tokens);
+        metrics.observe("chatbot_request_output_tokens", reply.usage.output_tokens);
+        metrics.observe("chatbot_request_cache_read_input_tokens", reply.usage.cache_read_input_tokens);
+        metrics.observe("chatbot_request_cache_creation_input_tokens", reply.usage.cache_creation_input_tokens);
     }
+}
+
+// Every turn, synchronous or not, goes through a per-conversation queue so a
+// conversation only ever has one request in flight and its history stays
+// strictly user/assistant alternating, in the order the journal expects.
+std::future<std::string> ClaudeChatbot::enqueue_turn(const std::string& conversation_id,
+                                                     const std::string& user_message,
+                                                     const std::function<void(const std::string&)>& on_text,
+                                                     CachePolicy cache,
+                                                     std::function<void(const std::string&)> on_reply) {
+    auto turn = std::make_shared<PendingTurn>();
+    turn->conversation_id = conversation_id;
+    turn->user_message = user_message;
+    turn->on_text = on_text;
+    turn->on_reply = std::move(on_reply);
+    turn->cache = cache;
+    std::future<std::string> result = turn->promise.get_future();
     
-    return response;
+    {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        std::shared_lock<std::shared_mutex> lock(store_mutex);
+        turn->conversation = conversations.handle(conversation_id);
+    }
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(turns_mutex);
+        auto& queue = pending_turns[conversation_id];
+        queue.push_back(turn);
+        first = queue.size() == 1;
+    }
+    if (first) {
+        run_turns(turn);
+    }
+    return result;
 }
 
-std::string ClaudeChatbot::send_message(const std::string& user_message) {
-    Conversation* conv = get_current_conversation();
-    if (!conv) {
-        start_new_conversation("New Chat");
-        conv = get_current_conversation();
-    }
-    
-    // Add user message
-    Message user_msg;
-    user_msg.role = "user";
-    user_msg.content = user_message;
-    user_msg.timestamp = get_timestamp();
-    conv->messages.push_back(user_msg);
-    
-    // Build API request
-    std::stringstream request_body;
-    request_body << "{"
-                 << "\"model\":\"" << model << "\","
-                 << "\"max_tokens\":" << max_tokens << ","
-                 << "\"messages\":" << build_messages_json(conv->messages)
-                 << "}";
-    
-    // Send to API
-    std::string response = http_post("https://api.anthropic.com/v1/messages", request_body.str());
-    
-    // Parse response (simple parsing - in production use a JSON library)
-    std::string assistant_response = "Error: Could not parse response";
-    size_t content_pos = response.find("\"text\":\"");
-    if (content_pos != std::string::npos) {
-        content_pos += 8;
-        size_t end_pos = response.find("\"", content_pos);
-        if (end_pos != std::string::npos) {
-            assistant_response = response.substr(content_pos, end_pos - content_pos);
+// Starts turn, then each turn that became ready meanwhile. A turn answered
+// from the cache completes inside start_turn; the one queued behind it is
+// handed back to the loop here instead of being started from within, so a
+// run of cached turns does not nest and each caller hears back before the
+// next turn starts.
+void ClaudeChatbot::run_turns(std::shared_ptr<PendingTurn> turn) {
+    struct Runner {
+        ClaudeChatbot* bot;
+        std::deque<std::shared_ptr<PendingTurn>> ready;
+    };
+    thread_local Runner* running = nullptr;
+    if (running && running->bot == this) {
+        running->ready.push_back(std::move(turn));
+        return;
+    }
+    Runner runner{this, {}};
+    runner.ready.push_back(std::move(turn));
+    Runner* outer = running;
+    running = &runner;
+    while (!runner.ready.empty()) {
+        std::shared_ptr<PendingTurn> next = std::move(runner.ready.front());
+        runner.ready.pop_front();
+        start_turn(next);
+    }
+    running = outer;
+}
+
+// Builds the request with the conversation locked, then sends it with
+// nothing locked: a cache hit completes the turn right away.
+void ClaudeChatbot::start_turn(std::shared_ptr<PendingTurn> turn) {
+    bool stream = static_cast<bool>(turn->on_text);
+    std::string body;
+    uint64_t serialize_us = 0;
+    SummaryJob summary;
+    bool summarize = false;
+    bool load_failed = false;
+    {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        Locked<WriteLock> conv = lock_conversation<WriteLock>(turn->conversation);
+        if (conv && !ensure_loaded(*conv)) {
+            load_failed = true;
+        } else if (conv) {
+            // Add user message
+            append_message(*conv, MessageView(Role::User, turn->user_message, get_timestamp()));
+            turn->user_index = conv->message_count - 1;
+            turn->started = true;
             
-            // Unescape JSON
-            size_t pos = 0;
-            while ((pos = assistant_response.find("\\n", pos)) != std::string::npos) {
-                assistant_response.replace(pos, 2, "\n");
-                pos += 1;
+            // Keep the request under the context budget
+            auto start = std::chrono::steady_clock::now();
+            build_messages_json(*conv);
+            ContextPlan plan;
+            {
+                std::lock_guard<std::mutex> settings(settings_mutex);
+                plan = context.plan(*conv, ContextManager::estimate_tokens(system_prompt.data(),
+                                                                           system_prompt.size()));
             }
-            pos = 0;
-            while ((pos = assistant_response.find("\\\"", pos)) != std::string::npos) {
-                assistant_response.replace(pos, 2, "\"");
-                pos += 1;
+            serialize_us = micros_since(start);
+            if (plan.summarize_to > 0) {
+                summarize = plan_summary(*conv, plan.summarize_to, summary);
             }
+            
+            start = std::chrono::steady_clock::now();
+            body = build_request_body(*conv, stream, plan);
+            serialize_us += micros_since(start);
         }
     }
+    if (!turn->started) {
+        ApiReply missing;
+        missing.error.type = load_failed ? "api_error" : "not_found_error";
+        missing.error.message = load_failed ? "Conversation could not be read from disk" : "Conversation not found";
+        complete_turn(turn, missing);
+        return;
+    }
+    if (summarize) {
+        send_summary(std::move(summary));
+    }
+    send_request(body, serialize_us, stream, turn->on_text, turn->cache,
+        [this, turn](const ApiReply& reply) {
+            complete_turn(turn, reply);
+        });
+}
+
+// Runs on the transport thread once the reply is in, retries and all. A
+// failed turn leaves nothing behind; the error only goes to the caller.
+void ClaudeChatbot::complete_turn(std::shared_ptr<PendingTurn> turn, const ApiReply& api_reply) {
+    std::string reply = api_reply.ok() ? api_reply.text : "Error: " + api_reply.error.message;
+    ApiReply recorded = api_reply;
+    if (turn->started) {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        Locked<WriteLock> conv = lock_conversation<WriteLock>(turn->conversation);
+        if (conv && conv->message_count == turn->user_index + 1) {
+            auto start = std::chrono::steady_clock::now();
+            // A compaction may have evicted it meanwhile
+            if (!ensure_loaded(*conv)) {
+                reply = "Error: Conversation could not be read from disk";
+                recorded.error.type = "api_error";
+                recorded.error.message = "Conversation could not be read from disk";
+            } else if (api_reply.ok()) {
+                finish_turn(*conv, reply);
+                recorded.metrics.persist_us = micros_since(start);
+                metrics.observe("chatbot_turn_persist_microseconds", recorded.metrics.persist_us);
+            } else {
+                rollback_turn(*conv);
+                metrics.add("chatbot_turns_rolled_back_total");
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex);
+        last_reply = std::move(recorded);
+    }
     
+    std::shared_ptr<PendingTurn> next;
+    {
+        std::lock_guard<std::mutex> lock(turns_mutex);
+        auto it = pending_turns.find(turn->conversation_id);
+        if (it != pending_turns.end()) {
+            it->second.pop_front();
+            if (it->second.empty()) {
+                pending_turns.erase(it);
+            } else {
+                next = it->second.front();
+            }
+        }
+    }
+    turn->promise.set_value(reply);
+    if (turn->on_reply) turn->on_reply(reply);
+    if (next) {
+        run_turns(next);
+    }
+}
+
+// Called with the conversation locked
+void ClaudeChatbot::finish_turn(Conversation& conv, const std::string& assistant_response) {
     // Add assistant message
-    Message assistant_msg;
-    assistant_msg.role = "assistant";
-    assistant_msg.content = assistant_response;
-    assistant_msg.timestamp = get_timestamp();
-    conv->messages.push_back(assistant_msg);
+    int64_t now = get_timestamp();
+    append_message(conv, MessageView(Role::Assistant, assistant_response, now));
+    conv.last_modified = now;
     
-    conv->last_modified = get_timestamp();
-    save_conversations();
+    JournalRecord records[2];
+    for (size_t i = 0; i < 2; i++) {
+        JournalRecord& record = records[i];
+        record.type = JournalRecordType::AddMessage;
+        record.conversation_id = conv.id;
+        record.message_index = conv.messages.size() - 2 + i;
+        record.message = Message(conv.messages[record.message_index]);
+    }
+    
+    std::lock_guard<std::shared_mutex> lock(store_mutex);
+    conversations.move_to_front(conv.id);
+    commit(records[0]);
+    commit(records[1]);
+}
+
+// Called with the conversation locked. Takes back the user message of a
+// turn that failed. It was never journaled, but a compaction may have
+// written it out meanwhile, so the removal is journaled: replay after a
+// crash then drops it from the block file too.
+void ClaudeChatbot::rollback_turn(Conversation& conv) {
+    JournalRecord record;
+    record.type = JournalRecordType::TruncateConversation;
+    record.conversation_id = conv.id;
+    record.message_index = conv.message_count - 1;
+    truncate_messages(conv, static_cast<size_t>(record.message_index));
+    commit(record);
+}
+
+std::string ClaudeChatbot::current_conversation_for_send() {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::lock_guard<std::shared_mutex> lock(store_mutex);
+    const Conversation* conv = conversations.get(current_conversation);
+    if (conv) {
+        return conv->id;
+    }
+    std::string id = add_conversation("New Chat");
+    current_conversation = conversations.handle(id);
+    return id;
+}
+
+std::string ClaudeChatbot::send_message(const std::string& user_message, CachePolicy cache) {
+    return enqueue_turn(current_conversation_for_send(), user_message, nullptr, cache).get();
+}
+
+std::string ClaudeChatbot::send_message(const std::string& conversation_id, const std::string& user_message,
+                                        CachePolicy cache) {
+    return enqueue_turn(conversation_id, user_message, nullptr, cache).get();
+}
+
+std::string ClaudeChatbot::send_message_stream(const std::string& user_message,
+                                               const std::function<void(const std::string&)>& on_text,
+                                               CachePolicy cache) {
+    std::function<void(const std::string&)> callback = on_text;
+    if (!callback) {
+        callback = [](const std::string&) {};
+    }
+    return enqueue_turn(current_conversation_for_send(), user_message, callback, cache).get();
+}
+
+std::future<std::string> ClaudeChatbot::send_message_async(const std::string& conversation_id,
+                                                           const std::string& user_message,
+                                                           CachePolicy cache) {
+    return enqueue_turn(conversation_id, user_message, nullptr, cache);
+}
+
+std::future<std::string> ClaudeChatbot::send_message_async(const std::string& conversation_id,
+                                                           const std::string& user_message,
+                                                           const std::function<void(const std::string&)>& on_text,
+                                                           CachePolicy cache) {
+    return enqueue_turn(conversation_id, user_message, on_text, cache);
+}
+
+void ClaudeChatbot::send_message_async(const std::string& conversation_id,
+                                       const std::string& user_message,
+                                       const std::function<void(const std::string&)>& on_text,
+                                       std::function<void(const std::string&)> on_reply,
+                                       CachePolicy cache) {
+    enqueue_turn(conversation_id, user_message, on_text, cache, std::move(on_reply));
+}
+
+void ClaudeChatbot::set_response_cache(bool enabled, uint64_t max_bytes) {
+    if (enabled) {
+        response_cache.open(data_dir + "/responses.cache", max_bytes);
+    } else {
+        response_cache.close();
+    }
+}
+
+bool ClaudeChatbot::response_cache_enabled() const {
+    return response_cache.is_open();
+}
+
+ResponseCacheStats ClaudeChatbot::get_response_cache_stats() const {
+    return response_cache.stats();
+}
+
+void ClaudeChatbot::clear_response_cache() {
+    response_cache.clear();
+}
+
+void ClaudeChatbot::complete_async(const std::string& prompt, std::function<void(ApiReply&&)> done,
+                                   CachePolicy cache) {
+    send_completion(prompt, true, std::move(done), cache);
+}
+
+// A single-message request outside any conversation
+void ClaudeChatbot::send_completion(const std::string& prompt, bool with_system_prompt,
+                                    std::function<void(ApiReply&&)> done, CachePolicy cache) {
+    Conversation scratch;
+    scratch.messages.push_back(MessageView(Role::User, prompt, 0));
+    
+    auto start = std::chrono::steady_clock::now();
+    std::string body = build_request_body(scratch, false, ContextPlan(), with_system_prompt);
+    send_request(body, micros_since(start), false, nullptr, cache,
+        [done](const ApiReply& reply) {
+            ApiReply copy = reply;
+            done(std::move(copy));
+        });
+}
+
+ApiReply ClaudeChatbot::get_last_reply() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return last_reply;
+}
+
+template <typename Lock, typename Key>
+ClaudeChatbot::Locked<Lock> ClaudeChatbot::lock_conversation(const Key& key) const {
+    Locked<Lock> locked;
+    {
+        std::shared_lock<std::shared_mutex> store(store_mutex);
+        locked.conv = conversations.share(key);
+    }
+    if (!locked.conv) return locked;
+    locked.lock = Lock(locked.conv->mutex);
+    // Deleted between the lookup and taking its lock
+    if (locked.conv->erased) {
+        locked.lock.unlock();
+        locked.conv.reset();
+    }
+    return locked;
+}
+
+std::vector<std::shared_ptr<Conversation>> ClaudeChatbot::share_conversations(size_t offset,
+                                                                              size_t limit) const {
+    std::shared_lock<std::shared_mutex> lock(store_mutex);
+    std::vector<std::shared_ptr<Conversation>> page;
+    if (offset >= conversations.size()) return page;
+    page.reserve(std::min(limit, conversations.size() - offset));
     
-    return assistant_response;
+    auto it = conversations.begin();
+    for (size_t i = 0; i < offset; i++) ++it;
+    for (; it != conversations.end() && page.size() < limit; ++it) {
+        page.push_back(conversations.share(it->id));
+    }
+    return page;
 }
 
 void ClaudeChatbot::start_new_conversation(const std::string& title) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::lock_guard<std::shared_mutex> lock(store_mutex);
+    current_conversation = conversations.handle(add_conversation(title));
+}
+
+std::string ClaudeChatbot::create_conversation(const std::string& title) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::lock_guard<std::shared_mutex> lock(store_mutex);
+    return add_conversation(title);
+}
+
+std::string ClaudeChatbot::add_conversation(const std::string& title) {
     Conversation new_conv;
     new_conv.id = generate_id();
     new_conv.title = title.empty() ? "New Chat" : title;
     new_conv.created_at = get_timestamp();
-    new_conv.last_modified = get_timestamp();
+    new_conv.last_modified = new_conv.created_at;
+    
+    JournalRecord record;
+    record.type = JournalRecordType::NewConversation;
+    record.conversation_id = new_conv.id;
+    record.title = new_conv.title;
+    record.created_at = new_conv.created_at;
+    record.last_modified = new_conv.last_modified;
     
-    conversations.insert(conversations.begin(), new_conv);
-    current_conversation_id = new_conv.id;
-    save_conversations();
+    conversations.push_front(std::move(new_conv));
+    commit(record);
+    return record.conversation_id;
 }
 
-void ClaudeChatbot::load_conversation(const std::string& conversation_id) {
-    for (const auto& conv : conversations) {
-        if (conv.id == conversation_id) {
-            current_conversation_id = conversation_id;
-            return;
-        }
+bool ClaudeChatbot::has_conversation(const std::string& conversation_id) const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::shared_lock<std::shared_mutex> lock(store_mutex);
+    return conversations.find(conversation_id) != nullptr;
+}
+
+bool ClaudeChatbot::is_idle() {
+    {
+        std::lock_guard<std::mutex> lock(turns_mutex);
+        if (!pending_turns.empty()) return false;
     }
+    std::lock_guard<std::mutex> lock(calls_mutex);
+    return outstanding_calls == 0;
+}
+
+bool ClaudeChatbot::load_conversation(const std::string& conversation_id) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(conversation_id);
+    if (!conv || !ensure_loaded(*conv)) return false;
+    std::lock_guard<std::shared_mutex> store(store_mutex);
+    current_conversation = conversations.handle(conversation_id);
+    return true;
 }
 
 Conversation* ClaudeChatbot::get_current_conversation() {
-    for (auto& conv : conversations) {
-        if (conv.id == current_conversation_id) {
-            return &conv;
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    ConversationHandle current;
+    {
+        std::shared_lock<std::shared_mutex> store(store_mutex);
+        current = current_conversation;
+    }
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(current);
+    if (conv && !ensure_loaded(*conv)) return nullptr;
+    return conv.conv.get();
+}
+
+std::string ClaudeChatbot::get_current_conversation_id() const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::shared_lock<std::shared_mutex> lock(store_mutex);
+    const Conversation* conv = conversations.get(current_conversation);
+    return conv ? conv->id : std::string();
+}
+
+size_t ClaudeChatbot::get_conversation_count() const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::shared_lock<std::shared_mutex> lock(store_mutex);
+    return conversations.size();
+}
+
+std::vector<ConversationSummary> ClaudeChatbot::list_conversations(size_t offset, size_t limit) const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::vector<ConversationSummary> page;
+    for (const auto& conv : share_conversations(offset, limit)) {
+        std::shared_lock<ConversationMutex> lock(conv->mutex);
+        if (conv->erased) continue;
+        ConversationSummary summary;
+        summary.id = conv->id;
+        summary.title = conv->title;
+        summary.created_at = conv->created_at;
+        summary.last_modified = conv->last_modified;
+        summary.message_count = conv->message_count;
+        page.push_back(std::move(summary));
+    }
+    return page;
+}
+
+bool ClaudeChatbot::for_each_message(const std::string& conversation_id, const MessageCallback& on_message,
+                                     size_t offset, size_t limit) const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<ReadLock> conv = lock_conversation<ReadLock>(conversation_id);
+    if (!conv) return false;
+    
+    size_t count = conv->message_count;
+    size_t end = offset < count ? offset + std::min(limit, count - offset) : offset;
+    if (conv->messages_loaded) {
+        for (size_t i = offset; i < end; i++) {
+            on_message(i, conv->messages[i]);
+        }
+    } else {
+        std::string block;
+        MessageBlockData data;
+        if (!files.read_block(conv->id, block) || !data.open(block.data(), block.size())) return true;
+        MessageBlockReader reader(data.data(), data.size());
+        MessageView view;
+        for (size_t i = 0; i < end && reader.next(view); i++) {
+            if (i >= offset) on_message(i, view);
         }
     }
-    return nullptr;
+    return true;
 }
 
 std::vector<Conversation> ClaudeChatbot::get_all_conversations() {
-    return conversations;
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::vector<Conversation> all;
+    std::vector<std::shared_ptr<Conversation>> shared = share_conversations();
+    all.reserve(shared.size());
+    for (const auto& conv : shared) {
+        std::shared_lock<ConversationMutex> lock(conv->mutex);
+        if (!conv->erased) all.push_back(*conv);
+    }
+    return all;
 }
 
 void ClaudeChatbot::delete_conversation(const std::string& conversation_id) {
-    conversations.erase(
-        std::remove_if(conversations.begin(), conversations.end(),
-            [&conversation_id](const Conversation& c) { return c.id == conversation_id; }),
-        conversations.end()
-    );
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(conversation_id);
+    if (!conv) return;
+    release_messages(*conv);
+    conv->erased = true;
+    {
+        std::lock_guard<std::shared_mutex> index(index_mutex);
+        search_index.remove_conversation(conversation_id);
+    }
     
-    if (current_conversation_id == conversation_id && !conversations.empty()) {
-        current_conversation_id = conversations[0].id;
+    JournalRecord record;
+    record.type = JournalRecordType::DeleteConversation;
+    record.conversation_id = conversation_id;
+    {
+        std::lock_guard<std::shared_mutex> store(store_mutex);
+        conversations.erase(conversation_id);
+        if (!conversations.get(current_conversation) && !conversations.empty()) {
+            current_conversation = conversations.handle(conversations.front()->id);
+        }
+        commit(record);
     }
+    // The catalog may still list it until the next compaction; loading
+    // drops entries whose block file is gone.
+    writer.unlink_after_commit(files.block_path(conversation_id));
+}
+
+void ClaudeChatbot::clear_conversation(const std::string& conversation_id) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(conversation_id);
+    if (!conv) return;
+    clear_messages(*conv);
+    conv->last_modified = get_timestamp();
     
-    save_conversations();
+    JournalRecord record;
+    record.type = JournalRecordType::ClearConversation;
+    record.conversation_id = conv->id;
+    record.last_modified = conv->last_modified;
+    
+    std::lock_guard<std::shared_mutex> store(store_mutex);
+    conversations.move_to_front(conv->id);
+    commit(record);
 }
 
 void ClaudeChatbot::clear_current_conversation() {
-    Conversation* conv = get_current_conversation();
-    if (conv) {
-        conv->messages.clear();
-        conv->last_modified = get_timestamp();
-        save_conversations();
+    std::string id = get_current_conversation_id();
+    if (!id.empty()) {
+        clear_conversation(id);
     }
 }
 
 std::vector<Message> ClaudeChatbot::search_messages(const std::string& query) {
-    std::vector<Message> results;
-    std::string lower_query = query;
-    std::transform(lower_query.begin(), lower_query.end(), lower_query.begin(), ::tolower);
-    
-    for (const auto& conv : conversations) {
-        for (const auto& msg : conv.messages) {
-            std::string lower_content = msg.content;
-            std::transform(lower_content.begin(), lower_content.end(), lower_content.begin(), ::tolower);
-            
-            if (lower_content.find(lower_query) != std::string::npos) {
-                results.push_back(msg);
-            }
+    std::vector<std::pair<std::pair<size_t, size_t>, Message>> found;
+    std::unordered_map<std::string, size_t> position;
+    {
+        std::shared_lock<std::shared_mutex> state(state_mutex);
+        std::shared_lock<std::shared_mutex> lock(store_mutex);
+        for (const auto& conv : conversations) {
+            position.emplace(conv.id, position.size());
         }
     }
     
+    scan_messages(query, ScanMode::Substring,
+        [&](const std::string& conversation_id, size_t message_index, const MessageView& view) {
+            // Created since the positions were taken: newest of all
+            auto it = position.find(conversation_id);
+            size_t order = it == position.end() ? 0 : it->second + 1;
+            found.push_back({{order, message_index}, Message(view)});
+        });
+    
+    // Hits stream in from several threads; report them in conversation order
+    std::sort(found.begin(), found.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    std::vector<Message> results;
+    results.reserve(found.size());
+    for (auto& hit : found) {
+        results.push_back(std::move(hit.second));
+    }
     return results;
 }
 
+bool ClaudeChatbot::scan_messages(const std::string& pattern, ScanMode mode, const ScanCallback& on_hit) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    std::vector<std::shared_ptr<Conversation>> shared = share_conversations();
+    
+    // Every conversation stays locked for reading while the scan runs.
+    // Taking the locks in address order keeps concurrent scans from
+    // deadlocking on each other.
+    std::vector<Conversation*> by_address;
+    by_address.reserve(shared.size());
+    for (const auto& conv : shared) {
+        by_address.push_back(conv.get());
+    }
+    std::sort(by_address.begin(), by_address.end());
+    std::vector<std::shared_lock<ConversationMutex>> locks;
+    locks.reserve(by_address.size());
+    for (Conversation* conv : by_address) {
+        locks.emplace_back(conv->mutex);
+    }
+    
+    // Resident conversations are scanned in memory, the rest straight out of
+    // their block files without paging them in.
+    std::vector<ScanSource> sources;
+    std::vector<std::string> block_paths;
+    sources.reserve(shared.size());
+    block_paths.reserve(shared.size());
+    for (const auto& conv : shared) {
+        if (conv->erased) continue;
+        ScanSource source = {&conv->id, nullptr, nullptr, 0, SNAPSHOT_VERSION, nullptr};
+        if (conv->messages_loaded) {
+            source.messages = &conv->messages;
+        } else {
+            block_paths.push_back(files.block_path(conv->id));
+            source.block_path = &block_paths.back();
+        }
+        sources.push_back(source);
+    }
+    return scan_engine.scan(sources, pattern, mode, on_hit);
+}
+
+std::vector<SearchHit> ClaudeChatbot::search_ranked(const std::string& query, size_t top_k) {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    return search_index.search(query, top_k);
+}
+
+bool ClaudeChatbot::get_message(const std::string& conversation_id, size_t index, Message& out) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(conversation_id);
+    if (!conv || !ensure_loaded(*conv)) return false;
+    if (index >= conv->messages.size()) return false;
+    out = Message(conv->messages[index]);
+    return true;
+}
+
 bool ClaudeChatbot::export_conversation(const std::string& conversation_id, const std::string& filepath) {
-    for (const auto& conv : conversations) {
-        if (conv.id == conversation_id) {
-            std::ofstream file(filepath);
-            if (!file.is_open()) return false;
-            
-            file << "Conversation: " << conv.title << "\n";
-            file << "Created: " << conv.created_at << "\n";
-            file << "Last Modified: " << conv.last_modified << "\n";
-            file << "=" << std::string(60, '=') << "\n\n";
-            
-            for (const auto& msg : conv.messages) {
-                file << "[" << msg.timestamp << "] " << msg.role << ":\n";
-                file << msg.content << "\n\n";
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    Locked<WriteLock> conv = lock_conversation<WriteLock>(conversation_id);
+    if (!conv || !ensure_loaded(*conv)) return false;
+    std::ofstream file(filepath);
+    if (!file.is_open()) return false;
+    
+    file << "Conversation: " << conv->title << "\n";
+    file << "Created: " << format_timestamp(conv->created_at) << "\n";
+    file << "Last Modified: " << format_timestamp(conv->last_modified) << "\n";
+    file << "=" << std::string(60, '=') << "\n\n";
+    
+    for (const MessageView& msg : conv->messages) {
+        file << "[" << format_timestamp(msg.timestamp) << "] " << role_name(msg.role) << ":\n";
+        file << msg.content << "\n\n";
+    }
+    
+    file.close();
+    return true;
+}
+
+// Called with the conversation the record is about locked, which keeps
+// sequence numbers in step with the changes they record; records that move
+// a conversation to the front are committed under store_mutex as well, so
+// replay restores the same order. The writer thread compacts once the
+// journal reaches COMPACTION_BYTES.
+void ClaudeChatbot::commit(const JournalRecord& record) {
+    writer.append(record);
+}
+
+void ClaudeChatbot::apply_journal_record(const JournalRecord& record) {
+    // Replay must be idempotent: a crash between writing the conversation
+    // files and resetting the journal leaves records whose effects are
+    // already applied, possibly to a block file the catalog does not yet
+    // account for, so message counts are checked against the loaded block.
+    // Recency moves mirror the live operations so replay restores the order.
+    // Called with state_mutex held exclusively.
+    Conversation* it = conversations.find(record.conversation_id);
+    
+    switch (record.type) {
+        case JournalRecordType::NewConversation:
+            if (!it) {
+                Conversation conv;
+                conv.id = record.conversation_id;
+                conv.title = record.title;
+                conv.created_at = record.created_at;
+                conv.last_modified = record.last_modified;
+                conversations.push_front(std::move(conv));
             }
-            
-            file.close();
-            return true;
-        }
+            break;
+        case JournalRecordType::AddMessage:
+            if (it && ensure_loaded(*it) && it->message_count == record.message_index) {
+                append_message(*it, record.message);
+                it->last_modified = record.last_modified;
+                conversations.move_to_front(it->id);
+            }
+            break;
+        case JournalRecordType::DeleteConversation:
+            if (it) {
+                release_messages(*it);
+                {
+                    std::lock_guard<std::shared_mutex> lock(index_mutex);
+                    search_index.remove_conversation(it->id);
+                }
+                conversations.erase(record.conversation_id);
+            }
+            break;
+        case JournalRecordType::ClearConversation:
+            if (it) {
+                clear_messages(*it);
+                it->last_modified = record.last_modified;
+                conversations.move_to_front(it->id);
+            }
+            break;
+        case JournalRecordType::TruncateConversation:
+            if (it && ensure_loaded(*it) && it->message_count > record.message_index) {
+                truncate_messages(*it, static_cast<size_t>(record.message_index));
+            }
+            break;
+        case JournalRecordType::SetSummary:
+            if (it && record.message_index <= it->message_count) {
+                it->summary = record.message.content;
+                it->summary_covers = static_cast<size_t>(record.message_index);
+            }
+            break;
     }
-    return false;
 }
 
 void ClaudeChatbot::save_conversations() {
-    std::string filepath = data_dir + "/conversations.dat";
-    std::ofstream file(filepath, std::ios::binary);
-    if (!file.is_open()) return;
+    writer.compact();
+}
+
+// Runs on the writer thread. The conversations are captured with
+// state_mutex held exclusively, which gives a consistent cut of every
+// conversation, the search index and the journal position; they are
+// written out without it, and the results swapped in under it again, so
+// turns never wait on the disk. Only conversations whose block
+// file is out of date are rewritten, in parallel; ones that change while
+// that happens stay dirty until the next compaction.
+bool ClaudeChatbot::write_conversation_files(uint64_t& covered) {
+    struct Captured {
+        ConversationHandle handle;
+        uint64_t revision = 0;
+        Conversation metadata;          // messages left empty
+        MessageLog messages;            // when the block file is out of date
+        bool written = false;
+    };
+    std::vector<Captured> captured;
+    std::vector<size_t> dirty;
+    std::string index_data;
+    uint64_t generation;
+    {
+        std::lock_guard<std::shared_mutex> lock(state_mutex);
+        covered = writer.last_sequence();
+        generation = catalog_generation + 1;
+        captured.resize(conversations.size());
+        size_t i = 0;
+        for (const auto& conv : conversations) {
+            Captured& item = captured[i];
+            item.handle = conversations.handle(conv.id);
+            item.revision = conv.revision;
+            item.metadata.id = conv.id;
+            item.metadata.title = conv.title;
+            item.metadata.created_at = conv.created_at;
+            item.metadata.last_modified = conv.last_modified;
+            item.metadata.message_count = conv.message_count;
+            item.metadata.block_size = conv.block_size;
+            item.metadata.block_raw_size = conv.block_raw_size;
+            item.metadata.summary = conv.summary;
+            item.metadata.summary_covers = conv.summary_covers;
+            if (!conv.in_snapshot) {
+                item.messages = conv.messages;
+                dirty.push_back(i);
+            }
+            i++;
+        }
+        std::shared_lock<std::shared_mutex> index(index_mutex);
+        search_index.serialize(index_data, generation);
+    }
     
-    size_t conv_count = conversations.size();
-    file.write(reinterpret_cast<const char*>(&conv_count), sizeof(conv_count));
+    bool durable = writer.get_fsync_policy() != FsyncPolicy::Never;
+    files.parallel_for(dirty.size(), [&](size_t n) {
+        Captured& item = captured[dirty[n]];
+        std::string block;
+        serialize_message_block(item.messages, block);
+        item.messages.clear();
+        item.metadata.block_size = block.size();
+        item.metadata.block_raw_size = message_block_raw_size(block.data(), block.size());
+        item.written = files.write_block(item.metadata.id, block, durable);
+    });
+    for (size_t i : dirty) {
+        if (!captured[i].written) return false;
+    }
     
-    for (const auto& conv : conversations) {
-        size_t id_len = conv.id.length();
-        file.write(reinterpret_cast<const char*>(&id_len), sizeof(id_len));
-        file.write(conv.id.c_str(), id_len);
-        
-        size_t title_len = conv.title.length();
-        file.write(reinterpret_cast<const char*>(&title_len), sizeof(title_len));
-        file.write(conv.title.c_str(), title_len);
-        
-        size_t created_len = conv.created_at.length();
-        file.write(reinterpret_cast<const char*>(&created_len), sizeof(created_len));
-        file.write(conv.created_at.c_str(), created_len);
-        
-        size_t modified_len = conv.last_modified.length();
-        file.write(reinterpret_cast<const char*>(&modified_len), sizeof(modified_len));
-        file.write(conv.last_modified.c_str(), modified_len);
-        
-        size_t msg_count = conv.messages.size();
-        file.write(reinterpret_cast<const char*>(&msg_count), sizeof(msg_count));
-        
-        for (const auto& msg : conv.messages) {
-            size_t role_len = msg.role.length();
-            file.write(reinterpret_cast<const char*>(&role_len), sizeof(role_len));
-            file.write(msg.role.c_str(), role_len);
-            
-            size_t content_len = msg.content.length();
-            file.write(reinterpret_cast<const char*>(&content_len), sizeof(content_len));
-            file.write(msg.content.c_str(), content_len);
-            
-            size_t timestamp_len = msg.timestamp.length();
-            file.write(reinterpret_cast<const char*>(&timestamp_len), sizeof(timestamp_len));
-            file.write(msg.timestamp.c_str(), timestamp_len);
+    // The catalog goes last: until it is replaced, the old one still
+    // describes blocks that the journal brings up to date.
+    std::vector<const Conversation*> order;
+    order.reserve(captured.size());
+    for (const auto& item : captured) {
+        order.push_back(&item.metadata);
+    }
+    if (!files.write_catalog(order, generation, durable)) return false;
+    // The renames must be durable before the writer empties the journal
+    if (durable) {
+        sync_directory(files.block_directory());
+        sync_directory(data_dir);
+    }
+    std::string index_path = data_dir + "/search.idx";
+    bool index_written = write_index_file(index_path + ".tmp", index_data);
+    
+    {
+        std::lock_guard<std::shared_mutex> lock(state_mutex);
+        catalog_generation = generation;
+        for (const auto& item : captured) {
+            Conversation* conv = conversations.get(item.handle);
+            if (!conv) continue;
+            conv->block_size = item.metadata.block_size;
+            conv->block_raw_size = item.metadata.block_raw_size;
+            conv->in_snapshot = conv->revision == item.revision;
         }
+        evict_cold_messages(nullptr);
     }
     
-    file.close();
+    if (index_written) {
+        replace_file(index_path + ".tmp", index_path);
+    }
+    return true;
 }
 
 void ClaudeChatbot::load_conversations() {
-    std::string filepath = data_dir + "/conversations.dat";
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) return;
-    
+    // Compactions on the writer thread take state_mutex; stop it first
+    writer.stop();
+    bool compact = load_from_disk();
+    writer.start();
+    if (compact) {
+        save_conversations();
+    }
+}
+
+// Called with the writer stopped. True if the result should be compacted.
+// Holds state_mutex exclusively throughout, so the store is used without
+// store_mutex; the search index is still locked, for search_ranked.
+bool ClaudeChatbot::load_from_disk() {
+    std::lock_guard<std::shared_mutex> lock(state_mutex);
     conversations.clear();
+    resident_bytes = 0;
+    catalog_generation = 0;
+    {
+        std::lock_guard<std::shared_mutex> index(index_mutex);
+        search_index.clear();
+    }
+    
+    // Messages read or replayed below go into the search index as they are
+    // appended, so it only needs a full rebuild if its saved copy is stale.
+    std::string legacy_path = data_dir + "/conversations.dat";
+    bool compact = false;
+    bool index_current = true;
+    std::vector<Conversation> stored;
+    bool cataloged = files.read_catalog(stored, catalog_generation);
+    if (cataloged) {
+        // Deleting a conversation unlinks its block before the catalog is
+        // rewritten, so an entry without one was deleted.
+        std::unordered_set<std::string> blocks = files.stored_ids();
+        for (auto& conv : stored) {
+            if (blocks.count(conv.id)) {
+                conversations.push_back(std::move(conv));
+            }
+        }
+        {
+            std::lock_guard<std::shared_mutex> index(index_mutex);
+            index_current = search_index.load(data_dir + "/search.idx", catalog_generation);
+        }
+        // Left behind if migrating was interrupted after the catalog was written
+        std::remove(legacy_path.c_str());
+    } else {
+        compact = migrate_snapshot(legacy_path, index_current);
+    }
     
+    writer.replay([this](const JournalRecord& record) { apply_journal_record(record); });
+    if (cataloged) {
+        std::unordered_set<std::string> live;
+        for (const auto& conv : conversations) {
+            live.insert(conv.id);
+        }
+        files.remove_orphans(live);
+    }
+    if (!index_current) {
+        rebuild_search_index();
+    }
+    writer.set_compaction_threshold(COMPACTION_BYTES);
+    return compact || writer.journal_size() > COMPACTION_BYTES;
+}
+
+// Moves a conversations.dat from before per-conversation files into them.
+// Indexed snapshots have their blocks copied (or, in older layouts,
+// re-encoded) into block files in parallel, and the catalog keeps the
+// snapshot's generation so the saved search index stays valid. Anything
+// else is read fully and left for a compaction to write out. True if the
+// result should be compacted.
+bool ClaudeChatbot::migrate_snapshot(const std::string& path, bool& index_current) {
+    MappedFile snapshot;
+    if (!snapshot.open(path)) return false;
+    if (!snapshot_is_indexed(snapshot)) {
+        // Pre-index format
+        snapshot.close();
+        std::ifstream file(path, std::ios::binary);
+        read_snapshot(file);
+        return true;
+    }
+    
+    std::vector<Conversation> indexed;
+    uint64_t generation;
+    uint32_t version;
+    if (!read_snapshot_index(snapshot, indexed, generation, version)) return false;
+    catalog_generation = generation;
+    
+    std::vector<SnapshotBlock> sources(indexed.size());
+    std::vector<char> written(indexed.size(), 0);
+    files.parallel_for(indexed.size(), [&](size_t i) {
+        Conversation& conv = indexed[i];
+        sources[i] = {conv.block_offset, conv.block_size};
+        const char* data = snapshot.data() + conv.block_offset;
+        std::string block;
+        if (version == SNAPSHOT_VERSION) {
+            block.assign(data, conv.block_size);
+        } else {
+            MessageLog messages;
+            parse_message_block(data, conv.block_size, version, messages);
+            serialize_message_block(messages, block);
+        }
+        snapshot.release(conv.block_offset, conv.block_size);
+        conv.block_offset = 0;
+        conv.block_size = block.size();
+        conv.block_raw_size = message_block_raw_size(block.data(), block.size());
+        written[i] = files.write_block(conv.id, block, true);
+    });
+    
+    std::vector<const Conversation*> order;
+    order.reserve(indexed.size());
+    for (const auto& conv : indexed) {
+        order.push_back(&conv);
+    }
+    if (std::find(written.begin(), written.end(), 0) == written.end() &&
+        files.write_catalog(order, generation, true)) {
+        sync_directory(files.block_directory());
+        sync_directory(data_dir);
+        for (auto& conv : indexed) {
+            conversations.push_back(std::move(conv));
+        }
+        {
+            std::lock_guard<std::shared_mutex> index(index_mutex);
+            index_current = search_index.load(data_dir + "/search.idx", generation);
+        }
+        snapshot.close();
+        std::remove(path.c_str());
+        return false;
+    }
+    
+    // Could not write the new files: keep everything in memory for now and
+    // let the compaction try again
+    for (size_t i = 0; i < indexed.size(); i++) {
+        Conversation& conv = indexed[i];
+        parse_message_block(snapshot.data() + sources[i].offset, sources[i].size, version, conv.messages);
+        conv.messages_loaded = true;
+        conv.message_count = conv.messages.size();
+        conv.in_snapshot = false;
+        conv.resident_bytes = conv.messages.memory_bytes();
+        resident_bytes += conv.resident_bytes;
+        conversations.push_back(std::move(conv));
+    }
+    index_current = false;
+    return true;
+}
+
+void ClaudeChatbot::read_snapshot(std::ifstream& file) {
     size_t conv_count;
-    file.read(reinterpret_cast<char*>(&conv_count), sizeof(conv_count));
+    if (!file.read(reinterpret_cast<char*>(&conv_count), sizeof(conv_count))) return;
     
     for (size_t i = 0; i < conv_count; i++) {
         Conversation conv;
@@ -382,15 +1387,19 @@ void ClaudeChatbot::load_conversations() {
         conv.title.resize(title_len);
         file.read(&conv.title[0], title_len);
         
+        std::string created_at;
         size_t created_len;
         file.read(reinterpret_cast<char*>(&created_len), sizeof(created_len));
-        conv.created_at.resize(created_len);
-        file.read(&conv.created_at[0], created_len);
+        created_at.resize(created_len);
+        file.read(&created_at[0], created_len);
+        conv.created_at = parse_timestamp(created_at);
         
+        std::string last_modified;
         size_t modified_len;
         file.read(reinterpret_cast<char*>(&modified_len), sizeof(modified_len));
-        conv.last_modified.resize(modified_len);
-        file.read(&conv.last_modified[0], modified_len);
+        last_modified.resize(modified_len);
+        file.read(&last_modified[0], modified_len);
+        conv.last_modified = parse_timestamp(last_modified);
         
         size_t msg_count;
         file.read(reinterpret_cast<char*>(&msg_count), sizeof(msg_count));
@@ -398,38 +1407,297 @@ void ClaudeChatbot::load_conversations() {
         for (size_t j = 0; j < msg_count; j++) {
             Message msg;
             
+            std::string role;
             size_t role_len;
             file.read(reinterpret_cast<char*>(&role_len), sizeof(role_len));
-            msg.role.resize(role_len);
-            file.read(&msg.role[0], role_len);
+            role.resize(role_len);
+            file.read(&role[0], role_len);
+            parse_role(role, msg.role);
             
             size_t content_len;
             file.read(reinterpret_cast<char*>(&content_len), sizeof(content_len));
             msg.content.resize(content_len);
             file.read(&msg.content[0], content_len);
             
+            std::string timestamp;
             size_t timestamp_len;
             file.read(reinterpret_cast<char*>(&timestamp_len), sizeof(timestamp_len));
-            msg.timestamp.resize(timestamp_len);
-            file.read(&msg.timestamp[0], timestamp_len);
+            timestamp.resize(timestamp_len);
+            file.read(&timestamp[0], timestamp_len);
+            msg.timestamp = parse_timestamp(timestamp);
             
-            conv.messages.push_back(msg);
+            append_message(conv, msg);
         }
         
-        conversations.push_back(conv);
+        conv.in_snapshot = false;
+        conversations.push_back(std::move(conv));
+    }
+}
+
+void ClaudeChatbot::rebuild_search_index() {
+    {
+        std::lock_guard<std::shared_mutex> index(index_mutex);
+        search_index.clear();
+    }
+    for (auto& conv : conversations) {
+        if (!ensure_loaded(conv)) continue;
+        std::lock_guard<std::shared_mutex> index(index_mutex);
+        for (size_t i = 0; i < conv.messages.size(); i++) {
+            search_index.add_message(conv.id, i, conv.messages[i].content);
+        }
     }
+}
+
+// The paging functions are called with the conversation locked, or with
+// state_mutex held exclusively.
+//
+// Pages the messages in from the block file. A block that cannot be read,
+// or holds fewer messages than the catalog says, leaves the conversation
+// unloaded: carrying on from what was read would have the next compaction
+// overwrite the stored history with it. A longer block is fine; a crash
+// between writing the blocks and the catalog leaves one behind.
+bool ClaudeChatbot::ensure_loaded(Conversation& conv) {
+    conv.last_used = ++use_clock;
+    if (conv.messages_loaded) return true;
     
-    file.close();
+    conv.messages.clear();
+    conv.messages.reserve(conv.message_count);
+    std::string block;
+    bool read = files.read_block(conv.id, block);
+    if (read) {
+        read = parse_message_block(block.data(), block.size(), SNAPSHOT_VERSION, conv.messages);
+    } else {
+        read = conv.message_count == 0;     // never written out yet
+    }
+    if (!read || conv.messages.size() < conv.message_count) {
+        conv.messages.clear();
+        metrics.add("chatbot_block_load_failures_total");
+        return false;
+    }
+    conv.messages_loaded = true;
+    conv.message_count = conv.messages.size();
+    
+    conv.resident_bytes = conv.messages.memory_bytes();
+    resident_bytes += conv.resident_bytes;
+    
+    evict_cold_messages(&conv);
+    return true;
+}
+
+void ClaudeChatbot::release_messages(Conversation& conv) {
+    conv.messages.clear();
+    conv.reset_request_json();
+    conv.messages_loaded = false;
+    resident_bytes -= conv.resident_bytes;
+    conv.resident_bytes = 0;
+}
+
+// keep is the conversation the caller has locked, if any. Others are only
+// tried: one that is busy is in use and a poor candidate anyway.
+void ClaudeChatbot::evict_cold_messages(const Conversation* keep) {
+    if (resident_bytes <= memory_budget) return;
+    
+    std::shared_lock<std::shared_mutex> store(store_mutex);
+    const Conversation* current = conversations.get(current_conversation);
+    std::vector<std::pair<uint64_t, Conversation*>> candidates;
+    for (auto& conv : conversations) {
+        if (&conv == keep || &conv == current) continue;
+        std::unique_lock<ConversationMutex> lock(conv.mutex, std::try_to_lock);
+        if (lock && conv.messages_loaded && conv.in_snapshot) {
+            candidates.push_back({conv.last_used, &conv});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    
+    for (const auto& candidate : candidates) {
+        if (resident_bytes <= memory_budget) break;
+        Conversation& conv = *candidate.second;
+        std::unique_lock<ConversationMutex> lock(conv.mutex, std::try_to_lock);
+        // Checked again: it may have been used in the meantime
+        if (lock && conv.messages_loaded && conv.in_snapshot && conv.last_used == candidate.first) {
+            release_messages(conv);
+        }
+    }
+}
+
+void ClaudeChatbot::append_message(Conversation& conv, const MessageView& msg) {
+    conv.messages.push_back(msg);
+    conv.message_count = conv.messages.size();
+    conv.in_snapshot = false;
+    conv.revision++;
+    uint64_t bytes = conv.messages.memory_bytes();
+    resident_bytes += bytes - conv.resident_bytes;
+    conv.resident_bytes = bytes;
+    std::lock_guard<std::shared_mutex> index(index_mutex);
+    search_index.add_message(conv.id, conv.messages.size() - 1, msg.content);
+}
+
+// Drops the messages from count on; the conversation must be loaded
+void ClaudeChatbot::truncate_messages(Conversation& conv, size_t count) {
+    while (conv.messages.size() > count) {
+        size_t index = conv.messages.size() - 1;
+        {
+            std::lock_guard<std::shared_mutex> lock(index_mutex);
+            search_index.remove_message(conv.id, index);
+        }
+        conv.messages.pop_back();
+    }
+    conv.truncate_request_json(count);
+    conv.message_count = conv.messages.size();
+    conv.in_snapshot = false;
+    conv.revision++;
+    uint64_t bytes = conv.messages.memory_bytes();
+    resident_bytes += bytes - conv.resident_bytes;
+    conv.resident_bytes = bytes;
+}
+
+void ClaudeChatbot::clear_messages(Conversation& conv) {
+    {
+        std::lock_guard<std::shared_mutex> index(index_mutex);
+        search_index.remove_conversation(conv.id);
+    }
+    conv.messages.clear();
+    conv.reset_request_json();
+    conv.summary.clear();
+    conv.summary_covers = 0;
+    conv.summary_job = 0;
+    conv.messages_loaded = true;
+    conv.message_count = 0;
+    conv.in_snapshot = false;
+    conv.revision++;
+    resident_bytes -= conv.resident_bytes;
+    conv.resident_bytes = 0;
 }
 
 void ClaudeChatbot::set_model(const std::string& new_model) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
     model = new_model;
 }
 
 void ClaudeChatbot::set_max_tokens(int tokens) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
     max_tokens = tokens;
 }
 
 std::string ClaudeChatbot::get_model() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
     return model;
 }
+
+void ClaudeChatbot::set_api_url(const std::string& url) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    api_url = url.empty() ? DEFAULT_API_URL : url;
+}
+
+std::string ClaudeChatbot::get_api_url() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return api_url;
+}
+
+void ClaudeChatbot::set_system_prompt(const std::string& prompt) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    system_prompt = prompt;
+}
+
+std::string ClaudeChatbot::get_system_prompt() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return system_prompt;
+}
+
+void ClaudeChatbot::set_prompt_caching(bool enabled) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    prompt_caching = enabled;
+}
+
+bool ClaudeChatbot::prompt_caching_enabled() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return prompt_caching;
+}
+
+void ClaudeChatbot::set_fsync_policy(FsyncPolicy policy, uint64_t interval_ms) {
+    writer.set_fsync_policy(policy, interval_ms);
+}
+
+FsyncPolicy ClaudeChatbot::get_fsync_policy() const {
+    return writer.get_fsync_policy();
+}
+
+uint64_t ClaudeChatbot::get_fsync_interval_ms() const {
+    return writer.get_fsync_interval_ms();
+}
+
+WriterStats ClaudeChatbot::get_writer_stats() const {
+    return writer.stats();
+}
+
+void ClaudeChatbot::flush() {
+    writer.flush();
+}
+
+void ClaudeChatbot::set_scheduler_options(const SchedulerOptions& options) {
+    scheduler->set_options(options);
+}
+
+SchedulerOptions ClaudeChatbot::get_scheduler_options() const {
+    return scheduler->get_options();
+}
+
+SchedulerStats ClaudeChatbot::get_scheduler_stats() const {
+    return scheduler->stats();
+}
+
+void ClaudeChatbot::prewarm_connection() {
+    scheduler->prewarm(get_api_url());
+}
+
+TransportStats ClaudeChatbot::get_transport_stats() const {
+    return scheduler->transport_stats();
+}
+
+MetricsSnapshot ClaudeChatbot::get_metrics() const {
+    return metrics.snapshot();
+}
+
+std::string ClaudeChatbot::export_metrics(MetricsFormat format) const {
+    return metrics.snapshot().render(format);
+}
+
+bool ClaudeChatbot::dump_metrics(const std::string& path, MetricsFormat format) const {
+    return metrics.write_file(path, format);
+}
+
+void ClaudeChatbot::reset_metrics() {
+    metrics.reset();
+}
+
+void ClaudeChatbot::set_context_budget(uint64_t tokens) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    context.set_budget(tokens);
+}
+
+uint64_t ClaudeChatbot::get_context_budget() const {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    return context.get_budget();
+}
+
+void ClaudeChatbot::set_memory_budget(uint64_t bytes) {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    memory_budget = bytes;
+    evict_cold_messages(nullptr);
+}
+
+uint64_t ClaudeChatbot::get_resident_bytes() const {
+    return resident_bytes;
+}
+
+StorageStats ClaudeChatbot::get_storage_stats() const {
+    std::shared_lock<std::shared_mutex> state(state_mutex);
+    StorageStats stats;
+    for (const auto& conv : share_conversations()) {
+        std::shared_lock<ConversationMutex> lock(conv->mutex);
+        if (conv->erased || !conv->in_snapshot) continue;
+        stats.stored_message_bytes += conv->block_size;
+        stats.message_bytes += conv->block_raw_size;
+    }
+    return stats;
+}
@@ -6,81 +6,410 @@
 #include <map>
 #include <fstream>
 #include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 
-// Platform detection
-#if defined(_WIN32) || defined(_WIN64)
-    #define PLATFORM_WINDOWS
-#elif defined(__ANDROID__)
-    #define PLATFORM_ANDROID
-#elif defined(__APPLE__)
-    #include <TargetConditionals.h>
-    #if TARGET_OS_IPHONE
-        #define PLATFORM_IOS
-    #else
-        #define PLATFORM_MACOS
-    #endif
-#elif defined(__linux__)
-    #define PLATFORM_LINUX
-#endif
+#include "platform.h"
+#include "conversation.h"
+#include "conversation_store.h"
+#include "journal.h"
+#include "background_writer.h"
+#include "conversation_files.h"
+#include "search_index.h"
+#include "scan_engine.h"
+#include "request_scheduler.h"
+#include "api_reply.h"
+#include "context_manager.h"
+#include "response_cache.h"
+#include "metrics.h"
 
-struct Message {
-    std::string role;
-    std::string content;
-    std::string timestamp;
+// The Messages API endpoint used unless set_api_url says otherwise.
+extern const char* const DEFAULT_API_URL;
+
+// Whether a call may be answered from the response cache. Bypass still
+// stores the fresh reply.
+enum class CachePolicy {
+    Use,
+    Bypass
 };
 
-struct Conversation {
-    std::string id;
-    std::string title;
-    std::vector<Message> messages;
-    std::string created_at;
-    std::string last_modified;
+// Receives messages in order; the view is only valid during the call.
+using MessageCallback = std::function<void(size_t index, const MessageView& message)>;
+
+// Size of the stored message blocks, before and after compression.
+struct StorageStats {
+    uint64_t message_bytes = 0;
+    uint64_t stored_message_bytes = 0;
 };
 
+// Safe for concurrent use. Locks, outermost first; a thread only ever
+// takes them in this order and holds none of them across network I/O:
+//
+//   state_mutex          shared by every operation on conversations;
+//                        exclusive only while loading and while a
+//                        compaction captures its cut and swaps in its
+//                        results.
+//   Conversation::mutex  one conversation's messages and paging state;
+//                        shared to read. Several are only ever taken
+//                        together shared, in address order; evicting
+//                        other conversations just tries theirs.
+//   store_mutex          which conversations exist, their recency order
+//                        and the current conversation; shared to list.
+//   index_mutex          the search index; shared to search.
+//   settings_mutex, turns_mutex
+//
+// So turns on different conversations only meet briefly in store_mutex
+// and index_mutex, and listing and searching run alongside them.
 class ClaudeChatbot {
 private:
-    std::string api_key;
+    const std::string api_key;
+    std::string data_dir;
+    
+    // Guarded by settings_mutex, along with last_reply
+    std::string api_url;
     std::string model;
     int max_tokens;
-    std::string data_dir;
-    std::vector<Conversation> conversations;
-    std::string current_conversation_id;
+    std::string system_prompt;
+    bool prompt_caching;
+    ContextManager context;
+    
+    // Guarded by store_mutex
+    ConversationStore conversations;
+    ConversationHandle current_conversation;
+    
+    ConversationFiles files;
+    uint64_t catalog_generation;    // state_mutex exclusive
+    SearchIndex search_index;       // index_mutex
+    ScanEngine scan_engine;
+    std::atomic<uint64_t> memory_budget;
+    std::atomic<uint64_t> resident_bytes;
+    std::atomic<uint64_t> use_clock;
+    std::atomic<uint64_t> summary_jobs;
+    ResponseCache response_cache;
+    
+    // Turns waiting for (or awaiting the reply to) their API request, queued
+    // per conversation so each conversation has at most one in flight.
+    struct PendingTurn {
+        std::string conversation_id;
+        ConversationHandle conversation;
+        std::string user_message;
+        std::function<void(const std::string&)> on_text;   // set when streaming
+        std::function<void(const std::string&)> on_reply;  // set instead of waiting on the future
+        size_t user_index = 0;
+        bool started = false;
+        CachePolicy cache = CachePolicy::Use;
+        std::promise<std::string> promise;
+    };
+    std::map<std::string, std::deque<std::shared_ptr<PendingTurn>>> pending_turns;   // turns_mutex
+    ApiReply last_reply;
+    
+    // A background summary claimed by plan_summary, sent once the
+    // conversation is unlocked.
+    struct SummaryJob {
+        std::string conversation_id;
+        uint64_t job = 0;
+        size_t end = 0;
+        std::string prompt;
+    };
+    
+    // Internally locked; outlives the writer, which records into it.
+    Metrics metrics;
+    
+    mutable std::shared_mutex state_mutex;
+    mutable std::shared_mutex store_mutex;
+    mutable std::shared_mutex index_mutex;
+    mutable std::mutex settings_mutex;
+    std::mutex turns_mutex;
+    
+    // Requests handed to the scheduler whose completion has not run yet
+    std::mutex calls_mutex;
+    std::condition_variable calls_finished;
+    size_t outstanding_calls;       // calls_mutex
+    bool owns_scheduler;
+    
+    // Appends to the journal and compacts it into the conversation files off the
+    // calling thread. Its compactions take state_mutex, so it is stopped
+    // before anything above is torn down.
+    BackgroundWriter writer;
+    
+    // Declared last so it is released first. Its threads run turn
+    // completions that touch the members above, so the destructor waits
+    // for those first, failing them if the scheduler is our own.
+    std::shared_ptr<RequestScheduler> scheduler;
     
     // Helper methods
     std::string generate_id();
-    std::string get_timestamp();
-    std::string get_data_directory();
+    int64_t get_timestamp();
     bool create_directory(const std::string& path);
-    std::string http_post(const std::string& url, const std::string& json_data);
-    std::string escape_json(const std::string& str);
-    std::string build_messages_json(const std::vector<Message>& messages);
+    HttpRequest build_api_request(const std::string& body, bool stream);
+    void build_messages_json(Conversation& conv);
+    std::string build_request_body(Conversation& conv, bool stream, const ContextPlan& plan,
+                                   bool with_system_prompt = true);
+    bool plan_summary(Conversation& conv, size_t target, SummaryJob& job);
+    void send_summary(SummaryJob job);
+    void send_completion(const std::string& prompt, bool with_system_prompt,
+                         std::function<void(ApiReply&&)> done, CachePolicy cache);
+    
+    // A conversation together with the lock held on it, or empty if there
+    // is no such conversation. The reference is declared first so it
+    // outlives the lock.
+    using WriteLock = std::unique_lock<ConversationMutex>;
+    using ReadLock = std::shared_lock<ConversationMutex>;
+    template <typename Lock>
+    struct Locked {
+        std::shared_ptr<Conversation> conv;
+        Lock lock;
+        
+        explicit operator bool() const { return conv != nullptr; }
+        Conversation* operator->() const { return conv.get(); }
+        Conversation& operator*() const { return *conv; }
+    };
+    
+    // Conversation lookup by id or handle, with state_mutex held shared.
+    // share_conversations takes references to a page of them, most
+    // recently active first, to be locked one at a time afterwards.
+    template <typename Lock, typename Key>
+    Locked<Lock> lock_conversation(const Key& key) const;
+    std::vector<std::shared_ptr<Conversation>> share_conversations(size_t offset = 0,
+                                                                   size_t limit = SIZE_MAX) const;
+    // Called with store_mutex held exclusively; returns the new id.
+    std::string add_conversation(const std::string& title);
+    
+    // Turn pipeline
+    std::string current_conversation_for_send();
+    std::future<std::string> enqueue_turn(const std::string& conversation_id,
+                                          const std::string& user_message,
+                                          const std::function<void(const std::string&)>& on_text,
+                                          CachePolicy cache,
+                                          std::function<void(const std::string&)> on_reply = nullptr);
+    void send_request(const std::string& body, uint64_t serialize_us, bool stream,
+                      const std::function<void(const std::string&)>& on_text,
+                      CachePolicy cache, std::function<void(const ApiReply&)> done);
+    void record_request_metrics(const ApiReply& reply);
+    void run_turns(std::shared_ptr<PendingTurn> turn);
+    void start_turn(std::shared_ptr<PendingTurn> turn);
+    void complete_turn(std::shared_ptr<PendingTurn> turn, const ApiReply& api_reply);
+    void finish_turn(Conversation& conv, const std::string& assistant_response);
+    void rollback_turn(Conversation& conv);
+    
+    // Persistence helpers
+    void commit(const JournalRecord& record);
+    bool write_conversation_files(uint64_t& covered);
+    void apply_journal_record(const JournalRecord& record);
+    bool load_from_disk();
+    bool migrate_snapshot(const std::string& path, bool& index_current);
+    void read_snapshot(std::ifstream& file);
+    void rebuild_search_index();
+    
+    // Message paging
+    bool ensure_loaded(Conversation& conv);
+    void release_messages(Conversation& conv);
+    void evict_cold_messages(const Conversation* keep);
+    void append_message(Conversation& conv, const MessageView& msg);
+    void truncate_messages(Conversation& conv, size_t count);
+    void clear_messages(Conversation& conv);
     
 public:
+    // Conversations are kept under data_directory, or the platform's
+    // application data directory if it is empty. Requests go through
+    // scheduler, shared with other chatbots using the same API key so they
+    // share its rate limits and connections, or through one of its own if
+    // it is null.
     ClaudeChatbot(const std::string& api_key, 
                   const std::string& model = "claude-sonnet-4-20250514",
-                  int max_tokens = 1000);
+                  int max_tokens = 1000,
+                  const std::string& data_directory = "",
+                  std::shared_ptr<RequestScheduler> scheduler = nullptr);
+    // Waits for requests still outstanding. Those on a scheduler of its own
+    // are failed first; on a shared one they run to completion unless it is
+    // shut down.
+    ~ClaudeChatbot();
+    ClaudeChatbot(const ClaudeChatbot&) = delete;
+    ClaudeChatbot& operator=(const ClaudeChatbot&) = delete;
+    
+    // The platform's application data directory, used when no data
+    // directory is given
+    static std::string get_data_directory();
+    
+    // Core chat functions. The forms without a conversation id act on the
+    // current conversation, which is shared by every caller; concurrent
+    // callers should name their conversation instead.
+    std::string send_message(const std::string& user_message, CachePolicy cache = CachePolicy::Use);
+    std::string send_message(const std::string& conversation_id, const std::string& user_message,
+                             CachePolicy cache = CachePolicy::Use);
     
-    // Core chat functions
-    std::string send_message(const std::string& user_message);
+    // Streams the reply: on_text receives each text delta as it arrives (on
+    // the transport thread). Returns and persists the assembled reply.
+    std::string send_message_stream(const std::string& user_message,
+                                    const std::function<void(const std::string&)>& on_text,
+                                    CachePolicy cache = CachePolicy::Use);
+    
+    // Queues a turn on the given conversation and returns at once. Requests
+    // for different conversations run concurrently on the transport's event
+    // loop; turns on the same conversation run one after another. The reply
+    // is queued for the journal before the future becomes ready.
+    std::future<std::string> send_message_async(const std::string& conversation_id,
+                                                const std::string& user_message,
+                                                CachePolicy cache = CachePolicy::Use);
+    
+    // As above, streaming the reply: on_text receives each text delta on the
+    // transport thread.
+    std::future<std::string> send_message_async(const std::string& conversation_id,
+                                                const std::string& user_message,
+                                                const std::function<void(const std::string&)>& on_text,
+                                                CachePolicy cache = CachePolicy::Use);
+    
+    // As above, handing the reply to on_reply (on the transport thread)
+    // instead of a future, so nothing has to wait for it. Either callback
+    // may be empty.
+    void send_message_async(const std::string& conversation_id,
+                            const std::string& user_message,
+                            const std::function<void(const std::string&)>& on_text,
+                            std::function<void(const std::string&)> on_reply,
+                            CachePolicy cache = CachePolicy::Use);
+    
+    // One-off prompt outside any conversation; nothing is persisted. done is
+    // called on the transport thread.
+    void complete_async(const std::string& prompt, std::function<void(ApiReply&&)> done,
+                        CachePolicy cache = CachePolicy::Use);
+    
+    // Usage, stop reason, error details and metrics of the most recent chat
+    // turn on any conversation.
+    ApiReply get_last_reply() const;
     void start_new_conversation(const std::string& title = "");
-    void load_conversation(const std::string& conversation_id);
+    // Creates a conversation without making it current; returns its id.
+    std::string create_conversation(const std::string& title = "");
+    bool has_conversation(const std::string& conversation_id) const;
+    // No turn queued or in flight and no request outstanding.
+    bool is_idle();
+    // False if there is no such conversation or it cannot be read.
+    bool load_conversation(const std::string& conversation_id);
     
     // Conversation management
+    // Compacts the journal into the conversation files and waits until they
+    // are written. Must not be called from a reply callback.
     void save_conversations();
     void load_conversations();
-    std::vector<Conversation> get_all_conversations();
+    // Not synchronised with anything that changes the conversation
+    // afterwards, replies landing in the background included; only for a
+    // single caller that has nothing else in flight. Null if its messages
+    // cannot be read.
     Conversation* get_current_conversation();
+    std::string get_current_conversation_id() const;
+    
+    // Listing without touching message bodies, most recently active first.
+    // Page through with offset/limit.
+    size_t get_conversation_count() const;
+    std::vector<ConversationSummary> list_conversations(size_t offset = 0,
+                                                        size_t limit = SIZE_MAX) const;
+    
+    // Visits messages [offset, offset + limit) of a conversation in place:
+    // out of memory if resident, otherwise straight out of its block file
+    // without paging the conversation in. False if there is no
+    // such conversation. The conversation is locked for reading meanwhile,
+    // so on_message must not change it.
+    bool for_each_message(const std::string& conversation_id, const MessageCallback& on_message,
+                          size_t offset = 0, size_t limit = SIZE_MAX) const;
+    
+    // Deep copy of every conversation including its messages; prefer
+    // list_conversations.
+    std::vector<Conversation> get_all_conversations();
     void delete_conversation(const std::string& conversation_id);
+    void clear_conversation(const std::string& conversation_id);
     void clear_current_conversation();
     
     // Search and export
     std::vector<Message> search_messages(const std::string& query);
+    std::vector<SearchHit> search_ranked(const std::string& query, size_t top_k = 10);
+    bool scan_messages(const std::string& pattern, ScanMode mode, const ScanCallback& on_hit);
+    bool get_message(const std::string& conversation_id, size_t index, Message& out);
     bool export_conversation(const std::string& conversation_id, const std::string& filepath);
     
     // Settings
     void set_model(const std::string& new_model);
     void set_max_tokens(int tokens);
     std::string get_model() const;
+    
+    // Where requests are sent, e.g. a local mock server for load tests. An
+    // empty url restores DEFAULT_API_URL. Applies to requests started
+    // afterwards.
+    void set_api_url(const std::string& url);
+    std::string get_api_url() const;
+    
+    // Sent as the system prompt of every chat turn and complete_async call,
+    // ahead of a conversation's summary; background summaries go without
+    // it. Empty for none. Applies to requests started afterwards.
+    void set_system_prompt(const std::string& prompt);
+    std::string get_system_prompt() const;
+    
+    // Prompt caching (on by default): requests mark their stable prefix
+    // with cache_control breakpoints, after the system prompt, after the
+    // summary and on the newest message, so the next turn has the API read
+    // the conversation so far back from its cache instead of processing it
+    // again. Prefixes too short for the API to cache are left unmarked. The
+    // cache_read and cache_creation token counts of each reply end up in
+    // get_last_reply().usage and the metrics.
+    void set_prompt_caching(bool enabled);
+    bool prompt_caching_enabled() const;
+    
+    // Upper bound on the estimated input tokens of a request (0 = no limit).
+    // Older turns beyond it are replaced by a rolling summary.
+    void set_context_budget(uint64_t tokens);
+    uint64_t get_context_budget() const;
+    
+    // Upper bound on message bytes kept in memory; conversations that are
+    // fully persisted in their block files are evicted least recently used first.
+    void set_memory_budget(uint64_t bytes);
+    uint64_t get_resident_bytes() const;
+    StorageStats get_storage_stats() const;
+    
+    // Optional on-disk cache of successful replies (off by default), keyed
+    // by model, max_tokens and the exact messages sent. Consulted before any
+    // network I/O; least recently used entries go once it exceeds max_bytes.
+    void set_response_cache(bool enabled, uint64_t max_bytes = ResponseCache::DEFAULT_MAX_BYTES);
+    bool response_cache_enabled() const;
+    ResponseCacheStats get_response_cache_stats() const;
+    void clear_response_cache();
+    
+    // Changes are handed to a background writer thread, which appends them
+    // to the journal in group commits, so a turn never waits on the disk.
+    // The fsync policy decides how soon they reach stable storage (default:
+    // at most once a second). flush() waits until every change so far is
+    // written and synced.
+    void set_fsync_policy(FsyncPolicy policy, uint64_t interval_ms = 1000);
+    FsyncPolicy get_fsync_policy() const;
+    uint64_t get_fsync_interval_ms() const;
+    WriterStats get_writer_stats() const;
+    void flush();
+    
+    // Requests are paced to the account's requests- and tokens-per-minute
+    // limits, taken from the API's rate-limit headers unless set here, and
+    // those failing with 429, 529, 5xx or a network error are retried with
+    // jittered backoff. A turn that still fails is not stored: its message
+    // is taken back out of the conversation and the caller gets "Error: ..."
+    // as the reply. With a shared scheduler these act on the shared one.
+    void set_scheduler_options(const SchedulerOptions& options);
+    SchedulerOptions get_scheduler_options() const;
+    SchedulerStats get_scheduler_stats() const;
+    
+    // Connection pool: open the API connection ahead of the first message,
+    // and count how many requests reused an already open connection.
+    void prewarm_connection();
+    TransportStats get_transport_stats() const;
+    
+    // Every request's curl phase timings, bytes on the wire, token usage
+    // and local serialize/parse/persist times, aggregated into histograms
+    // along with the writer's journal and compaction times. dump_metrics
+    // writes them as Prometheus text or JSON, replacing path atomically.
+    MetricsSnapshot get_metrics() const;
+    std::string export_metrics(MetricsFormat format) const;
+    bool dump_metrics(const std::string& path, MetricsFormat format) const;
+    void reset_metrics();
 };
 
 #endif // CHATBOT_H
@@ -0,0 +1,117 @@
+#include "context_manager.h"
+#include <algorithm>
+
+// Role and framing of each message in the request
+static const uint32_t MESSAGE_OVERHEAD_TOKENS = 4;
+
+uint32_t ContextManager::estimate_tokens(const char* data, size_t size) {
+    size_t ascii = 0;
+    size_t other = 0;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        ascii += c < 0x80;
+        other += c >= 0xC0;     // UTF-8 lead bytes only
+    }
+    return static_cast<uint32_t>((ascii + 3) / 4 + other);
+}
+
+uint32_t ContextManager::estimate_tokens(const MessageView& msg) {
+    return estimate_tokens(msg.content.data(), msg.content.size()) + MESSAGE_OVERHEAD_TOKENS;
+}
+
+ContextPlan ContextManager::plan(const Conversation& conv, uint64_t fixed_tokens) const {
+    ContextPlan result;
+    const std::vector<uint64_t>& totals = conv.token_totals;
+    size_t count = totals.size();
+    if (budget == 0 || count == 0 || totals.back() + fixed_tokens <= budget) {
+        return result;
+    }
+
+    // Tokens in messages [first, count)
+    auto tail = [&](size_t first) {
+        return totals.back() - (first ? totals[first - 1] : 0);
+    };
+    // First turn at or after from whose tail fits in limit. The tail shrinks
+    // as first grows, so this is a binary search.
+    auto first_fitting = [&](size_t from, uint64_t limit) {
+        size_t lo = from, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (tail(mid) <= limit) hi = mid; else lo = mid + 1;
+        }
+        while (lo < count && conv.messages[lo].role != Role::User) lo++;
+        return lo;
+    };
+
+    uint64_t summary_tokens = 0;
+    if (conv.summary_covers > 0) {
+        summary_tokens = estimate_tokens(conv.summary.data(), conv.summary.size()) + MESSAGE_OVERHEAD_TOKENS;
+    }
+    uint64_t available = budget > summary_tokens + fixed_tokens ? budget - summary_tokens - fixed_tokens : 0;
+
+    size_t first = first_fitting(conv.summary_covers, available);
+    if (first >= count) {
+        // Even the latest turn alone is over budget; send it anyway
+        first = count - 1;
+        while (first > 0 && conv.messages[first].role != Role::User) first--;
+    }
+    result.first_message = first;
+    result.use_summary = conv.summary_covers > 0;
+
+    // Summarize ahead to half the budget so this does not recur every turn
+    size_t target = first_fitting(conv.summary_covers, budget / 2);
+    if (target >= count) target = first;
+    if (target > conv.summary_covers) {
+        result.summarize_to = target;
+    }
+    return result;
+}
+
+size_t ContextManager::summary_chunk_end(const Conversation& conv, size_t target) const {
+    size_t start = conv.summary_covers;
+    uint64_t base = start ? conv.token_totals[start - 1] : 0;
+    uint64_t limit = std::max<uint64_t>(budget / 2, 1);
+
+    size_t end = start;
+    while (end < target && conv.token_totals[end] - base <= limit) end++;
+    if (end == start) end = start + 1;
+
+    // Stop before a user message so the summary ends on a complete turn
+    while (end < target && end > start + 1 && conv.messages[end].role != Role::User) end--;
+    return end;
+}
+
+std::string ContextManager::build_summary_prompt(const Conversation& conv, size_t begin, size_t end) const {
+    // Keep a single oversized message from blowing the summarizer's context
+    size_t max_message_bytes = budget ? static_cast<size_t>(budget) * 2 : std::string::npos;
+
+    std::string prompt =
+        "Summarize the conversation below so that the summary can stand in for it "
+        "as context when the conversation continues. Keep facts, names, numbers, "
+        "decisions, code details and open questions; leave out pleasantries. "
+        "Reply with the summary only.\n\n";
+    if (!conv.summary.empty()) {
+        prompt += "Summary of the conversation so far:\n";
+        prompt += conv.summary;
+        prompt += "\n\nThe conversation continues:\n\n";
+    } else {
+        prompt += "Conversation:\n\n";
+    }
+    for (size_t i = begin; i < end; i++) {
+        MessageView msg = conv.messages[i];
+        prompt += msg.role == Role::User ? "User: " : "Assistant: ";
+        if (msg.content.size() > max_message_bytes) {
+            prompt += msg.content.substr(0, max_message_bytes);
+            prompt += " [...]";
+        } else {
+            prompt += msg.content;
+        }
+        prompt += "\n\n";
+    }
+    return prompt;
+}
+
+std::string ContextManager::summary_preamble(const std::string& summary) {
+    return "The earlier part of this conversation is not included. "
+           "Summary of it:\n\n" + summary;
+}
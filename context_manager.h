@@ -0,0 +1,59 @@
+#ifndef CONTEXT_MANAGER_H
+#define CONTEXT_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "conversation.h"
+
+// What part of a conversation goes into the next request.
+struct ContextPlan {
+    size_t first_message = 0;   // messages before this one are left out
+    bool use_summary = false;   // send conv.summary in their place
+    size_t summarize_to = 0;    // if nonzero, the summary should be extended
+                                // in the background to cover this many messages
+};
+
+// Keeps requests under a token budget. Token counts are estimated locally
+// (no tokenizer round trip); once a conversation outgrows the budget its
+// oldest turns are replaced by a rolling summary kept on the Conversation.
+// The summary is only ever extended in the background, so until it catches
+// up the oldest turns beyond it are simply left out.
+class ContextManager {
+private:
+    uint64_t budget;
+
+public:
+    static constexpr uint64_t DEFAULT_BUDGET = 100000;
+
+    ContextManager() : budget(DEFAULT_BUDGET) {}
+
+    // 0 means unlimited.
+    void set_budget(uint64_t tokens) { budget = tokens; }
+    uint64_t get_budget() const { return budget; }
+
+    // Roughly four ASCII characters per token; other characters count as a
+    // token each. Errs on the high side for typical English and code.
+    static uint32_t estimate_tokens(const char* data, size_t size);
+    static uint32_t estimate_tokens(const MessageView& msg);
+
+    // conv.token_totals must cover every message. fixed_tokens are sent
+    // with every request whatever the plan, e.g. the system prompt.
+    ContextPlan plan(const Conversation& conv, uint64_t fixed_tokens = 0) const;
+
+    // Where the next background summary should stop: at most about half the
+    // budget's worth of messages past conv.summary_covers, ending on a turn
+    // boundary, and never beyond target.
+    size_t summary_chunk_end(const Conversation& conv, size_t target) const;
+
+    // Prompt asking the model to fold messages [begin, end) into the
+    // existing summary.
+    std::string build_summary_prompt(const Conversation& conv, size_t begin, size_t end) const;
+
+    // Text sent as the system prompt alongside a summarized conversation.
+    static std::string summary_preamble(const std::string& summary);
+};
+
+#endif // CONTEXT_MANAGER_H
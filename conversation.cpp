@@ -0,0 +1,136 @@
+#include "conversation.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "platform.h"
+
+const char* role_name(Role role) {
+    return role == Role::Assistant ? "assistant" : "user";
+}
+
+bool parse_role(std::string_view name, Role& role) {
+    if (name == "user") {
+        role = Role::User;
+    } else if (name == "assistant") {
+        role = Role::Assistant;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string format_timestamp(int64_t epoch_seconds) {
+    std::time_t time = static_cast<std::time_t>(epoch_seconds);
+    std::tm local;
+#ifdef PLATFORM_WINDOWS
+    localtime_s(&local, &time);
+#else
+    localtime_r(&time, &local);
+#endif
+    char text[32];
+    size_t length = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    return std::string(text, length);
+}
+
+int64_t parse_timestamp(std::string_view text) {
+    char buffer[32];
+    if (text.size() >= sizeof(buffer)) return 0;
+    std::memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+
+    std::tm local = {};
+    if (std::sscanf(buffer, "%d-%d-%d %d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+                    &local.tm_hour, &local.tm_min, &local.tm_sec) != 6) {
+        return 0;
+    }
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    std::time_t time = std::mktime(&local);
+    return time == static_cast<std::time_t>(-1) ? 0 : static_cast<int64_t>(time);
+}
+
+MessageLog::MessageLog() : chunk_pos(nullptr), chunk_left(0), arena_bytes(0) {}
+
+MessageLog::MessageLog(const MessageLog& other) : MessageLog() {
+    entries.reserve(other.entries.size());
+    for (const MessageView& message : other) {
+        push_back(message);
+    }
+}
+
+MessageLog::MessageLog(MessageLog&& other) noexcept
+    : entries(std::move(other.entries)), chunks(std::move(other.chunks)),
+      chunk_pos(other.chunk_pos), chunk_left(other.chunk_left), arena_bytes(other.arena_bytes) {
+    other.chunk_pos = nullptr;
+    other.chunk_left = 0;
+    other.arena_bytes = 0;
+}
+
+MessageLog& MessageLog::operator=(MessageLog other) noexcept {
+    entries.swap(other.entries);
+    chunks.swap(other.chunks);
+    std::swap(chunk_pos, other.chunk_pos);
+    std::swap(chunk_left, other.chunk_left);
+    std::swap(arena_bytes, other.arena_bytes);
+    return *this;
+}
+
+const char* MessageLog::store_text(std::string_view text) {
+    if (text.empty()) return nullptr;
+
+    // Big messages get a chunk of their own so the current one is not wasted
+    if (text.size() > CHUNK_BYTES / 4) {
+        chunks.emplace_back(new char[text.size()]);
+        arena_bytes += text.size();
+        std::memcpy(chunks.back().get(), text.data(), text.size());
+        return chunks.back().get();
+    }
+    if (text.size() > chunk_left) {
+        chunks.emplace_back(new char[CHUNK_BYTES]);
+        arena_bytes += CHUNK_BYTES;
+        chunk_pos = chunks.back().get();
+        chunk_left = CHUNK_BYTES;
+    }
+    char* at = chunk_pos;
+    std::memcpy(at, text.data(), text.size());
+    chunk_pos += text.size();
+    chunk_left -= text.size();
+    return at;
+}
+
+void MessageLog::push_back(const MessageView& message) {
+    Entry entry;
+    entry.content = store_text(message.content);
+    entry.size = static_cast<uint32_t>(message.content.size());
+    entry.role = message.role;
+    entry.timestamp = message.timestamp;
+    entries.push_back(entry);
+}
+
+void MessageLog::pop_back() {
+    const Entry& entry = entries.back();
+    if (entry.size > CHUNK_BYTES / 4) {
+        if (!chunks.empty() && chunks.back().get() == entry.content) {
+            chunks.pop_back();
+            arena_bytes -= entry.size;
+        }
+    } else if (entry.content != nullptr && entry.content + entry.size == chunk_pos) {
+        chunk_pos -= entry.size;
+        chunk_left += entry.size;
+    }
+    entries.pop_back();
+}
+
+void MessageLog::clear() {
+    std::vector<Entry>().swap(entries);
+    std::vector<std::unique_ptr<char[]>>().swap(chunks);
+    chunk_pos = nullptr;
+    chunk_left = 0;
+    arena_bytes = 0;
+}
+
+uint64_t MessageLog::memory_bytes() const {
+    return entries.capacity() * sizeof(Entry) + chunks.capacity() * sizeof(chunks[0]) + arena_bytes;
+}
@@ -0,0 +1,222 @@
+#ifndef CONVERSATION_H
+#define CONVERSATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class Role : uint8_t {
+    User = 0,
+    Assistant = 1
+};
+
+const char* role_name(Role role);                   // "user" / "assistant"
+bool parse_role(std::string_view name, Role& role);
+
+// Timestamps are seconds since the epoch and only turned into text
+// ("YYYY-MM-DD HH:MM:SS", local time) for display and export.
+std::string format_timestamp(int64_t epoch_seconds);
+// Reads the text form back, for files written before timestamps were
+// stored as numbers. 0 if malformed.
+int64_t parse_timestamp(std::string_view text);
+
+// Non-owning view of a message, e.g. one in a MessageLog or read straight
+// out of a mapped block.
+struct MessageView {
+    Role role = Role::User;
+    std::string_view content;
+    int64_t timestamp = 0;
+
+    MessageView() = default;
+    MessageView(Role role, std::string_view content, int64_t timestamp)
+        : role(role), content(content), timestamp(timestamp) {}
+};
+
+// A message that owns its text, for handing out of and into the chatbot.
+struct Message {
+    Role role = Role::User;
+    std::string content;
+    int64_t timestamp = 0;
+
+    Message() = default;
+    Message(Role role, std::string content, int64_t timestamp)
+        : role(role), content(std::move(content)), timestamp(timestamp) {}
+    explicit Message(const MessageView& view)
+        : role(view.role), content(view.content), timestamp(view.timestamp) {}
+
+    operator MessageView() const { return MessageView(role, content, timestamp); }
+};
+
+// A conversation's messages: 24-byte entries plus a text arena. Text is
+// copied into 64 KB chunks that never move, so entries point straight at
+// their content and a long history costs a handful of allocations rather
+// than several per message.
+class MessageLog {
+private:
+    struct Entry {
+        const char* content;
+        uint32_t size;
+        Role role;
+        int64_t timestamp;
+    };
+
+    static const size_t CHUNK_BYTES = 64 * 1024;
+
+    std::vector<Entry> entries;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* chunk_pos;
+    size_t chunk_left;
+    uint64_t arena_bytes;
+
+    const char* store_text(std::string_view text);
+
+public:
+    class const_iterator {
+    private:
+        const MessageLog* log;
+        size_t index;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MessageView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = MessageView;
+
+        const_iterator(const MessageLog* log, size_t index) : log(log), index(index) {}
+
+        MessageView operator*() const { return (*log)[index]; }
+        const_iterator& operator++() {
+            index++;
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+
+    MessageLog();
+    MessageLog(const MessageLog& other);
+    MessageLog(MessageLog&& other) noexcept;
+    MessageLog& operator=(MessageLog other) noexcept;
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    MessageView operator[](size_t index) const {
+        const Entry& entry = entries[index];
+        return MessageView(entry.role, std::string_view(entry.content, entry.size), entry.timestamp);
+    }
+    MessageView back() const { return (*this)[entries.size() - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, entries.size()); }
+
+    void reserve(size_t count) { entries.reserve(count); }
+    void push_back(const MessageView& message);
+    // Drops the last message, giving its text back to the arena when it was
+    // the last thing stored.
+    void pop_back();
+
+    // Frees the entries and the arena.
+    void clear();
+
+    // Heap bytes held, for the memory budget.
+    uint64_t memory_bytes() const;
+};
+
+// What a conversation listing needs, without the messages.
+struct ConversationSummary {
+    std::string id;
+    std::string title;
+    int64_t created_at = 0;
+    int64_t last_modified = 0;
+    size_t message_count = 0;
+};
+
+// Reader-writer lock carried by each Conversation. Copies and moves get a
+// fresh, unlocked one, so conversations stay plain values.
+class ConversationMutex {
+private:
+    std::shared_mutex mutex;
+
+public:
+    ConversationMutex() = default;
+    ConversationMutex(const ConversationMutex&) {}
+    ConversationMutex& operator=(const ConversationMutex&) { return *this; }
+
+    void lock() { mutex.lock(); }
+    bool try_lock() { return mutex.try_lock(); }
+    void unlock() { mutex.unlock(); }
+    void lock_shared() { mutex.lock_shared(); }
+    bool try_lock_shared() { return mutex.try_lock_shared(); }
+    void unlock_shared() { mutex.unlock_shared(); }
+};
+
+struct Conversation {
+    std::string id;
+    std::string title;
+    MessageLog messages;
+    int64_t created_at = 0;
+    int64_t last_modified = 0;
+
+    // Valid even while the message bodies are not paged in.
+    size_t message_count = 0;
+
+    // Storage bookkeeping. A conversation whose messages match its block
+    // file can drop them from memory and page them back in. block_offset is
+    // only used while migrating conversations.dat.
+    bool messages_loaded = true;
+    bool in_snapshot = false;
+    uint64_t block_offset = 0;
+    uint64_t block_size = 0;
+    uint64_t block_raw_size = 0;    // size of the messages before compression
+    uint64_t resident_bytes = 0;
+    uint64_t last_used = 0;
+    uint64_t revision = 0;          // bumped on every change to the messages
+
+    // Rolling summary of the first summary_covers messages, sent in their
+    // place once the conversation outgrows the context budget. The messages
+    // themselves stay in the history.
+    std::string summary;
+    size_t summary_covers = 0;
+    uint64_t summary_job = 0;       // background summary in flight, 0 if none
+
+    // The messages already serialized for the Messages API ("{...},{...}"),
+    // where each one starts in it, and running token estimates. Messages
+    // are append-only between clears, so each turn only processes what is
+    // new. Anything that clears, edits or drops the messages must reset it.
+    std::string request_json;
+    std::vector<size_t> request_json_offsets;
+    std::vector<uint64_t> token_totals;
+
+    // Guards everything above but id, title and created_at, which never
+    // change. erased is set, under the lock, once the conversation has been
+    // deleted, for holders of a reference that outlived the deletion.
+    mutable ConversationMutex mutex;
+    bool erased = false;
+
+    size_t request_json_count() const { return request_json_offsets.size(); }
+
+    // Forgets the serialized messages past the first count, after messages
+    // were dropped from the end.
+    void truncate_request_json(size_t count) {
+        if (count >= request_json_offsets.size()) return;
+        size_t end = request_json_offsets[count];
+        request_json.resize(count > 0 ? end - 1 : 0);   // and the comma before it
+        request_json_offsets.resize(count);
+        token_totals.resize(count);
+    }
+
+    void reset_request_json() {
+        std::string().swap(request_json);
+        std::vector<size_t>().swap(request_json_offsets);
+        std::vector<uint64_t>().swap(token_totals);
+    }
+};
+
+#endif // CONVERSATION_H
@@ -0,0 +1,272 @@
+#include "conversation_files.h"
+#include "journal.h"
+#include "platform.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+    #include <direct.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+static const char CATALOG_MAGIC[4] = {'C', 'C', 'C', '1'};
+static const char BLOCK_SUFFIX[] = ".blk";
+static const char TEMP_SUFFIX[] = ".tmp";
+
+static void put_u64(std::string& buf, uint64_t value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put_string(std::string& buf, const std::string& value) {
+    put_u64(buf, value.size());
+    buf.append(value);
+}
+
+static bool get_u64(const std::string& buf, size_t& pos, uint64_t& value) {
+    if (buf.size() - pos < sizeof(value)) return false;
+    buf.copy(reinterpret_cast<char*>(&value), sizeof(value), pos);
+    pos += sizeof(value);
+    return true;
+}
+
+static bool get_string(const std::string& buf, size_t& pos, std::string& value) {
+    uint64_t len;
+    if (!get_u64(buf, pos, len) || buf.size() - pos < len) return false;
+    value.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+static bool get_time(const std::string& buf, size_t& pos, int64_t& value) {
+    uint64_t raw;
+    if (!get_u64(buf, pos, raw)) return false;
+    value = static_cast<int64_t>(raw);
+    return true;
+}
+
+static bool read_file(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    out.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(&out[0], static_cast<std::streamsize>(out.size())));
+}
+
+// Written under a temporary name, then renamed over path
+static bool write_file(const std::string& path, const std::string& data, bool durable) {
+    std::string temp_path = path + TEMP_SUFFIX;
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    file.close();
+    if (!file || (durable && !sync_file(temp_path)) || !replace_file(temp_path, path)) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Ids become file names; anything but [A-Za-z0-9_-] is written as %XX.
+static std::string encode_file_name(const std::string& id) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string name;
+    name.reserve(id.size());
+    for (unsigned char c : id) {
+        if (std::isalnum(c) || c == '_' || c == '-') {
+            name.push_back(static_cast<char>(c));
+        } else {
+            name.push_back('%');
+            name.push_back(HEX[c >> 4]);
+            name.push_back(HEX[c & 0x0f]);
+        }
+    }
+    return name;
+}
+
+static bool decode_file_name(const std::string& name, std::string& id) {
+    id.clear();
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] != '%') {
+            id.push_back(name[i]);
+            continue;
+        }
+        if (i + 2 >= name.size()) return false;
+        unsigned value;
+        if (std::sscanf(name.c_str() + i + 1, "%2x", &value) != 1) return false;
+        id.push_back(static_cast<char>(value));
+        i += 2;
+    }
+    return true;
+}
+
+static bool ends_with(const std::string& text, const char* suffix) {
+    size_t length = std::strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static std::vector<std::string> list_directory(const std::string& path) {
+    std::vector<std::string> names;
+#ifdef PLATFORM_WINDOWS
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) return names;
+    do {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(entry.cFileName);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return names;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+    return names;
+}
+
+ConversationFiles::ConversationFiles(unsigned threads) {
+    thread_count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ConversationFiles::set_directory(const std::string& data_dir) {
+    directory = data_dir;
+    blocks_directory = data_dir + "/conversations";
+#ifdef PLATFORM_WINDOWS
+    _mkdir(blocks_directory.c_str());
+#else
+    mkdir(blocks_directory.c_str(), 0755);
+#endif
+}
+
+std::string ConversationFiles::block_path(const std::string& conversation_id) const {
+    return blocks_directory + "/" + encode_file_name(conversation_id) + BLOCK_SUFFIX;
+}
+
+std::string ConversationFiles::catalog_path() const {
+    return directory + "/catalog.dat";
+}
+
+bool ConversationFiles::read_catalog(std::vector<Conversation>& conversations, uint64_t& generation) const {
+    std::string data;
+    if (!read_file(catalog_path(), data)) return false;
+    if (data.size() < sizeof(CATALOG_MAGIC) + 4 ||
+        std::memcmp(data.data(), CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0) {
+        return false;
+    }
+    uint32_t version;
+    std::memcpy(&version, data.data() + sizeof(CATALOG_MAGIC), sizeof(version));
+    if (version != CATALOG_VERSION) return false;
+
+    size_t pos = sizeof(CATALOG_MAGIC) + sizeof(version);
+    uint64_t count;
+    if (!get_u64(data, pos, generation) || !get_u64(data, pos, count)) return false;
+
+    conversations.clear();
+    for (uint64_t i = 0; i < count; i++) {
+        Conversation conv;
+        uint64_t message_count, summary_covers;
+        if (!get_string(data, pos, conv.id) ||
+            !get_string(data, pos, conv.title) ||
+            !get_time(data, pos, conv.created_at) ||
+            !get_time(data, pos, conv.last_modified) ||
+            !get_u64(data, pos, message_count) ||
+            !get_u64(data, pos, conv.block_size) ||
+            !get_u64(data, pos, conv.block_raw_size) ||
+            !get_string(data, pos, conv.summary) ||
+            !get_u64(data, pos, summary_covers)) {
+            return false;
+        }
+        conv.message_count = static_cast<size_t>(message_count);
+        conv.summary_covers = static_cast<size_t>(std::min(summary_covers, message_count));
+        conv.messages_loaded = false;
+        conv.in_snapshot = true;
+        conversations.push_back(std::move(conv));
+    }
+    return true;
+}
+
+bool ConversationFiles::write_catalog(const std::vector<const Conversation*>& conversations,
+                                      uint64_t generation, bool durable) const {
+    std::string data(CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    data.append(reinterpret_cast<const char*>(&CATALOG_VERSION), sizeof(CATALOG_VERSION));
+    put_u64(data, generation);
+    put_u64(data, conversations.size());
+    for (const Conversation* conv : conversations) {
+        put_string(data, conv->id);
+        put_string(data, conv->title);
+        put_u64(data, static_cast<uint64_t>(conv->created_at));
+        put_u64(data, static_cast<uint64_t>(conv->last_modified));
+        put_u64(data, conv->message_count);
+        put_u64(data, conv->block_size);
+        put_u64(data, conv->block_raw_size);
+        put_string(data, conv->summary);
+        put_u64(data, conv->summary_covers);
+    }
+    return write_file(catalog_path(), data, durable);
+}
+
+bool ConversationFiles::write_block(const std::string& conversation_id, const std::string& block,
+                                    bool durable) const {
+    return write_file(block_path(conversation_id), block, durable);
+}
+
+bool ConversationFiles::read_block(const std::string& conversation_id, std::string& block) const {
+    return read_file(block_path(conversation_id), block);
+}
+
+std::unordered_set<std::string> ConversationFiles::stored_ids() const {
+    std::unordered_set<std::string> ids;
+    std::string id;
+    for (const std::string& name : list_directory(blocks_directory)) {
+        if (!ends_with(name, BLOCK_SUFFIX)) continue;
+        if (decode_file_name(name.substr(0, name.size() - std::strlen(BLOCK_SUFFIX)), id)) {
+            ids.insert(id);
+        }
+    }
+    return ids;
+}
+
+size_t ConversationFiles::remove_orphans(const std::unordered_set<std::string>& live) const {
+    size_t removed = 0;
+    std::string id;
+    for (const std::string& name : list_directory(blocks_directory)) {
+        bool orphan = ends_with(name, TEMP_SUFFIX);
+        if (!orphan && ends_with(name, BLOCK_SUFFIX)) {
+            orphan = !decode_file_name(name.substr(0, name.size() - std::strlen(BLOCK_SUFFIX)), id) ||
+                     live.count(id) == 0;
+        }
+        if (orphan && std::remove((blocks_directory + "/" + name).c_str()) == 0) {
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void ConversationFiles::parallel_for(size_t count, const std::function<void(size_t)>& task) const {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < count) {
+            task(i);
+        }
+    };
+
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(thread_count, count));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < workers; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
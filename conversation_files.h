@@ -0,0 +1,68 @@
+#ifndef CONVERSATION_FILES_H
+#define CONVERSATION_FILES_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "conversation.h"
+
+// Conversations on disk, one file each plus a small catalog:
+//
+//   catalog.dat              "CCC1" | u32 version | u64 generation | u64 count
+//                            | per conversation, most recently active first:
+//                            id, title, i64 created_at, i64 last_modified,
+//                            u64 message count, u64 block size, u64 size of
+//                            the messages, summary, u64 messages summarized
+//   conversations/<id>.blk   the conversation's message block, laid out like
+//                            a block of conversations.dat (see snapshot.h)
+//
+// Strings are a u64 length and the bytes. Every file is written under a
+// temporary name and renamed into place, so a crash leaves either the old
+// or the new version. Only conversations that changed are rewritten, and
+// deleting one unlinks its file.
+//
+// The generation increases with every catalog written so files derived from
+// it (such as the search index) can tell whether they are still current.
+const uint32_t CATALOG_VERSION = 1;
+
+class ConversationFiles {
+private:
+    std::string directory;
+    std::string blocks_directory;
+    unsigned thread_count;
+
+public:
+    explicit ConversationFiles(unsigned threads = 0);
+
+    // Creates the conversations/ directory under data_dir if needed.
+    void set_directory(const std::string& data_dir);
+
+    const std::string& block_directory() const { return blocks_directory; }
+    std::string block_path(const std::string& conversation_id) const;
+    std::string catalog_path() const;
+
+    // Fills conversations with metadata only; messages are left unloaded.
+    bool read_catalog(std::vector<Conversation>& conversations, uint64_t& generation) const;
+    bool write_catalog(const std::vector<const Conversation*>& conversations, uint64_t generation,
+                       bool durable) const;
+
+    // durable syncs the file before it is renamed into place; the caller
+    // syncs the directory once a batch of files is in.
+    bool write_block(const std::string& conversation_id, const std::string& block, bool durable) const;
+    bool read_block(const std::string& conversation_id, std::string& block) const;
+
+    // Ids of the conversations that have a block file.
+    std::unordered_set<std::string> stored_ids() const;
+
+    // Removes block files, and temporaries left by a crash, that belong to
+    // none of the live conversations. Returns how many were removed.
+    size_t remove_orphans(const std::unordered_set<std::string>& live) const;
+
+    // Runs task(i) for every i in [0, count) on a pool of threads.
+    void parallel_for(size_t count, const std::function<void(size_t)>& task) const;
+};
+
+#endif // CONVERSATION_FILES_H
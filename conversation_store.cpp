@@ -0,0 +1,138 @@
+#include "conversation_store.h"
+
+ConversationStore::ConversationStore() : head(NONE), tail(NONE) {}
+
+uint32_t ConversationStore::allocate(Conversation&& conv) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    slots[slot].conversation = std::make_shared<Conversation>(std::move(conv));
+    index[slots[slot].conversation->id] = slot;
+    return slot;
+}
+
+void ConversationStore::link_front(uint32_t slot) {
+    slots[slot].prev = NONE;
+    slots[slot].next = head;
+    if (head != NONE) slots[head].prev = slot;
+    head = slot;
+    if (tail == NONE) tail = slot;
+}
+
+void ConversationStore::link_back(uint32_t slot) {
+    slots[slot].prev = tail;
+    slots[slot].next = NONE;
+    if (tail != NONE) slots[tail].next = slot;
+    tail = slot;
+    if (head == NONE) head = slot;
+}
+
+void ConversationStore::unlink(uint32_t slot) {
+    Slot& s = slots[slot];
+    if (s.prev != NONE) slots[s.prev].next = s.next; else head = s.next;
+    if (s.next != NONE) slots[s.next].prev = s.prev; else tail = s.prev;
+    s.prev = NONE;
+    s.next = NONE;
+}
+
+Conversation* ConversationStore::push_front(Conversation&& conv) {
+    if (index.count(conv.id)) return nullptr;
+    uint32_t slot = allocate(std::move(conv));
+    link_front(slot);
+    return slots[slot].conversation.get();
+}
+
+Conversation* ConversationStore::push_back(Conversation&& conv) {
+    if (index.count(conv.id)) return nullptr;
+    uint32_t slot = allocate(std::move(conv));
+    link_back(slot);
+    return slots[slot].conversation.get();
+}
+
+Conversation* ConversationStore::find(const std::string& id) {
+    auto it = index.find(id);
+    return it == index.end() ? nullptr : slots[it->second].conversation.get();
+}
+
+const Conversation* ConversationStore::find(const std::string& id) const {
+    auto it = index.find(id);
+    return it == index.end() ? nullptr : slots[it->second].conversation.get();
+}
+
+ConversationHandle ConversationStore::handle(const std::string& id) const {
+    ConversationHandle result;
+    auto it = index.find(id);
+    if (it != index.end()) {
+        result.slot = it->second;
+        result.generation = slots[it->second].generation;
+    }
+    return result;
+}
+
+Conversation* ConversationStore::get(ConversationHandle handle) {
+    if (handle.slot >= slots.size()) return nullptr;
+    Slot& s = slots[handle.slot];
+    return s.generation == handle.generation ? s.conversation.get() : nullptr;
+}
+
+const Conversation* ConversationStore::get(ConversationHandle handle) const {
+    if (handle.slot >= slots.size()) return nullptr;
+    const Slot& s = slots[handle.slot];
+    return s.generation == handle.generation ? s.conversation.get() : nullptr;
+}
+
+std::shared_ptr<Conversation> ConversationStore::share(const std::string& id) const {
+    auto it = index.find(id);
+    return it == index.end() ? nullptr : slots[it->second].conversation;
+}
+
+std::shared_ptr<Conversation> ConversationStore::share(ConversationHandle handle) const {
+    if (handle.slot >= slots.size()) return nullptr;
+    const Slot& s = slots[handle.slot];
+    return s.generation == handle.generation ? s.conversation : nullptr;
+}
+
+bool ConversationStore::erase(const std::string& id) {
+    auto it = index.find(id);
+    if (it == index.end()) return false;
+    uint32_t slot = it->second;
+    index.erase(it);
+    unlink(slot);
+    slots[slot].conversation.reset();
+    slots[slot].generation++;
+    free_slots.push_back(slot);
+    return true;
+}
+
+void ConversationStore::move_to_front(const std::string& id) {
+    auto it = index.find(id);
+    if (it == index.end() || it->second == head) return;
+    unlink(it->second);
+    link_front(it->second);
+}
+
+void ConversationStore::clear() {
+    // Generations survive so handles into the old contents stay dead
+    index.clear();
+    free_slots.clear();
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+        if (slots[slot].conversation) {
+            slots[slot].conversation.reset();
+            slots[slot].generation++;
+        }
+        slots[slot].prev = NONE;
+        slots[slot].next = NONE;
+        free_slots.push_back(slot);
+    }
+    head = NONE;
+    tail = NONE;
+}
+
+Conversation* ConversationStore::front() {
+    return head == NONE ? nullptr : slots[head].conversation.get();
+}
@@ -0,0 +1,127 @@
+#ifndef CONVERSATION_STORE_H
+#define CONVERSATION_STORE_H
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "conversation.h"
+
+// Refers to a conversation for as long as it exists. A handle outlives
+// inserts and deletes of other conversations; once its own conversation is
+// erased the slot's generation moves on and get() returns nullptr, even if
+// the slot has been reused.
+struct ConversationHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool valid() const { return slot != UINT32_MAX; }
+    bool operator==(const ConversationHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+    bool operator!=(const ConversationHandle& other) const { return !(*this == other); }
+};
+
+// Owns every conversation. Each lives in a heap slot of its own, so
+// Conversation pointers stay put until it is erased; ids map to slots
+// through a hash index, and a doubly linked list threaded through the
+// slots keeps them most recently active first. Lookup, insert, erase and
+// moving to the front are all O(1).
+//
+// Not internally locked. share() hands out a reference that keeps a
+// conversation alive after it is erased, so a caller can look one up under
+// its own lock and go on using it once that lock is released.
+class ConversationStore {
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Slot {
+        std::shared_ptr<Conversation> conversation;     // null while free
+        uint32_t generation = 0;
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::unordered_map<std::string, uint32_t> index;
+    uint32_t head;
+    uint32_t tail;
+
+    uint32_t allocate(Conversation&& conv);
+    void link_front(uint32_t slot);
+    void link_back(uint32_t slot);
+    void unlink(uint32_t slot);
+
+public:
+    template <typename Value>
+    class Iterator {
+    private:
+        using SlotVector = typename std::conditional<std::is_const<Value>::value,
+                                                     const std::vector<Slot>, std::vector<Slot>>::type;
+        SlotVector* slots;
+        uint32_t slot;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Conversation;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        Iterator(SlotVector* slots, uint32_t slot) : slots(slots), slot(slot) {}
+
+        reference operator*() const { return *(*slots)[slot].conversation; }
+        pointer operator->() const { return (*slots)[slot].conversation.get(); }
+        Iterator& operator++() {
+            slot = (*slots)[slot].next;
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const Iterator& other) const { return slot == other.slot; }
+        bool operator!=(const Iterator& other) const { return slot != other.slot; }
+    };
+
+    using iterator = Iterator<Conversation>;
+    using const_iterator = Iterator<const Conversation>;
+
+    ConversationStore();
+    ConversationStore(const ConversationStore&) = delete;
+    ConversationStore& operator=(const ConversationStore&) = delete;
+
+    // Both return the stored conversation, or nullptr if the id is taken.
+    Conversation* push_front(Conversation&& conv);
+    Conversation* push_back(Conversation&& conv);
+
+    Conversation* find(const std::string& id);
+    const Conversation* find(const std::string& id) const;
+    ConversationHandle handle(const std::string& id) const;
+    Conversation* get(ConversationHandle handle);
+    const Conversation* get(ConversationHandle handle) const;
+    std::shared_ptr<Conversation> share(const std::string& id) const;
+    std::shared_ptr<Conversation> share(ConversationHandle handle) const;
+
+    bool erase(const std::string& id);
+    void move_to_front(const std::string& id);
+    void clear();
+
+    Conversation* front();
+    size_t size() const { return index.size(); }
+    bool empty() const { return index.empty(); }
+
+    // Most recently active first
+    iterator begin() { return iterator(&slots, head); }
+    iterator end() { return iterator(&slots, NONE); }
+    const_iterator begin() const { return const_iterator(&slots, head); }
+    const_iterator end() const { return const_iterator(&slots, NONE); }
+};
+
+#endif // CONVERSATION_STORE_H
@@ -0,0 +1,692 @@
+#include "http_server.h"
+#include "platform.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <thread>
+#include <unordered_map>
+
+#ifdef PLATFORM_LINUX
+    #include <arpa/inet.h>
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t MAX_HEADER_BYTES = 16 * 1024;
+static const size_t READ_CHUNK = 16 * 1024;
+// Buffers that grew past this are released once drained, so a connection
+// that once carried a large request goes back to costing next to nothing.
+static const size_t KEEP_BUFFER_BYTES = 64 * 1024;
+
+const char* http_status_text(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+const std::string* ServerRequest::header(const std::string& name) const {
+    for (const auto& entry : headers) {
+        if (entry.first == name) return &entry.second;
+    }
+    return nullptr;
+}
+
+static std::string response_head(int status, const std::string& content_type, bool keep_alive) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + http_status_text(status) + "\r\n";
+    if (!content_type.empty()) head += "Content-Type: " + content_type + "\r\n";
+    head += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    return head;
+}
+
+// Output travelling from a handler to the loop thread
+struct ServerOutput {
+    uint64_t connection;
+    std::string data;
+    bool last;      // the response is complete
+    bool close;     // close the connection once it is written
+};
+
+class ServerCore : public std::enable_shared_from_this<ServerCore> {
+public:
+    ServerOptions options;
+    RequestHandler handler;
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> open{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint16_t> bound_port{0};
+
+    bool start(const ServerOptions& server_options, RequestHandler request_handler, std::string& error);
+    void shutdown();
+
+    // Queues output for the loop; dropped once the server has stopped.
+    void post(ServerOutput item);
+
+private:
+    // Worker pool
+    std::mutex work_mutex;
+    std::condition_variable work_ready;
+    std::deque<std::shared_ptr<ServerExchange>> work;
+    std::vector<std::thread> workers;
+    bool workers_stopping = false;
+
+    // Output waiting for the loop
+    std::mutex output_mutex;
+    std::vector<ServerOutput> output;
+    bool running = false;
+
+    void dispatch(std::shared_ptr<ServerExchange> exchange);
+    void run_worker();
+
+#ifdef PLATFORM_LINUX
+    // epoll tags for the two descriptors that are not connections
+    static const uint64_t LISTEN_TAG = 0;
+    static const uint64_t WAKE_TAG = 1;
+
+    struct Connection {
+        int fd = -1;
+        uint64_t id = 0;
+        std::string in;
+        std::string out;
+        size_t sent = 0;
+        uint32_t events = 0;            // as registered with epoll
+        bool busy = false;              // a request is with a handler
+        bool continue_sent = false;
+        bool close_after = false;
+        bool peer_closed = false;       // the client shut down its side
+        Clock::time_point last_active;
+    };
+
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int spare_fd = -1;                  // given up to shed connections when out of descriptors
+    std::atomic<bool> loop_stopping{false};
+    std::thread loop;
+
+    // Loop thread only
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    uint64_t next_id = 2;
+
+    bool open_sockets(std::string& error);
+    void close_sockets();
+    void signal_loop();
+    void run_loop();
+    void accept_connections();
+    bool read_from(Connection& conn);
+    bool serve_next(Connection& conn);
+    bool parse_request(Connection& conn);
+    bool reject(Connection& conn, int status, const std::string& message);
+    bool flush(Connection& conn);
+    void update_interest(Connection& conn);
+    void drain_output();
+    void close_idle(Clock::time_point now);
+    void close_connection(uint64_t id);
+#endif
+};
+
+ServerExchange::ServerExchange(std::shared_ptr<ServerCore> core, uint64_t connection, bool keep_alive,
+                               ServerRequest request)
+    : core(std::move(core)), connection(connection), keep_alive(keep_alive), req(std::move(request)),
+      started(false), done(false) {}
+
+void ServerExchange::respond(int status, const std::string& content_type, const std::string& body) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started || done) return;
+    done = true;
+    std::string data = response_head(status, content_type, keep_alive);
+    data += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    data += body;
+    core->post(ServerOutput{connection, std::move(data), true, !keep_alive});
+}
+
+void ServerExchange::start_stream(int status, const std::string& content_type) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started || done) return;
+    started = true;
+    std::string data = response_head(status, content_type, keep_alive);
+    data += "Cache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n\r\n";
+    core->post(ServerOutput{connection, std::move(data), false, false});
+}
+
+void ServerExchange::write(const std::string& data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!started || done || data.empty()) return;
+    char size[24];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    std::string chunk = size;
+    chunk.reserve(chunk.size() + data.size() + 2);
+    chunk += data;
+    chunk += "\r\n";
+    core->post(ServerOutput{connection, std::move(chunk), false, false});
+}
+
+void ServerExchange::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!started || done) return;
+    done = true;
+    core->post(ServerOutput{connection, "0\r\n\r\n", true, !keep_alive});
+}
+
+void ServerCore::post(ServerOutput item) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    if (!running) return;
+    bool was_empty = output.empty();
+    output.push_back(std::move(item));
+#ifdef PLATFORM_LINUX
+    if (was_empty) signal_loop();
+#else
+    (void)was_empty;
+#endif
+}
+
+void ServerCore::dispatch(std::shared_ptr<ServerExchange> exchange) {
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        work.push_back(std::move(exchange));
+    }
+    work_ready.notify_one();
+}
+
+void ServerCore::run_worker() {
+    while (true) {
+        std::shared_ptr<ServerExchange> exchange;
+        {
+            std::unique_lock<std::mutex> lock(work_mutex);
+            work_ready.wait(lock, [this] { return workers_stopping || !work.empty(); });
+            if (workers_stopping) return;
+            exchange = std::move(work.front());
+            work.pop_front();
+        }
+        try {
+            handler(exchange);
+        } catch (const std::exception& e) {
+            exchange->respond(500, "text/plain", std::string(e.what()) + "\n");
+        }
+    }
+}
+
+bool ServerCore::start(const ServerOptions& server_options, RequestHandler request_handler, std::string& error) {
+#ifdef PLATFORM_LINUX
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (running) {
+            error = "Server is already running";
+            return false;
+        }
+    }
+    options = server_options;
+    handler = std::move(request_handler);
+    if (!open_sockets(error)) {
+        close_sockets();
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        running = true;
+    }
+    loop_stopping = false;
+    workers_stopping = false;
+
+    unsigned count = options.workers;
+    if (count == 0) count = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < count; i++) {
+        workers.emplace_back(&ServerCore::run_worker, this);
+    }
+    loop = std::thread(&ServerCore::run_loop, this);
+    return true;
+#else
+    (void)server_options;
+    (void)request_handler;
+    error = "Server mode needs epoll and is only available on Linux";
+    return false;
+#endif
+}
+
+void ServerCore::shutdown() {
+#ifdef PLATFORM_LINUX
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (!running) return;
+        running = false;
+        output.clear();
+        loop_stopping = true;
+        signal_loop();
+    }
+    loop.join();
+    for (auto& entry : connections) {
+        close(entry.second->fd);
+    }
+    open -= connections.size();
+    connections.clear();
+    close_sockets();
+
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        workers_stopping = true;
+        work.clear();
+    }
+    work_ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+#endif
+}
+
+#ifdef PLATFORM_LINUX
+
+bool ServerCore::open_sockets(std::string& error) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.bind_address.c_str(), &address.sin_addr) != 1) {
+        error = "Invalid IPv4 bind address: " + options.bind_address;
+        return false;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        error = "Cannot listen on " + options.bind_address + ":" + std::to_string(options.port) +
+                ": " + strerror(errno);
+        return false;
+    }
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &length);
+    bound_port = ntohs(address.sin_port);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        error = std::string("Cannot set up epoll: ") + strerror(errno);
+        return false;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.u64 = WAKE_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+    spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return true;
+}
+
+void ServerCore::close_sockets() {
+    for (int* fd : {&listen_fd, &epoll_fd, &wake_fd, &spare_fd}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+}
+
+void ServerCore::signal_loop() {
+    uint64_t one = 1;
+    ssize_t written = ::write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void ServerCore::run_loop() {
+    std::vector<epoll_event> events(256);
+    Clock::time_point last_sweep = Clock::now();
+    while (!loop_stopping) {
+        int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 1000);
+        if (ready < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < ready; i++) {
+            uint64_t id = events[i].data.u64;
+            uint32_t flags = events[i].events;
+            if (id == LISTEN_TAG) {
+                accept_connections();
+                continue;
+            }
+            if (id == WAKE_TAG) {
+                uint64_t count;
+                ssize_t drained = ::read(wake_fd, &count, sizeof(count));
+                (void)drained;
+                drain_output();
+                continue;
+            }
+
+            auto it = connections.find(id);
+            if (it == connections.end()) continue;
+            Connection& conn = *it->second;
+            // A hangup leaves nothing that could carry a response
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                close_connection(id);
+                continue;
+            }
+            if ((flags & EPOLLOUT) && !flush(conn)) continue;
+            if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !read_from(conn)) continue;
+            update_interest(conn);
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now - last_sweep >= std::chrono::seconds(1)) {
+            close_idle(now);
+            last_sweep = now;
+        }
+    }
+}
+
+void ServerCore::accept_connections() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EMFILE || errno == ENFILE) && spare_fd >= 0) {
+                // Out of descriptors: take the connection with the spare one
+                // just to close it, so it is refused instead of spinning the loop
+                close(spare_fd);
+                int shed = accept(listen_fd, nullptr, nullptr);
+                if (shed >= 0) close(shed);
+                spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = fd;
+        conn->id = next_id++;
+        conn->events = EPOLLIN | EPOLLRDHUP;
+        conn->last_active = Clock::now();
+
+        epoll_event event = {};
+        event.events = conn->events;
+        event.data.u64 = conn->id;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        accepted++;
+        open++;
+        connections.emplace(conn->id, std::move(conn));
+    }
+}
+
+// Reads whatever has arrived and parses a request out of it if none is
+// being handled. False if the connection was closed.
+bool ServerCore::read_from(Connection& conn) {
+    size_t limit = MAX_HEADER_BYTES + options.max_body_bytes;
+    char buffer[READ_CHUNK];
+    while (conn.in.size() < limit) {
+        ssize_t received = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            if (!conn.close_after) conn.in.append(buffer, static_cast<size_t>(received));
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (received == 0) {
+            // Half-closed: requests already read still get their responses
+            conn.peer_closed = true;
+            break;
+        }
+        close_connection(conn.id);
+        return false;
+    }
+    conn.last_active = Clock::now();
+    return serve_next(conn);
+}
+
+// Parses the next request, or once the client has shut down its side and
+// nothing is left to handle, closes after the pending output is written.
+// False if the connection was closed.
+bool ServerCore::serve_next(Connection& conn) {
+    if (!parse_request(conn)) return false;
+    if (conn.peer_closed && !conn.busy && !conn.close_after) {
+        conn.close_after = true;
+        return flush(conn);
+    }
+    return true;
+}
+
+static std::string lower(std::string text) {
+    for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+static std::string trim(const std::string& text, size_t begin, size_t end) {
+    while (begin < end && (text[begin] == ' ' || text[begin] == '\t')) begin++;
+    while (end > begin && (text[end - 1] == ' ' || text[end - 1] == '\t')) end--;
+    return text.substr(begin, end - begin);
+}
+
+// Hands the next complete request in conn.in to a worker, unless one is
+// already being handled. False if the connection was closed.
+bool ServerCore::parse_request(Connection& conn) {
+    if (conn.busy || conn.close_after) return true;
+    size_t head_end = conn.in.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        if (conn.in.size() > MAX_HEADER_BYTES) return reject(conn, 431, "Request header too large");
+        return true;
+    }
+
+    ServerRequest request;
+    std::string version;
+    size_t line_end = conn.in.find("\r\n");
+    size_t method_end = conn.in.find(' ');
+    size_t target_end = method_end < line_end ? conn.in.find(' ', method_end + 1) : std::string::npos;
+    if (target_end == std::string::npos || target_end > line_end) {
+        return reject(conn, 400, "Malformed request line");
+    }
+    request.method = conn.in.substr(0, method_end);
+    std::string target = conn.in.substr(method_end + 1, target_end - method_end - 1);
+    version = conn.in.substr(target_end + 1, line_end - target_end - 1);
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) request.query = target.substr(question + 1);
+
+    uint64_t content_length = 0;
+    bool expect_continue = false;
+    std::string connection_header;
+    for (size_t pos = line_end + 2; pos < head_end;) {
+        size_t end = conn.in.find("\r\n", pos);
+        size_t colon = conn.in.find(':', pos);
+        if (colon == std::string::npos || colon > end) return reject(conn, 400, "Malformed header");
+        std::string name = lower(conn.in.substr(pos, colon - pos));
+        std::string value = trim(conn.in, colon + 1, end);
+        if (name == "content-length") {
+            char* parsed_end = nullptr;
+            content_length = std::strtoull(value.c_str(), &parsed_end, 10);
+            if (value.empty() || *parsed_end != '\0') return reject(conn, 400, "Bad Content-Length");
+        } else if (name == "transfer-encoding") {
+            return reject(conn, 501, "Chunked request bodies are not supported");
+        } else if (name == "expect") {
+            expect_continue = lower(value) == "100-continue";
+        } else if (name == "connection") {
+            connection_header = lower(value);
+        }
+        request.headers.emplace_back(std::move(name), std::move(value));
+        pos = end + 2;
+    }
+    if (content_length > options.max_body_bytes) return reject(conn, 413, "Request body too large");
+
+    size_t total = head_end + 4 + static_cast<size_t>(content_length);
+    if (conn.in.size() < total) {
+        if (expect_continue && !conn.continue_sent) {
+            conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+            conn.continue_sent = true;
+            return flush(conn);
+        }
+        return true;
+    }
+    request.body = conn.in.substr(head_end + 4, static_cast<size_t>(content_length));
+    conn.in.erase(0, total);
+    if (conn.in.capacity() > KEEP_BUFFER_BYTES) conn.in.shrink_to_fit();
+    conn.continue_sent = false;
+    conn.busy = true;
+
+    bool keep_alive = version == "HTTP/1.1" ? connection_header != "close"
+                                            : connection_header == "keep-alive";
+    requests++;
+    dispatch(std::make_shared<ServerExchange>(shared_from_this(), conn.id, keep_alive, std::move(request)));
+    return true;
+}
+
+// Answers a request that never reaches a handler, then closes
+bool ServerCore::reject(Connection& conn, int status, const std::string& message) {
+    std::string body = message + "\n";
+    conn.out += response_head(status, "text/plain", false);
+    conn.out += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    conn.close_after = true;
+    conn.in.clear();
+    return flush(conn);
+}
+
+// Writes as much pending output as the socket takes. False if the
+// connection was closed.
+bool ServerCore::flush(Connection& conn) {
+    while (conn.sent < conn.out.size()) {
+        ssize_t written = send(conn.fd, conn.out.data() + conn.sent, conn.out.size() - conn.sent, MSG_NOSIGNAL);
+        if (written > 0) {
+            conn.sent += static_cast<size_t>(written);
+            continue;
+        }
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close_connection(conn.id);
+        return false;
+    }
+    if (conn.sent == conn.out.size()) {
+        conn.out.clear();
+        conn.sent = 0;
+        if (conn.out.capacity() > KEEP_BUFFER_BYTES) conn.out.shrink_to_fit();
+        if (conn.close_after && !conn.busy) {
+            close_connection(conn.id);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stops reading while a handled request has a full buffer queued behind
+// it or once the client has shut down its side, and waits for
+// writability only while output is pending.
+void ServerCore::update_interest(Connection& conn) {
+    uint32_t events = 0;
+    if (!conn.peer_closed) {
+        events |= EPOLLRDHUP;
+        if (!conn.busy || conn.in.size() < MAX_HEADER_BYTES + options.max_body_bytes) events |= EPOLLIN;
+    }
+    if (conn.sent < conn.out.size()) events |= EPOLLOUT;
+    if (events == conn.events) return;
+    epoll_event event = {};
+    event.events = events;
+    event.data.u64 = conn.id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event) == 0) conn.events = events;
+}
+
+void ServerCore::drain_output() {
+    std::vector<ServerOutput> items;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        items.swap(output);
+    }
+    std::vector<uint64_t> touched;
+    Clock::time_point now = Clock::now();
+    for (ServerOutput& item : items) {
+        auto it = connections.find(item.connection);
+        if (it == connections.end()) continue;     // the client went away
+        Connection& conn = *it->second;
+        conn.out += item.data;
+        if (item.last) {
+            conn.busy = false;
+            conn.last_active = now;
+            if (item.close) conn.close_after = true;
+        }
+        touched.push_back(item.connection);
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    for (uint64_t id : touched) {
+        Connection& conn = *connections.find(id)->second;
+        // A pipelined request may already be waiting behind the response
+        if (!flush(conn) || !serve_next(conn)) continue;
+        update_interest(conn);
+    }
+}
+
+void ServerCore::close_idle(Clock::time_point now) {
+    if (options.idle_timeout_seconds == 0) return;
+    auto timeout = std::chrono::seconds(options.idle_timeout_seconds);
+    std::vector<uint64_t> idle;
+    for (const auto& entry : connections) {
+        const Connection& conn = *entry.second;
+        if (!conn.busy && conn.out.empty() && now - conn.last_active > timeout) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (uint64_t id : idle) {
+        close_connection(id);
+    }
+}
+
+void ServerCore::close_connection(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    close(it->second->fd);   // also drops it from the epoll set
+    connections.erase(it);
+    open--;
+}
+
+#endif // PLATFORM_LINUX
+
+HttpServer::HttpServer() : core(std::make_shared<ServerCore>()) {}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+bool HttpServer::start(const ServerOptions& options, RequestHandler handler, std::string& error) {
+    return core->start(options, std::move(handler), error);
+}
+
+void HttpServer::stop() {
+    core->shutdown();
+}
+
+uint16_t HttpServer::port() const {
+    return core->bound_port;
+}
+
+ServerStats HttpServer::stats() const {
+    ServerStats stats;
+    stats.connections_accepted = core->accepted;
+    stats.connections_open = core->open;
+    stats.requests = core->requests;
+    return stats;
+}
@@ -0,0 +1,107 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ServerRequest {
+    std::string method;
+    std::string path;           // as sent, without the query
+    std::string query;          // after '?', still percent-encoded
+    std::vector<std::pair<std::string, std::string>> headers;  // names in lower case
+    std::string body;
+
+    // Value of the named (lower case) header, or nullptr
+    const std::string* header(const std::string& name) const;
+};
+
+struct ServerStats {
+    uint64_t connections_accepted = 0;
+    uint64_t connections_open = 0;
+    uint64_t requests = 0;
+};
+
+struct ServerOptions {
+    std::string bind_address = "127.0.0.1";
+    uint16_t port = 8080;                   // 0 picks a free port
+    unsigned workers = 0;                   // 0 = one per hardware thread
+    size_t max_body_bytes = 1024 * 1024;
+    unsigned idle_timeout_seconds = 300;    // 0 = never close idle connections
+};
+
+class ServerCore;
+
+// The reply side of one request. Handlers may keep it and answer later from
+// any thread, e.g. from a reply callback. Exactly one of respond() or
+// start_stream() ... finish() should be used; once the client has gone,
+// whatever is written is dropped.
+class ServerExchange {
+private:
+    std::shared_ptr<ServerCore> core;
+    uint64_t connection;
+    bool keep_alive;
+    ServerRequest req;
+
+    std::mutex mutex;
+    bool started;
+    bool done;
+
+public:
+    ServerExchange(std::shared_ptr<ServerCore> core, uint64_t connection, bool keep_alive,
+                   ServerRequest request);
+
+    const ServerRequest& request() const { return req; }
+
+    void respond(int status, const std::string& content_type, const std::string& body);
+
+    // Chunked response for server-sent events and other long-lived output;
+    // each write() goes out as one chunk straight away.
+    void start_stream(int status, const std::string& content_type);
+    void write(const std::string& data);
+    void finish();
+};
+
+using RequestHandler = std::function<void(std::shared_ptr<ServerExchange>)>;
+
+// HTTP/1.1 server on a single epoll loop. The loop thread accepts, reads
+// and parses requests and writes responses; handlers run on a pool of
+// worker threads and hand their output back to the loop, so a slow handler
+// or a response waiting on the network never holds up other connections.
+// An idle keep-alive connection costs a file descriptor and a few dozen
+// bytes, so thousands of them are cheap. Requests on one connection are
+// answered in order, one at a time.
+//
+// Linux only; start() fails elsewhere.
+class HttpServer {
+private:
+    std::shared_ptr<ServerCore> core;
+
+public:
+    HttpServer();
+    ~HttpServer();
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Binds, then starts the loop and worker threads. On failure returns
+    // false and describes why in error.
+    bool start(const ServerOptions& options, RequestHandler handler, std::string& error);
+
+    // Closes every connection and joins the threads. Exchanges still held
+    // by handlers stay valid; their output goes nowhere.
+    void stop();
+
+    // The port actually bound, once started
+    uint16_t port() const;
+    ServerStats stats() const;
+};
+
+// Reason phrase for a status code, e.g. "Not Found"
+const char* http_status_text(int status);
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,305 @@
+#include "http_transport.h"
+#include "platform.h"
+#include <algorithm>
+#include <cctype>
+#include <future>
+
+#ifdef PLATFORM_WINDOWS
+    #pragma comment(lib, "ws2_32.lib")
+#endif
+
+#include <curl/curl.h>
+
+// Idle connections are kept this long before curl closes them
+static const long MAX_CONNECTION_AGE_SECONDS = 300;
+static const size_t MAX_IDLE_HANDLES = 16;
+
+struct HttpTransport::Transfer {
+    HttpRequest request;
+    HttpResponse response;
+    Completion done;
+    bool head_only = false;
+    CURL* handle = nullptr;
+    curl_slist* headers = nullptr;
+};
+
+static size_t write_callback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    size_t total_size = size * nmemb;
+    userp->append(static_cast<char*>(contents), total_size);
+    return total_size;
+}
+
+static size_t stream_callback(void* contents, size_t size, size_t nmemb, HttpRequest* request) {
+    size_t total_size = size * nmemb;
+    if (!request->on_data(static_cast<const char*>(contents), total_size)) return 0;
+    return total_size;
+}
+
+// One header line at a time; a status line starts a new response (after a
+// redirect or a 100 Continue), whose headers replace the ones before.
+static size_t header_callback(char* data, size_t size, size_t nmemb, HttpResponse* response) {
+    size_t total_size = size * nmemb;
+    std::string line(data, total_size);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        response->headers.clear();
+        return total_size;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return total_size;
+
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    size_t end = line.find_last_not_of(" \t\r\n");
+    std::string value = (begin == std::string::npos || end < begin) ? "" : line.substr(begin, end - begin + 1);
+    response->headers.emplace_back(std::move(name), std::move(value));
+    return total_size;
+}
+
+const std::string* HttpResponse::header(const std::string& name) const {
+    for (const auto& entry : headers) {
+        if (entry.first == name) return &entry.second;
+    }
+    return nullptr;
+}
+
+static void global_init_once() {
+    static std::once_flag once;
+    std::call_once(once, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
+HttpTransport::HttpTransport()
+    : multi(nullptr), stopping(false), request_count(0), reused_count(0), opened_count(0) {
+    global_init_once();
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    loop = std::thread(&HttpTransport::run, this);
+}
+
+HttpTransport::~HttpTransport() {
+    shutdown();
+
+    for (void* handle : idle_handles) {
+        curl_easy_cleanup(static_cast<CURL*>(handle));
+    }
+    curl_multi_cleanup(multi);
+}
+
+void HttpTransport::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    curl_multi_wakeup(multi);
+    if (loop.joinable()) loop.join();
+}
+
+HttpResponse HttpTransport::post(const HttpRequest& request) {
+    std::promise<HttpResponse> promise;
+    std::future<HttpResponse> result = promise.get_future();
+    post_async(request, [&promise](HttpResponse&& response) {
+        promise.set_value(std::move(response));
+    });
+    return result.get();
+}
+
+void HttpTransport::post_async(const HttpRequest& request, Completion done) {
+    Transfer* transfer = new Transfer();
+    transfer->request = request;
+    transfer->done = std::move(done);
+    submit(transfer);
+}
+
+void HttpTransport::prewarm(const std::string& url) {
+    Transfer* transfer = new Transfer();
+    transfer->request.url = url;
+    transfer->head_only = true;
+    submit(transfer);
+}
+
+void HttpTransport::submit(Transfer* transfer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            submitted.push_back(transfer);
+            transfer = nullptr;
+        }
+    }
+    if (transfer) {
+        transfer->response.error = "Transport is shutting down";
+        if (transfer->done) transfer->done(std::move(transfer->response));
+        delete transfer;
+        return;
+    }
+    curl_multi_wakeup(multi);
+}
+
+TransportStats HttpTransport::stats() const {
+    TransportStats s;
+    s.requests = request_count.load();
+    s.connections_reused = reused_count.load();
+    s.connections_opened = opened_count.load();
+    return s;
+}
+
+// Runs on the event loop thread
+void HttpTransport::start_transfer(Transfer* transfer) {
+    CURL* curl;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle_handles.empty()) {
+            curl = nullptr;
+        } else {
+            curl = static_cast<CURL*>(idle_handles.back());
+            idle_handles.pop_back();
+        }
+    }
+    if (!curl) {
+        curl = curl_easy_init();
+    } else {
+        curl_easy_reset(curl);
+    }
+    if (!curl) {
+        transfer->response.error = "Failed to initialize curl";
+        if (transfer->done) transfer->done(std::move(transfer->response));
+        delete transfer;
+        return;
+    }
+    transfer->handle = curl;
+
+    for (const auto& header : transfer->request.headers) {
+        transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, transfer->request.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 15L);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, MAX_CONNECTION_AGE_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->response);
+
+    if (transfer->head_only) {
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->request.body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                         static_cast<curl_off_t>(transfer->request.body.size()));
+        if (transfer->request.on_data) {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_callback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->request);
+        } else {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response.body);
+        }
+    }
+
+    in_flight.push_back(transfer);
+    curl_multi_add_handle(multi, curl);
+}
+
+// Runs on the event loop thread
+static uint64_t info_offset(CURL* curl, CURLINFO info) {
+    curl_off_t value = 0;
+    if (curl_easy_getinfo(curl, info, &value) != CURLE_OK || value < 0) return 0;
+    return static_cast<uint64_t>(value);
+}
+
+static uint64_t info_long(CURL* curl, CURLINFO info) {
+    long value = 0;
+    if (curl_easy_getinfo(curl, info, &value) != CURLE_OK || value < 0) return 0;
+    return static_cast<uint64_t>(value);
+}
+
+void HttpTransport::finish_transfer(void* handle, int result) {
+    CURL* curl = static_cast<CURL*>(handle);
+    Transfer* transfer = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, reinterpret_cast<char**>(&transfer));
+    curl_multi_remove_handle(multi, curl);
+    in_flight.erase(std::find(in_flight.begin(), in_flight.end(), transfer));
+
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &transfer->response.status);
+    transfer->response.connection_reused = (result == CURLE_OK && connects == 0);
+
+    HttpTiming& timing = transfer->response.timing;
+    timing.namelookup_us = info_offset(curl, CURLINFO_NAMELOOKUP_TIME_T);
+    timing.connect_us = info_offset(curl, CURLINFO_CONNECT_TIME_T);
+    timing.appconnect_us = info_offset(curl, CURLINFO_APPCONNECT_TIME_T);
+    timing.starttransfer_us = info_offset(curl, CURLINFO_STARTTRANSFER_TIME_T);
+    timing.total_us = info_offset(curl, CURLINFO_TOTAL_TIME_T);
+    timing.bytes_sent = info_long(curl, CURLINFO_REQUEST_SIZE) + info_offset(curl, CURLINFO_SIZE_UPLOAD_T);
+    timing.bytes_received = info_long(curl, CURLINFO_HEADER_SIZE) + info_offset(curl, CURLINFO_SIZE_DOWNLOAD_T);
+
+    if (!transfer->head_only) {
+        request_count++;
+        if (transfer->response.connection_reused) reused_count++;
+    }
+    opened_count += static_cast<uint64_t>(connects);
+
+    if (result != CURLE_OK) {
+        transfer->response.error = curl_easy_strerror(static_cast<CURLcode>(result));
+    }
+
+    curl_slist_free_all(transfer->headers);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle_handles.size() < MAX_IDLE_HANDLES) {
+            idle_handles.push_back(curl);
+            curl = nullptr;
+        }
+    }
+    if (curl) curl_easy_cleanup(curl);
+
+    if (transfer->done) transfer->done(std::move(transfer->response));
+    delete transfer;
+}
+
+void HttpTransport::run() {
+    std::deque<Transfer*> starting;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) break;
+            starting.swap(submitted);
+        }
+        while (!starting.empty()) {
+            start_transfer(starting.front());
+            starting.pop_front();
+        }
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg* msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg == CURLMSG_DONE) {
+                finish_transfer(msg->easy_handle, msg->data.result);
+            }
+        }
+
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    // Fail whatever is still queued or in flight
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        starting.swap(submitted);
+    }
+    for (Transfer* transfer : starting) {
+        transfer->response.error = "Transport is shutting down";
+        if (transfer->done) transfer->done(std::move(transfer->response));
+        delete transfer;
+    }
+    while (!in_flight.empty()) {
+        finish_transfer(in_flight.back()->handle, CURLE_ABORTED_BY_CALLBACK);
+    }
+}
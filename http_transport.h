@@ -0,0 +1,108 @@
+#ifndef HTTP_TRANSPORT_H
+#define HTTP_TRANSPORT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct HttpRequest {
+    std::string url;
+    std::vector<std::string> headers;
+    std::string body;
+
+    // When set, response bytes are handed to this callback (on the event
+    // loop thread) as they arrive instead of being collected in the
+    // response body. Returning false aborts the transfer.
+    std::function<bool(const char* data, size_t size)> on_data;
+};
+
+// Phase timings as curl reports them, in microseconds from the start of the
+// transfer; each one includes the phases before it.
+struct HttpTiming {
+    uint64_t namelookup_us = 0;
+    uint64_t connect_us = 0;
+    uint64_t appconnect_us = 0;     // TLS handshake done, 0 without TLS
+    uint64_t starttransfer_us = 0;  // first response byte
+    uint64_t total_us = 0;
+    uint64_t bytes_sent = 0;        // request headers and body
+    uint64_t bytes_received = 0;    // response headers and body
+};
+
+struct HttpResponse {
+    long status = 0;
+    std::vector<std::pair<std::string, std::string>> headers;  // final response's, names in lower case
+    std::string body;
+    std::string error;              // transport-level failure, empty on success
+    bool connection_reused = false;
+    HttpTiming timing;
+
+    // Value of the named (lower case) header, or nullptr
+    const std::string* header(const std::string& name) const;
+};
+
+struct TransportStats {
+    uint64_t requests = 0;
+    uint64_t connections_reused = 0;
+    uint64_t connections_opened = 0;
+};
+
+// Long-lived HTTP client. All transfers run on one curl multi handle driven
+// by a background event loop, so connections (and TLS sessions) stay in its
+// cache between requests and concurrent requests to the same host are
+// multiplexed over a single HTTP/2 connection. Easy handles are pooled.
+class HttpTransport {
+public:
+    using Completion = std::function<void(HttpResponse&&)>;
+
+private:
+    struct Transfer;
+
+    void* multi;
+    std::thread loop;
+    std::mutex mutex;
+    std::deque<Transfer*> submitted;
+    std::vector<void*> idle_handles;
+    std::vector<Transfer*> in_flight;   // event loop thread only
+    bool stopping;
+
+    std::atomic<uint64_t> request_count;
+    std::atomic<uint64_t> reused_count;
+    std::atomic<uint64_t> opened_count;
+
+    void run();
+    void start_transfer(Transfer* transfer);
+    void finish_transfer(void* handle, int result);
+    void submit(Transfer* transfer);
+
+public:
+    HttpTransport();
+    ~HttpTransport();
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+    // Blocks until the response arrives.
+    HttpResponse post(const HttpRequest& request);
+
+    // Calls done on the event loop thread when the response arrives.
+    void post_async(const HttpRequest& request, Completion done);
+
+    // Opens a connection to url's host in the background so the first real
+    // request does not pay for DNS, TCP and TLS setup.
+    void prewarm(const std::string& url);
+
+    TransportStats stats() const;
+
+    // Fails whatever is queued or in flight and stops the event loop;
+    // requests made afterwards fail at once. The destructor does the same.
+    // Not to be called from a completion.
+    void shutdown();
+};
+
+#endif // HTTP_TRANSPORT_H
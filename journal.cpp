@@ -0,0 +1,321 @@
+#include "journal.h"
+#include "platform.h"
+
+#include <cstdio>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+    #include <io.h>
+    #include <fcntl.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+static const char JOURNAL_MAGIC[4] = {'C', 'C', 'J', '1'};
+
+static uint32_t checksum(const char* data, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void put_u64(std::string& buf, uint64_t value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put_string(std::string& buf, const std::string& value) {
+    put_u64(buf, value.size());
+    buf.append(value);
+}
+
+static bool get_u64(const std::string& buf, size_t& pos, uint64_t& value) {
+    if (buf.size() - pos < sizeof(value)) return false;
+    buf.copy(reinterpret_cast<char*>(&value), sizeof(value), pos);
+    pos += sizeof(value);
+    return true;
+}
+
+static bool get_string(const std::string& buf, size_t& pos, std::string& value) {
+    uint64_t len;
+    if (!get_u64(buf, pos, len) || buf.size() - pos < len) return false;
+    value.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+static bool get_time(const std::string& buf, size_t& pos, int64_t& value) {
+    uint64_t raw;
+    if (!get_u64(buf, pos, raw)) return false;
+    value = static_cast<int64_t>(raw);
+    return true;
+}
+
+// Text timestamps, as written before records 6-8 existed
+static bool get_legacy_time(const std::string& buf, size_t& pos, int64_t& value) {
+    std::string text;
+    if (!get_string(buf, pos, text)) return false;
+    value = parse_timestamp(text);
+    return true;
+}
+
+enum LegacyRecordType : uint8_t {
+    LEGACY_NEW_CONVERSATION = 1,
+    LEGACY_ADD_MESSAGE = 2,
+    LEGACY_CLEAR_CONVERSATION = 4
+};
+
+static std::string encode(const JournalRecord& record) {
+    std::string payload;
+    payload.push_back(static_cast<char>(record.type));
+    put_string(payload, record.conversation_id);
+
+    switch (record.type) {
+        case JournalRecordType::NewConversation:
+            put_string(payload, record.title);
+            put_u64(payload, static_cast<uint64_t>(record.created_at));
+            put_u64(payload, static_cast<uint64_t>(record.last_modified));
+            break;
+        case JournalRecordType::AddMessage:
+            put_u64(payload, record.message_index);
+            payload.push_back(static_cast<char>(record.message.role));
+            put_u64(payload, static_cast<uint64_t>(record.message.timestamp));
+            put_string(payload, record.message.content);
+            break;
+        case JournalRecordType::ClearConversation:
+            put_u64(payload, static_cast<uint64_t>(record.last_modified));
+            break;
+        case JournalRecordType::SetSummary:
+            put_u64(payload, record.message_index);
+            put_string(payload, record.message.content);
+            break;
+        case JournalRecordType::TruncateConversation:
+            put_u64(payload, record.message_index);
+            break;
+        case JournalRecordType::DeleteConversation:
+            break;
+    }
+    return payload;
+}
+
+static bool decode(const std::string& payload, JournalRecord& record) {
+    if (payload.empty()) return false;
+    size_t pos = 1;
+    record = JournalRecord();
+    record.type = static_cast<JournalRecordType>(payload[0]);
+    if (!get_string(payload, pos, record.conversation_id)) return false;
+
+    switch (static_cast<uint8_t>(payload[0])) {
+        case LEGACY_NEW_CONVERSATION:
+            record.type = JournalRecordType::NewConversation;
+            return get_string(payload, pos, record.title) &&
+                   get_legacy_time(payload, pos, record.created_at) &&
+                   get_legacy_time(payload, pos, record.last_modified);
+        case LEGACY_ADD_MESSAGE: {
+            std::string role;
+            record.type = JournalRecordType::AddMessage;
+            if (!get_u64(payload, pos, record.message_index) ||
+                !get_string(payload, pos, role) ||
+                !get_string(payload, pos, record.message.content) ||
+                !get_legacy_time(payload, pos, record.message.timestamp) ||
+                !parse_role(role, record.message.role)) {
+                return false;
+            }
+            record.last_modified = record.message.timestamp;
+            return true;
+        }
+        case LEGACY_CLEAR_CONVERSATION:
+            record.type = JournalRecordType::ClearConversation;
+            return get_legacy_time(payload, pos, record.last_modified);
+        default:
+            break;
+    }
+
+    switch (record.type) {
+        case JournalRecordType::NewConversation:
+            return get_string(payload, pos, record.title) &&
+                   get_time(payload, pos, record.created_at) &&
+                   get_time(payload, pos, record.last_modified);
+        case JournalRecordType::AddMessage:
+            if (!get_u64(payload, pos, record.message_index) || payload.size() - pos < 1) {
+                return false;
+            }
+            record.message.role = static_cast<Role>(payload[pos++]);
+            if (!get_time(payload, pos, record.message.timestamp) ||
+                !get_string(payload, pos, record.message.content)) {
+                return false;
+            }
+            record.last_modified = record.message.timestamp;
+            return true;
+        case JournalRecordType::ClearConversation:
+            return get_time(payload, pos, record.last_modified);
+        case JournalRecordType::SetSummary:
+            return get_u64(payload, pos, record.message_index) &&
+                   get_string(payload, pos, record.message.content);
+        case JournalRecordType::TruncateConversation:
+            return get_u64(payload, pos, record.message_index);
+        case JournalRecordType::DeleteConversation:
+            return true;
+    }
+    return false;
+}
+
+static bool truncate_file(const std::string& path, uint64_t length) {
+#ifdef PLATFORM_WINDOWS
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _chsize_s(fd, static_cast<__int64>(length)) == 0;
+    _close(fd);
+    return ok;
+#else
+    return truncate(path.c_str(), static_cast<off_t>(length)) == 0;
+#endif
+}
+
+ConversationJournal::ConversationJournal(const std::string& path) : path(path) {}
+
+void ConversationJournal::set_path(const std::string& new_path) {
+    if (out.is_open()) out.close();
+    path = new_path;
+    bytes_written = 0;
+}
+
+bool ConversationJournal::open_for_append() {
+    if (out.is_open()) return true;
+    out.open(path, std::ios::binary | std::ios::app);
+    if (!out.is_open()) return false;
+    if (bytes_written == 0) {
+        out.write(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        bytes_written = sizeof(JOURNAL_MAGIC);
+    }
+    return true;
+}
+
+size_t ConversationJournal::replay(const std::function<void(const JournalRecord&)>& apply) {
+    if (out.is_open()) out.close();
+    bytes_written = 0;
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return 0;
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    char magic[sizeof(JOURNAL_MAGIC)];
+    if (!file.read(magic, sizeof(magic)) ||
+        std::string(magic, sizeof(magic)) != std::string(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC))) {
+        file.close();
+        truncate_file(path, 0);
+        return 0;
+    }
+
+    uint64_t valid_end = sizeof(JOURNAL_MAGIC);
+    size_t applied = 0;
+    std::string payload;
+    JournalRecord record;
+
+    while (true) {
+        uint32_t header[2];
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) break;
+        if (header[0] > file_size - valid_end - sizeof(header)) break;
+        payload.resize(header[0]);
+        if (!file.read(&payload[0], header[0])) break;
+        if (checksum(payload.data(), payload.size()) != header[1]) break;
+        if (!decode(payload, record)) break;
+
+        apply(record);
+        applied++;
+        valid_end += sizeof(header) + header[0];
+    }
+
+    file.close();
+
+    if (file_size != valid_end) {
+        truncate_file(path, valid_end);
+    }
+    bytes_written = valid_end;
+    return applied;
+}
+
+bool ConversationJournal::append(const JournalRecord& record) {
+    return append(std::vector<JournalRecord>(1, record));
+}
+
+bool ConversationJournal::append(const std::vector<JournalRecord>& records) {
+    if (!open_for_append()) return false;
+
+    std::string buffer;
+    for (const JournalRecord& record : records) {
+        std::string payload = encode(record);
+        uint32_t header[2] = {
+            static_cast<uint32_t>(payload.size()),
+            checksum(payload.data(), payload.size())
+        };
+        buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+        buffer.append(payload);
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    out.flush();
+    if (!out) return false;
+
+    bytes_written += buffer.size();
+    return true;
+}
+
+bool ConversationJournal::sync() {
+    if (!out.is_open()) return true;
+    out.flush();
+    return static_cast<bool>(out) && sync_file(path);
+}
+
+bool ConversationJournal::reset() {
+    if (out.is_open()) out.close();
+    bytes_written = 0;
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    out.flush();
+    bytes_written = sizeof(JOURNAL_MAGIC);
+    return static_cast<bool>(out);
+}
+
+bool sync_file(const std::string& path) {
+#ifdef PLATFORM_WINDOWS
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _commit(fd) == 0;
+    _close(fd);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+bool sync_directory(const std::string& path) {
+#ifdef PLATFORM_WINDOWS
+    // NTFS journals renames itself; directories cannot be flushed
+    (void)path;
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+bool replace_file(const std::string& from, const std::string& to) {
+#ifdef PLATFORM_WINDOWS
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
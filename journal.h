@@ -0,0 +1,76 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "conversation.h"
+
+// Append-only log of conversation changes made since the last snapshot.
+// Each record is framed as [payload length][checksum][payload] so a record
+// torn by a crash is detected on replay and discarded.
+//
+// Types 1, 2 and 4 are the older encodings of 6, 7 and 8 with text
+// timestamps; they are still replayed but no longer written.
+enum class JournalRecordType : uint8_t {
+    DeleteConversation = 3,
+    SetSummary = 5,         // message_index = messages covered, message.content = summary
+    NewConversation = 6,
+    AddMessage = 7,
+    ClearConversation = 8,
+    TruncateConversation = 9    // message_index = messages kept
+};
+
+struct JournalRecord {
+    JournalRecordType type = JournalRecordType::AddMessage;
+    std::string conversation_id;
+    std::string title;
+    int64_t created_at = 0;
+    int64_t last_modified = 0;
+    uint64_t message_index = 0;
+    Message message;
+};
+
+class ConversationJournal {
+private:
+    std::string path;
+    std::ofstream out;
+    uint64_t bytes_written = 0;
+
+    bool open_for_append();
+
+public:
+    explicit ConversationJournal(const std::string& path = "");
+
+    void set_path(const std::string& new_path);
+
+    // Calls apply for every intact record in order. A torn tail left by a
+    // crash is truncated away so later appends start on a record boundary.
+    size_t replay(const std::function<void(const JournalRecord&)>& apply);
+
+    bool append(const JournalRecord& record);
+
+    // Writes the records with a single write, as one group commit.
+    bool append(const std::vector<JournalRecord>& records);
+
+    // Forces everything appended so far to stable storage.
+    bool sync();
+
+    // Drops all records; called once their effects are in the snapshot.
+    bool reset();
+
+    uint64_t size() const { return bytes_written; }
+};
+
+// Force a closed file's contents, or a directory's entries (so a rename
+// survives a crash), to stable storage.
+bool sync_file(const std::string& path);
+bool sync_directory(const std::string& path);
+
+// Renames from over to, replacing it atomically.
+bool replace_file(const std::string& from, const std::string& to);
+
+#endif // JOURNAL_H
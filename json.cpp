@@ -0,0 +1,132 @@
+#include "json.h"
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(const char* data, size_t size, size_t& pos, uint32_t& value) {
+    if (size - pos < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(data[pos + i]);
+        if (digit < 0) return false;
+        value = (value << 4) | static_cast<uint32_t>(digit);
+    }
+    pos += 4;
+    return true;
+}
+
+void append_utf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+bool json_decode_string(const char* data, size_t size, size_t& pos, std::string& out) {
+    while (pos < size) {
+        // Copy the run up to the next quote or escape in one go
+        size_t run = pos;
+        while (run < size && data[run] != '"' && data[run] != '\\') run++;
+        out.append(data + pos, run - pos);
+        pos = run;
+        if (pos >= size) return false;
+
+        if (data[pos] == '"') {
+            pos++;
+            return true;
+        }
+
+        pos++;
+        if (pos >= size) return false;
+        char c = data[pos++];
+        switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code_point;
+                if (!read_hex4(data, size, pos, code_point)) return false;
+                if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                    uint32_t low;
+                    size_t save = pos;
+                    if (size - pos >= 2 && data[pos] == '\\' && data[pos + 1] == 'u') {
+                        pos += 2;
+                        if (read_hex4(data, size, pos, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        } else {
+                            pos = save;
+                            code_point = 0xFFFD;
+                        }
+                    } else {
+                        code_point = 0xFFFD;
+                    }
+                } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                    code_point = 0xFFFD;
+                }
+                append_utf8(out, code_point);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+void append_json_escaped(std::string& out, const char* data, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    size_t pos = 0;
+    while (pos < size) {
+        // Copy the run that needs no escaping in one go
+        size_t run = pos;
+        while (run < size && data[run] != '"' && data[run] != '\\' &&
+               static_cast<unsigned char>(data[run]) >= 0x20) {
+            run++;
+        }
+        out.append(data + pos, run - pos);
+        pos = run;
+        if (pos >= size) break;
+
+        char c = data[pos++];
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex[(c >> 4) & 0xF];
+                out += hex[c & 0xF];
+        }
+    }
+}
+
+std::string json_escape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() + text.size() / 8);
+    append_json_escaped(out, text.data(), text.size());
+    return out;
+}
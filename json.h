@@ -0,0 +1,20 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Appends the UTF-8 encoding of a Unicode code point.
+void append_utf8(std::string& out, uint32_t code_point);
+
+// Decodes a JSON string literal body. pos must point just past the opening
+// quote; on success it is left just past the closing quote. Handles every
+// escape JSON defines, including \uXXXX surrogate pairs.
+bool json_decode_string(const char* data, size_t size, size_t& pos, std::string& out);
+
+// Encodes text as the body of a JSON string literal (no surrounding quotes).
+std::string json_escape(const std::string& text);
+void append_json_escaped(std::string& out, const char* data, size_t size);
+
+#endif // JSON_H
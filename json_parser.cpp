@@ -0,0 +1,329 @@
+#include "json_parser.h"
+#include "json.h"
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+JsonStreamParser::JsonStreamParser(Handler& handler)
+    : handler(handler), state(State::Value), string_is_key(false),
+      unicode_value(0), unicode_digits(0), high_surrogate(0) {}
+
+void JsonStreamParser::emit_string(const char* data, size_t size) {
+    if (string_is_key) {
+        key.append(data, size);
+    } else {
+        handler.on_string_data(data, size);
+    }
+}
+
+void JsonStreamParser::flush_surrogate() {
+    // A high surrogate without its low half decodes to U+FFFD
+    high_surrogate = 0;
+    emit_string("\xEF\xBF\xBD", 3);
+}
+
+void JsonStreamParser::emit_code_point(uint32_t code_point) {
+    if (high_surrogate) {
+        if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+            code_point = 0x10000 + ((high_surrogate - 0xD800) << 10) + (code_point - 0xDC00);
+            high_surrogate = 0;
+            std::string encoded;
+            append_utf8(encoded, code_point);
+            emit_string(encoded.data(), encoded.size());
+            return;
+        }
+        flush_surrogate();
+    }
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        high_surrogate = code_point;
+        return;
+    }
+    if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        code_point = 0xFFFD;
+    }
+    std::string encoded;
+    append_utf8(encoded, code_point);
+    emit_string(encoded.data(), encoded.size());
+}
+
+void JsonStreamParser::end_value() {
+    state = stack.empty() ? State::Done : State::AfterValue;
+}
+
+bool JsonStreamParser::end_token() {
+    if (state == State::Number) {
+        handler.on_number(token);
+    } else if (token == "true") {
+        handler.on_bool(true);
+    } else if (token == "false") {
+        handler.on_bool(false);
+    } else if (token == "null") {
+        handler.on_null();
+    } else {
+        state = State::Error;
+        return false;
+    }
+    end_value();
+    return true;
+}
+
+bool JsonStreamParser::feed(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        char c = data[i];
+        switch (state) {
+            case State::String: {
+                if (high_surrogate && c != '\\') flush_surrogate();
+                // Hand over the whole unescaped run at once
+                size_t run = i;
+                while (run < size && data[run] != '"' && data[run] != '\\' &&
+                       static_cast<unsigned char>(data[run]) >= 0x20) {
+                    run++;
+                }
+                if (run > i) {
+                    emit_string(data + i, run - i);
+                    i = run;
+                } else if (c == '"') {
+                    i++;
+                    if (string_is_key) {
+                        handler.on_key(key);
+                        state = State::Colon;
+                    } else {
+                        handler.on_string_end();
+                        end_value();
+                    }
+                } else if (c == '\\') {
+                    i++;
+                    state = State::Escape;
+                } else {
+                    state = State::Error;   // raw control character
+                }
+                break;
+            }
+
+            case State::Escape: {
+                i++;
+                if (c == 'u') {
+                    unicode_value = 0;
+                    unicode_digits = 0;
+                    state = State::Unicode;
+                    break;
+                }
+                if (high_surrogate) flush_surrogate();
+                char decoded;
+                switch (c) {
+                    case '"': decoded = '"'; break;
+                    case '\\': decoded = '\\'; break;
+                    case '/': decoded = '/'; break;
+                    case 'b': decoded = '\b'; break;
+                    case 'f': decoded = '\f'; break;
+                    case 'n': decoded = '\n'; break;
+                    case 'r': decoded = '\r'; break;
+                    case 't': decoded = '\t'; break;
+                    default:
+                        state = State::Error;
+                        continue;
+                }
+                emit_string(&decoded, 1);
+                state = State::String;
+                break;
+            }
+
+            case State::Unicode: {
+                int digit = hex_digit(c);
+                if (digit < 0) {
+                    state = State::Error;
+                    break;
+                }
+                i++;
+                unicode_value = (unicode_value << 4) | static_cast<uint32_t>(digit);
+                if (++unicode_digits == 4) {
+                    state = State::String;
+                    emit_code_point(unicode_value);
+                }
+                break;
+            }
+
+            case State::Value:
+            case State::ArrayValueOrEnd:
+                if (is_space(c)) {
+                    i++;
+                    break;
+                }
+                i++;
+                if (c == ']' && state == State::ArrayValueOrEnd) {
+                    stack.pop_back();
+                    handler.on_end_array();
+                    end_value();
+                } else if (c == '{') {
+                    stack.push_back('{');
+                    handler.on_start_object();
+                    state = State::KeyOrEnd;
+                } else if (c == '[') {
+                    stack.push_back('[');
+                    handler.on_start_array();
+                    state = State::ArrayValueOrEnd;
+                } else if (c == '"') {
+                    string_is_key = false;
+                    handler.on_string_begin();
+                    state = State::String;
+                } else if (c == '-' || is_digit(c)) {
+                    token.assign(1, c);
+                    state = State::Number;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    token.assign(1, c);
+                    state = State::Literal;
+                } else {
+                    state = State::Error;
+                }
+                break;
+
+            case State::KeyOrEnd:
+            case State::Key:
+                if (is_space(c)) {
+                    i++;
+                    break;
+                }
+                i++;
+                if (c == '}' && state == State::KeyOrEnd) {
+                    stack.pop_back();
+                    handler.on_end_object();
+                    end_value();
+                } else if (c == '"') {
+                    string_is_key = true;
+                    key.clear();
+                    state = State::String;
+                } else {
+                    state = State::Error;
+                }
+                break;
+
+            case State::Colon:
+                i++;
+                if (c == ':') {
+                    state = State::Value;
+                } else if (!is_space(c)) {
+                    state = State::Error;
+                }
+                break;
+
+            case State::AfterValue:
+                i++;
+                if (is_space(c)) break;
+                if (c == ',') {
+                    state = stack.back() == '{' ? State::Key : State::Value;
+                } else if (c == '}' && stack.back() == '{') {
+                    stack.pop_back();
+                    handler.on_end_object();
+                    end_value();
+                } else if (c == ']' && stack.back() == '[') {
+                    stack.pop_back();
+                    handler.on_end_array();
+                    end_value();
+                } else {
+                    state = State::Error;
+                }
+                break;
+
+            case State::Number:
+                if (is_digit(c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                    token += c;
+                    i++;
+                } else {
+                    end_token();    // c is looked at again in the new state
+                }
+                break;
+
+            case State::Literal:
+                if (c >= 'a' && c <= 'z') {
+                    token += c;
+                    i++;
+                } else {
+                    end_token();
+                }
+                break;
+
+            case State::Done:
+                i++;
+                if (!is_space(c)) state = State::Error;
+                break;
+
+            case State::Error:
+                return false;
+        }
+    }
+    return state != State::Error;
+}
+
+bool JsonStreamParser::finish() {
+    if (state == State::Number || state == State::Literal) {
+        end_token();
+    }
+    return state == State::Done;
+}
+
+// Collects the members of the root object for parse_json_object
+class ObjectFieldsHandler : public JsonStreamParser::Handler {
+public:
+    std::map<std::string, JsonField>& fields;
+    bool is_object = false;
+    int depth = 0;
+    JsonField* current = nullptr;   // member whose value comes next
+
+    explicit ObjectFieldsHandler(std::map<std::string, JsonField>& fields) : fields(fields) {}
+
+    // Called for every value; only those directly inside the root count
+    JsonField* member(JsonField::Type type) {
+        JsonField* field = depth == 1 ? current : nullptr;
+        if (field) field->type = type;
+        return field;
+    }
+
+    void on_start_object() override {
+        if (depth == 0) is_object = true;
+        else member(JsonField::Type::Object);
+        depth++;
+    }
+    void on_end_object() override { depth--; }
+    void on_start_array() override {
+        member(JsonField::Type::Array);
+        depth++;
+    }
+    void on_end_array() override { depth--; }
+    void on_key(const std::string& key) override {
+        if (depth == 1) {
+            current = &fields[key];
+            *current = JsonField();
+        }
+    }
+    void on_string_begin() override { member(JsonField::Type::String); }
+    void on_string_data(const char* data, size_t size) override {
+        if (depth == 1 && current) current->text.append(data, size);
+    }
+    void on_number(const std::string& text) override {
+        if (JsonField* field = member(JsonField::Type::Number)) field->text = text;
+    }
+    void on_bool(bool value) override {
+        if (JsonField* field = member(JsonField::Type::Bool)) field->flag = value;
+    }
+    void on_null() override { member(JsonField::Type::Null); }
+};
+
+bool parse_json_object(const std::string& text, std::map<std::string, JsonField>& fields) {
+    fields.clear();
+    ObjectFieldsHandler handler(fields);
+    JsonStreamParser parser(handler);
+    return parser.feed(text.data(), text.size()) && parser.finish() && handler.is_object;
+}
@@ -0,0 +1,94 @@
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Push-style (SAX) JSON parser that accepts its input in arbitrary chunks,
+// e.g. straight from a curl write callback, and never buffers the document.
+// String values are handed to the handler in pieces: unescaped runs point
+// directly into the fed buffer, escapes are decoded (including \uXXXX
+// surrogate pairs) into a few bytes of scratch space. Object keys, numbers
+// and literals are short and are delivered whole.
+class JsonStreamParser {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual void on_start_object() {}
+        virtual void on_end_object() {}
+        virtual void on_start_array() {}
+        virtual void on_end_array() {}
+        virtual void on_key(const std::string& key) { (void)key; }
+        virtual void on_string_begin() {}
+        virtual void on_string_data(const char* data, size_t size) { (void)data; (void)size; }
+        virtual void on_string_end() {}
+        virtual void on_number(const std::string& text) { (void)text; }
+        virtual void on_bool(bool value) { (void)value; }
+        virtual void on_null() {}
+    };
+
+private:
+    enum class State : uint8_t {
+        Value,              // expecting any value
+        ArrayValueOrEnd,    // just after '['
+        KeyOrEnd,           // just after '{'
+        Key,                // after ',' in an object
+        Colon,
+        AfterValue,
+        String,
+        Escape,
+        Unicode,
+        Number,
+        Literal,
+        Done,
+        Error
+    };
+
+    Handler& handler;
+    State state;
+    std::vector<char> stack;    // '{' or '[' per open container
+    bool string_is_key;
+    std::string key;
+    std::string token;          // number or literal being read
+    uint32_t unicode_value;
+    int unicode_digits;
+    uint32_t high_surrogate;    // pending \uD800-\uDBFF awaiting its pair
+
+    void emit_string(const char* data, size_t size);
+    void emit_code_point(uint32_t code_point);
+    void flush_surrogate();
+    void end_value();
+    bool end_token();
+
+public:
+    explicit JsonStreamParser(Handler& handler);
+
+    // Returns false once the input is known to be malformed.
+    bool feed(const char* data, size_t size);
+
+    // Call after the last chunk; true if exactly one complete value was read.
+    bool finish();
+
+    bool failed() const { return state == State::Error; }
+};
+
+// A top-level member of an object read by parse_json_object. Nested
+// objects and arrays are skipped, only their type is kept.
+struct JsonField {
+    enum class Type : uint8_t { String, Number, Bool, Null, Object, Array };
+    Type type = Type::Null;
+    std::string text;           // decoded string, or the number as written
+    bool flag = false;          // the boolean
+};
+
+// Parses text as a single JSON object and collects its top-level members
+// by key, a repeated key keeping its last value. False if text is not
+// valid JSON or not an object. For small untrusted documents such as
+// request bodies, where a key must not be picked up from a nested value.
+bool parse_json_object(const std::string& text, std::map<std::string, JsonField>& fields);
+
+#endif // JSON_PARSER_H
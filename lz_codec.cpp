@@ -0,0 +1,182 @@
+#include "lz_codec.h"
+#include <cstring>
+#include <vector>
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const unsigned HASH_BITS = 14;
+// Matches may not start in the last bytes, which keeps the 8-byte compares
+// in extend_match inside the input.
+static const size_t END_LITERALS = 8;
+
+static uint32_t read_u32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(const char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static unsigned trailing_zero_bytes(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x)) / 8;
+#else
+    unsigned n = 0;
+    while ((x & 0xff) == 0) {
+        x >>= 8;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Length of the common run at a and b, with b ahead of a and b < limit
+static size_t extend_match(const char* a, const char* b, const char* limit) {
+    const char* start = b;
+    while (b + 8 <= limit) {
+        uint64_t diff = read_u64(a) ^ read_u64(b);
+        if (diff) return static_cast<size_t>(b - start) + trailing_zero_bytes(diff);
+        a += 8;
+        b += 8;
+    }
+    while (b < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return static_cast<size_t>(b - start);
+}
+
+static void put_length(std::string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+static void put_sequence(std::string& out, const char* literals, size_t literal_count,
+                         size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>((literal_count < 15 ? literal_count : 15) << 4 |
+                                         (match_code < 15 ? match_code : 15));
+    out.push_back(static_cast<char>(token));
+    if (literal_count >= 15) put_length(out, literal_count - 15);
+    out.append(literals, literal_count);
+    if (match_length == 0) return;
+
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+void lz_compress(const char* data, size_t size, std::string& out) {
+    out.reserve(out.size() + lz_compress_bound(size));
+    const char* end = data + size;
+    const char* anchor = data;          // first byte not yet emitted
+
+    if (size > END_LITERALS + MIN_MATCH) {
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        const char* match_limit = end - END_LITERALS;
+        const char* p = data + 1;
+        unsigned misses = 0;
+
+        while (p < match_limit) {
+            uint32_t sequence = read_u32(p);
+            uint32_t& slot = table[hash4(sequence)];
+            const char* candidate = data + slot;
+            slot = static_cast<uint32_t>(p - data);
+
+            if (candidate >= p || static_cast<size_t>(p - candidate) > MAX_OFFSET ||
+                read_u32(candidate) != sequence) {
+                // Step faster through data that does not compress
+                p += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // Grow the match backwards over pending literals
+            while (p > anchor && candidate > data && p[-1] == candidate[-1]) {
+                p--;
+                candidate--;
+            }
+            size_t length = MIN_MATCH + extend_match(candidate + MIN_MATCH, p + MIN_MATCH, match_limit);
+            put_sequence(out, anchor, static_cast<size_t>(p - anchor),
+                         static_cast<size_t>(p - candidate), length);
+            p += length;
+            anchor = p;
+
+            if (p < match_limit) {
+                // Index a position inside the match so the next one is found sooner
+                table[hash4(read_u32(p - 2))] = static_cast<uint32_t>(p - 2 - data);
+            }
+        }
+    }
+
+    put_sequence(out, anchor, static_cast<size_t>(end - anchor), 0, 0);
+}
+
+static bool get_length(const unsigned char*& p, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (p >= end) return false;
+        byte = *p++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_decompress(const char* data, size_t size, char* out, size_t out_size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    char* op = out;
+    char* op_end = out + out_size;
+
+    while (p < end) {
+        uint8_t token = *p++;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !get_length(p, end, literal_count)) return false;
+        if (literal_count > static_cast<size_t>(end - p) ||
+            literal_count > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+        std::memcpy(op, p, literal_count);
+        p += literal_count;
+        op += literal_count;
+
+        if (p == end) break;            // final literal-only sequence
+
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+        p += 2;
+        size_t length = token & 0x0f;
+        if (length == 15 && !get_length(p, end, length)) return false;
+        length += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(op - out) ||
+            length > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+        const char* match = op - offset;
+        if (offset >= length) {
+            std::memcpy(op, match, length);
+            op += length;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < length; i++) *op++ = *match++;
+        }
+    }
+    return op == op_end;
+}
@@ -0,0 +1,34 @@
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Byte-oriented LZ77 block codec in the LZ4 mould: greedy matching through
+// a hash table of 4-byte sequences, a 64 KB window, and no entropy coding,
+// so decompression is little more than memcpy. Meant for message text,
+// which is mostly English and code and compresses 2-4x.
+//
+// A compressed block is a series of sequences:
+//
+//   token     high nibble literal count, low nibble match length - 4
+//             (15 in either means more length bytes follow: 255 each,
+//             ended by one below 255)
+//   literals
+//   offset    u16 little-endian, back from the current output position
+//
+// The last sequence has literals only. The decompressed size is not stored;
+// callers keep it next to the block.
+
+// Worst-case compressed size for size input bytes.
+size_t lz_compress_bound(size_t size);
+
+// Appends the compressed form of [data, data + size) to out.
+void lz_compress(const char* data, size_t size, std::string& out);
+
+// Decompresses exactly out_size bytes into out. Returns false on malformed
+// input (never reads or writes out of bounds).
+bool lz_decompress(const char* data, size_t size, char* out, size_t out_size);
+
+#endif // LZ_CODEC_H
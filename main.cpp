@@ -1,7 +1,18 @@
 #include "chatbot.h"
+#include "batch.h"
+#include "api_server.h"
 #include <iostream>
 #include <string>
 #include <limits>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef PLATFORM_WINDOWS
+    #include <csignal>
+    #include <pthread.h>
+    #include <sys/resource.h>
+#endif
 
 void clear_screen() {
 #ifdef PLATFORM_WINDOWS
@@ -42,14 +53,12 @@ void chat_mode(ClaudeChatbot& bot) {
         }
         
         if (input == "history") {
-            Conversation* conv = bot.get_current_conversation();
-            if (conv) {
-                std::cout << "\n--- Conversation History ---\n";
-                for (const auto& msg : conv->messages) {
-                    std::cout << "[" << msg.timestamp << "] " 
-                              << msg.role << ": " << msg.content << "\n\n";
-                }
-            }
+            std::cout << "\n--- Conversation History ---\n";
+            bot.for_each_message(bot.get_current_conversation_id(),
+                [](size_t, const MessageView& msg) {
+                    std::cout << "[" << format_timestamp(msg.timestamp) << "] " 
+                              << role_name(msg.role) << ": " << msg.content << "\n\n";
+                });
             continue;
         }
         
@@ -58,78 +67,112 @@ void chat_mode(ClaudeChatbot& bot) {
         std::cout << "\nClaude: ";
         std::cout.flush();
         
-        std::string response = bot.send_message(input);
-        std::cout << response << "\n\n";
+        bool streamed = false;
+        std::string reply = bot.send_message_stream(input, [&streamed](const std::string& text) {
+            streamed = true;
+            std::cout << text;
+            std::cout.flush();
+        });
+        // Failed turns stream nothing, or break off partway
+        if (!streamed) {
+            std::cout << reply;
+        } else if (reply.compare(0, 7, "Error: ") == 0) {
+            std::cout << "\n" << reply;
+        }
+        std::cout << "\n\n";
+    }
+}
+
+const size_t PAGE_SIZE = 10;
+
+void print_conversations(const std::vector<ConversationSummary>& page, size_t offset) {
+    for (size_t i = 0; i < page.size(); i++) {
+        std::cout << offset + i + 1 << ". " << page[i].title << "\n";
+        std::cout << "   ID: " << page[i].id << "\n";
+        std::cout << "   Created: " << format_timestamp(page[i].created_at) << "\n";
+        std::cout << "   Messages: " << page[i].message_count << "\n";
+        std::cout << "   Last Modified: " << format_timestamp(page[i].last_modified) << "\n\n";
     }
 }
 
 void view_conversations(ClaudeChatbot& bot) {
-    auto conversations = bot.get_all_conversations();
-    
-    if (conversations.empty()) {
+    if (bot.get_conversation_count() == 0) {
         std::cout << "\nNo conversations found.\n";
         return;
     }
     
     std::cout << "\n========== All Conversations ==========\n";
-    for (size_t i = 0; i < conversations.size(); i++) {
-        std::cout << i + 1 << ". " << conversations[i].title << "\n";
-        std::cout << "   ID: " << conversations[i].id << "\n";
-        std::cout << "   Created: " << conversations[i].created_at << "\n";
-        std::cout << "   Messages: " << conversations[i].messages.size() << "\n";
-        std::cout << "   Last Modified: " << conversations[i].last_modified << "\n\n";
+    for (size_t offset = 0; ; offset += PAGE_SIZE) {
+        auto page = bot.list_conversations(offset, PAGE_SIZE);
+        if (page.empty()) break;
+        print_conversations(page, offset);
     }
 }
 
-void load_conversation_menu(ClaudeChatbot& bot) {
-    auto conversations = bot.get_all_conversations();
-    
-    if (conversations.empty()) {
-        std::cout << "\nNo conversations to load.\n";
-        return;
+// Pages through the conversations until one is picked. False on cancel or
+// an invalid choice.
+bool choose_conversation(ClaudeChatbot& bot, const std::string& action, ConversationSummary& chosen) {
+    size_t total = bot.get_conversation_count();
+    if (total == 0) {
+        std::cout << "\nNo conversations to " << action << ".\n";
+        return false;
     }
     
-    view_conversations(bot);
-    
-    std::cout << "Enter conversation number to load: ";
-    int choice;
-    std::cin >> choice;
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    size_t offset = 0;
+    while (true) {
+        auto page = bot.list_conversations(offset, PAGE_SIZE);
+        std::cout << "\n========== Conversations " << offset + 1 << "-" << offset + page.size()
+                  << " of " << total << " ==========\n";
+        print_conversations(page, offset);
+        
+        std::cout << "Enter conversation number to " << action;
+        if (total > PAGE_SIZE) std::cout << " (n/p = next/previous page)";
+        std::cout << ", 0 to cancel: ";
+        std::string input;
+        std::getline(std::cin, input);
+        
+        if (input == "n" || input == "p") {
+            if (input == "n" && offset + PAGE_SIZE < total) offset += PAGE_SIZE;
+            if (input == "p") offset = offset >= PAGE_SIZE ? offset - PAGE_SIZE : 0;
+            continue;
+        }
+        
+        long choice = atol(input.c_str());
+        if (choice == 0) return false;
+        auto picked = choice > 0 ? bot.list_conversations(static_cast<size_t>(choice - 1), 1)
+                                 : std::vector<ConversationSummary>();
+        if (picked.empty()) {
+            std::cout << "Invalid choice.\n";
+            return false;
+        }
+        chosen = picked[0];
+        return true;
+    }
+}
+
+void load_conversation_menu(ClaudeChatbot& bot) {
+    ConversationSummary conv;
+    if (!choose_conversation(bot, "load", conv)) return;
     
-    if (choice > 0 && choice <= static_cast<int>(conversations.size())) {
-        bot.load_conversation(conversations[choice - 1].id);
-        std::cout << "Loaded conversation: " << conversations[choice - 1].title << "\n";
+    if (bot.load_conversation(conv.id)) {
+        std::cout << "Loaded conversation: " << conv.title << "\n";
     } else {
-        std::cout << "Invalid choice.\n";
+        std::cout << "Failed to load conversation.\n";
     }
 }
 
 void delete_conversation_menu(ClaudeChatbot& bot) {
-    auto conversations = bot.get_all_conversations();
-    
-    if (conversations.empty()) {
-        std::cout << "\nNo conversations to delete.\n";
-        return;
-    }
+    ConversationSummary conv;
+    if (!choose_conversation(bot, "delete", conv)) return;
     
-    view_conversations(bot);
-    
-    std::cout << "Enter conversation number to delete (0 to cancel): ";
-    int choice;
-    std::cin >> choice;
+    std::cout << "Are you sure you want to delete \"" << conv.title << "\"? (y/n): ";
+    char confirm;
+    std::cin >> confirm;
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
-    if (choice > 0 && choice <= static_cast<int>(conversations.size())) {
-        std::cout << "Are you sure you want to delete \"" 
-                  << conversations[choice - 1].title << "\"? (y/n): ";
-        char confirm;
-        std::cin >> confirm;
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        
-        if (confirm == 'y' || confirm == 'Y') {
-            bot.delete_conversation(conversations[choice - 1].id);
-            std::cout << "Conversation deleted.\n";
-        }
+    if (confirm == 'y' || confirm == 'Y') {
+        bot.delete_conversation(conv.id);
+        std::cout << "Conversation deleted.\n";
     }
 }
 
@@ -138,57 +181,124 @@ void search_messages_menu(ClaudeChatbot& bot) {
     std::string query;
     std::getline(std::cin, query);
     
-    auto results = bot.search_messages(query);
+    auto hits = bot.search_ranked(query, 20);
     
-    if (results.empty()) {
+    if (hits.empty()) {
         std::cout << "No messages found matching \"" << query << "\".\n";
         return;
     }
     
     std::cout << "\n========== Search Results ==========\n";
-    std::cout << "Found " << results.size() << " messages:\n\n";
+    std::cout << "Top " << hits.size() << " messages:\n\n";
     
-    for (const auto& msg : results) {
-        std::cout << "[" << msg.timestamp << "] " << msg.role << ":\n";
+    for (const auto& hit : hits) {
+        Message msg;
+        if (!bot.get_message(hit.conversation_id, hit.message_index, msg)) continue;
+        std::cout << "[" << format_timestamp(msg.timestamp) << "] " << role_name(msg.role)
+                  << " (conversation " << hit.conversation_id
+                  << ", message " << hit.message_index + 1 << ")\n";
         std::cout << msg.content << "\n";
         std::cout << "---\n\n";
     }
 }
 
 void export_conversation_menu(ClaudeChatbot& bot) {
-    auto conversations = bot.get_all_conversations();
+    ConversationSummary conv;
+    if (!choose_conversation(bot, "export", conv)) return;
     
-    if (conversations.empty()) {
-        std::cout << "\nNo conversations to export.\n";
-        return;
-    }
+    std::cout << "Enter filename (e.g., conversation.txt): ";
+    std::string filename;
+    std::getline(std::cin, filename);
     
-    view_conversations(bot);
-    
-    std::cout << "Enter conversation number to export: ";
-    int choice;
-    std::cin >> choice;
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-    
-    if (choice > 0 && choice <= static_cast<int>(conversations.size())) {
-        std::cout << "Enter filename (e.g., conversation.txt): ";
-        std::string filename;
-        std::getline(std::cin, filename);
-        
-        if (bot.export_conversation(conversations[choice - 1].id, filename)) {
-            std::cout << "Conversation exported to " << filename << "\n";
-        } else {
-            std::cout << "Failed to export conversation.\n";
-        }
+    if (bot.export_conversation(conv.id, filename)) {
+        std::cout << "Conversation exported to " << filename << "\n";
+    } else {
+        std::cout << "Failed to export conversation.\n";
     }
 }
 
+// Dumps are JSON when the file name says so, Prometheus text otherwise
+MetricsFormat metrics_format_for(const std::string& path) {
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    return json ? MetricsFormat::Json : MetricsFormat::Prometheus;
+}
+
 void settings_menu(ClaudeChatbot& bot) {
     while (true) {
         std::cout << "\n========== Settings ==========\n";
-        std::cout << "Current Model: " << bot.get_model() << "\n\n";
+        TransportStats stats = bot.get_transport_stats();
+        std::cout << "Current Model: " << bot.get_model() << "\n";
+        std::cout << "Context Budget: " << bot.get_context_budget() << " tokens\n";
+        std::string system_prompt = bot.get_system_prompt();
+        std::cout << "System Prompt: "
+                  << (system_prompt.empty() ? "none" : std::to_string(system_prompt.size()) + " characters")
+                  << ", prompt caching " << (bot.prompt_caching_enabled() ? "on" : "off") << "\n";
+        std::cout << "Requests: " << stats.requests << " ("
+                  << stats.connections_reused << " on a reused connection)\n";
+        SchedulerStats scheduled = bot.get_scheduler_stats();
+        if (scheduled.retries > 0 || scheduled.throttled > 0) {
+            std::cout << "Retries: " << scheduled.retries << " (" << scheduled.rate_limited
+                      << " rate-limited, " << scheduled.overloaded << " overloaded), "
+                      << scheduled.throttled << " held back by the rate limits\n";
+        }
+        ApiReply last = bot.get_last_reply();
+        if (last.status != 0) {
+            std::cout << "Last reply: " << last.usage.input_tokens << " input / "
+                      << last.usage.output_tokens << " output tokens, "
+                      << (last.ok() ? "stop reason " + last.stop_reason : last.error.type) << "\n";
+        }
+        MetricsSnapshot metrics = bot.get_metrics();
+        const Histogram& latency = metrics.histograms["chatbot_request_total_microseconds"];
+        if (latency.count() > 0) {
+            const Histogram& first_byte = metrics.histograms["chatbot_request_starttransfer_microseconds"];
+            std::cout << std::fixed << std::setprecision(0)
+                      << "Latency: p50 " << latency.percentile(50) / 1000 << " ms, p99 "
+                      << latency.percentile(99) / 1000 << " ms (first byte p50 "
+                      << first_byte.percentile(50) / 1000 << " ms)\n";
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        StorageStats storage = bot.get_storage_stats();
+        if (storage.stored_message_bytes > 0) {
+            std::cout << "Storage: " << storage.message_bytes / 1024 << " KB of messages in "
+                      << storage.stored_message_bytes / 1024 << " KB ("
+                      << std::fixed << std::setprecision(1)
+                      << static_cast<double>(storage.message_bytes) / storage.stored_message_bytes
+                      << "x)\n";
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        WriterStats writes = bot.get_writer_stats();
+        std::cout << "Disk Sync: ";
+        switch (bot.get_fsync_policy()) {
+            case FsyncPolicy::EveryCommit:
+                std::cout << "every commit";
+                break;
+            case FsyncPolicy::Interval:
+                std::cout << "every " << bot.get_fsync_interval_ms() << " ms";
+                break;
+            case FsyncPolicy::Never:
+                std::cout << "never";
+                break;
+        }
+        std::cout << " (" << writes.records << " changes in " << writes.commits
+                  << " writes, " << writes.syncs << " syncs)\n";
+        if (bot.response_cache_enabled()) {
+            ResponseCacheStats cache = bot.get_response_cache_stats();
+            std::cout << "Response Cache: on, " << cache.entries << " entries ("
+                      << cache.bytes / 1024 << " KB), " << cache.hits << " hits / "
+                      << cache.misses << " misses\n";
+        } else {
+            std::cout << "Response Cache: off\n";
+        }
+        std::cout << "\n";
         std::cout << "1. Change Model\n";
         std::cout << "2. Change Max Tokens\n";
+        std::cout << "3. Change Context Budget\n";
+        std::cout << "4. Toggle Response Cache\n";
+        std::cout << "5. Clear Response Cache\n";
+        std::cout << "6. Change Disk Sync Policy\n";
+        std::cout << "7. Dump Metrics to File\n";
+        std::cout << "8. Set System Prompt\n";
+        std::cout << "9. Toggle Prompt Caching\n";
         std::cout << "0. Back to Main Menu\n";
         std::cout << "Choice: ";
         
@@ -242,19 +352,267 @@ void settings_menu(ClaudeChatbot& bot) {
                 }
                 break;
             }
+            case 3: {
+                std::cout << "\nEnter context budget in tokens (0 = unlimited, min 2000): ";
+                long long tokens;
+                std::cin >> tokens;
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                
+                if (tokens == 0 || tokens >= 2000) {
+                    bot.set_context_budget(static_cast<uint64_t>(tokens));
+                    std::cout << "Context budget set to " << tokens << "\n";
+                } else {
+                    std::cout << "Invalid token count.\n";
+                }
+                break;
+            }
+            case 4:
+                bot.set_response_cache(!bot.response_cache_enabled());
+                std::cout << "Response cache " << (bot.response_cache_enabled() ? "enabled" : "disabled") << "\n";
+                break;
+            case 5:
+                bot.clear_response_cache();
+                std::cout << "Response cache cleared.\n";
+                break;
+            case 6: {
+                std::cout << "\n1. Sync every commit (safest)\n";
+                std::cout << "2. Sync at an interval\n";
+                std::cout << "3. Never sync (fastest)\n";
+                std::cout << "Enter policy number: ";
+                int policy_choice;
+                std::cin >> policy_choice;
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                
+                if (policy_choice == 1) {
+                    bot.set_fsync_policy(FsyncPolicy::EveryCommit);
+                    std::cout << "Syncing every commit\n";
+                } else if (policy_choice == 2) {
+                    std::cout << "Interval in milliseconds (10-60000): ";
+                    long long interval;
+                    std::cin >> interval;
+                    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                    if (interval >= 10 && interval <= 60000) {
+                        bot.set_fsync_policy(FsyncPolicy::Interval, static_cast<uint64_t>(interval));
+                        std::cout << "Syncing every " << interval << " ms\n";
+                    } else {
+                        std::cout << "Invalid interval.\n";
+                    }
+                } else if (policy_choice == 3) {
+                    bot.set_fsync_policy(FsyncPolicy::Never);
+                    std::cout << "Sync disabled\n";
+                } else {
+                    std::cout << "Invalid choice.\n";
+                }
+                break;
+            }
+            case 7: {
+                std::cout << "\nEnter filename (.json for JSON, else Prometheus text): ";
+                std::string filename;
+                std::getline(std::cin, filename);
+                if (!filename.empty() && bot.dump_metrics(filename, metrics_format_for(filename))) {
+                    std::cout << "Metrics written to " << filename << "\n";
+                } else {
+                    std::cout << "Failed to write metrics.\n";
+                }
+                break;
+            }
+            case 8: {
+                std::cout << "\nEnter system prompt (empty for none): ";
+                std::string prompt;
+                std::getline(std::cin, prompt);
+                bot.set_system_prompt(prompt);
+                std::cout << (prompt.empty() ? "System prompt cleared.\n" : "System prompt set.\n");
+                break;
+            }
+            case 9:
+                bot.set_prompt_caching(!bot.prompt_caching_enabled());
+                std::cout << "Prompt caching " << (bot.prompt_caching_enabled() ? "enabled" : "disabled") << "\n";
+                break;
             default:
                 std::cout << "Invalid choice.\n";
         }
     }
 }
 
-int main() {
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << "\n"
+              << "       " << program << " --batch in.jsonl --out out.jsonl [--concurrency N]\n"
+              << "                        [--model NAME] [--max-tokens N] [--cache] [--api-url URL]\n"
+              << "                        [--metrics FILE] [--system TEXT] [--data-dir DIR]\n"
+              << "       " << program << " --serve [--port N] [--bind ADDR] [--data-root DIR] [--workers N]\n"
+              << "                        [--idle-timeout SECONDS] [--model NAME] [--max-tokens N]\n"
+              << "                        [--api-url URL] [--system TEXT] [--max-tenants N]\n"
+              << "Batch mode reads the API key from ANTHROPIC_API_KEY. The endpoint defaults to\n"
+              << "ANTHROPIC_API_URL if set, else " << DEFAULT_API_URL << ".\n"
+              << "--metrics writes request metrics when done, as JSON if FILE ends in .json and\n"
+              << "as Prometheus text otherwise. Batch mode keeps its data, including the\n"
+              << "--cache responses, in DIR (default: batch/ under the interactive data\n"
+              << "directory), apart from the interactive conversations.\n"
+              << "Server mode (Linux) serves each tenant's conversations over a REST/SSE API,\n"
+              << "keeping tenant data in DIR/<tenant> (default ./tenants), with at most N\n"
+              << "tenants open at once (default 256, 0 = no limit).\n";
+}
+
+int batch_main(int argc, char* argv[]) {
+    BatchOptions options;
+    std::string model = "claude-sonnet-4-20250514";
+    int max_tokens = 1000;
+    bool cache = false;
+    std::string metrics_path;
+    std::string system_prompt;
+    std::string data_dir = ClaudeChatbot::get_data_directory() + "/batch";
+    const char* api_url = getenv("ANTHROPIC_API_URL");
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--batch") == 0 && has_value) {
+            options.input_path = argv[++i];
+        } else if (strcmp(arg, "--out") == 0 && has_value) {
+            options.output_path = argv[++i];
+        } else if (strcmp(arg, "--concurrency") == 0 && has_value) {
+            options.concurrency = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (strcmp(arg, "--model") == 0 && has_value) {
+            model = argv[++i];
+        } else if (strcmp(arg, "--max-tokens") == 0 && has_value) {
+            max_tokens = atoi(argv[++i]);
+        } else if (strcmp(arg, "--cache") == 0) {
+            cache = true;
+        } else if (strcmp(arg, "--api-url") == 0 && has_value) {
+            api_url = argv[++i];
+        } else if (strcmp(arg, "--metrics") == 0 && has_value) {
+            metrics_path = argv[++i];
+        } else if (strcmp(arg, "--system") == 0 && has_value) {
+            system_prompt = argv[++i];
+        } else if (strcmp(arg, "--data-dir") == 0 && has_value) {
+            data_dir = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.input_path.empty() || options.output_path.empty() || options.concurrency == 0 ||
+        max_tokens <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    const char* api_key = getenv("ANTHROPIC_API_KEY");
+    if (!api_key || !*api_key) {
+        std::cerr << "ANTHROPIC_API_KEY is not set.\n";
+        return 1;
+    }
+    
+    // Its own data directory, so the conversation every chatbot starts
+    // with does not show up in the interactive history
+    ClaudeChatbot bot(api_key, model, max_tokens, data_dir);
+    if (api_url) bot.set_api_url(api_url);
+    if (cache) bot.set_response_cache(true);
+    bot.set_system_prompt(system_prompt);
+    bot.prewarm_connection();
+    int status = run_batch(bot, options);
+    if (!metrics_path.empty() && !bot.dump_metrics(metrics_path, metrics_format_for(metrics_path))) {
+        std::cerr << "Could not write metrics to " << metrics_path << "\n";
+    }
+    return status;
+}
+
+int serve_main(int argc, char* argv[]) {
+    ApiServerOptions options;
+    const char* api_url = getenv("ANTHROPIC_API_URL");
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--serve") == 0) {
+            continue;
+        } else if (strcmp(arg, "--port") == 0 && has_value) {
+            options.http.port = static_cast<uint16_t>(atoi(argv[++i]));
+        } else if (strcmp(arg, "--bind") == 0 && has_value) {
+            options.http.bind_address = argv[++i];
+        } else if (strcmp(arg, "--data-root") == 0 && has_value) {
+            options.data_root = argv[++i];
+        } else if (strcmp(arg, "--workers") == 0 && has_value) {
+            options.http.workers = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (strcmp(arg, "--idle-timeout") == 0 && has_value) {
+            options.http.idle_timeout_seconds = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (strcmp(arg, "--model") == 0 && has_value) {
+            options.model = argv[++i];
+        } else if (strcmp(arg, "--max-tokens") == 0 && has_value) {
+            options.max_tokens = atoi(argv[++i]);
+        } else if (strcmp(arg, "--api-url") == 0 && has_value) {
+            api_url = argv[++i];
+        } else if (strcmp(arg, "--system") == 0 && has_value) {
+            options.system_prompt = argv[++i];
+        } else if (strcmp(arg, "--max-tenants") == 0 && has_value) {
+            options.max_tenants = static_cast<size_t>(atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    const char* api_key = getenv("ANTHROPIC_API_KEY");
+    if (!api_key || !*api_key) {
+        std::cerr << "ANTHROPIC_API_KEY is not set.\n";
+        return 1;
+    }
+    options.api_key = api_key;
+    if (api_url) options.api_url = api_url;
+    
+#ifdef PLATFORM_WINDOWS
+    std::cerr << "Server mode is only available on Linux.\n";
+    return 1;
+#else
+    // Every client connection takes a descriptor
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    
+    // Block the stop signals before any thread starts, so only sigwait
+    // below sees them
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    
+    ApiServer server(options);
+    std::string error;
+    if (!server.start(error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::cout << "Serving on http://" << options.http.bind_address << ":" << server.port()
+              << ", tenant data in " << options.data_root << std::endl;
+    
+    int signal_number = 0;
+    sigwait(&stop_signals, &signal_number);
+    std::cout << "Shutting down..." << std::endl;
+    server.stop();
+    return 0;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        return serve_main(argc, argv);
+    }
+    if (argc > 1) {
+        return batch_main(argc, argv);
+    }
+    
     std::cout << "========== Claude Chatbot ==========\n";
     std::cout << "Welcome! This chatbot uses Claude AI.\n\n";
     
-    std::cout << "Enter your Anthropic API key: ";
     std::string api_key;
-    std::getline(std::cin, api_key);
+    const char* env_key = getenv("ANTHROPIC_API_KEY");
+    if (env_key && *env_key) {
+        api_key = env_key;
+    } else {
+        std::cout << "Enter your Anthropic API key: ";
+        std::getline(std::cin, api_key);
+    }
     
     if (api_key.empty()) {
         std::cout << "API key is required. Exiting...\n";
@@ -262,6 +620,9 @@ int main() {
     }
     
     ClaudeChatbot bot(api_key);
+    const char* api_url = getenv("ANTHROPIC_API_URL");
+    if (api_url) bot.set_api_url(api_url);
+    bot.prewarm_connection();
     
     std::cout << "\nChatbot initialized successfully!\n";
     std::cout << "Your conversations will be saved automatically.\n";
@@ -0,0 +1,96 @@
+#include "mapped_file.h"
+#include <algorithm>
+
+#ifdef PLATFORM_WINDOWS
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef PLATFORM_WINDOWS
+MappedFile::MappedFile()
+    : base(nullptr), length(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr) {}
+#else
+MappedFile::MappedFile() : base(nullptr), length(0) {}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef PLATFORM_WINDOWS
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    length = static_cast<uint64_t>(file_size.QuadPart);
+
+    mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_handle) {
+        close();
+        return false;
+    }
+    base = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<uint64_t>(st.st_size);
+
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+    base = static_cast<const char*>(addr);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef PLATFORM_WINDOWS
+    if (base) UnmapViewOfFile(base);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = INVALID_HANDLE_VALUE;
+#else
+    if (base) munmap(const_cast<char*>(base), length);
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+void MappedFile::release(uint64_t offset, uint64_t size) const {
+#ifndef PLATFORM_WINDOWS
+    if (!base || offset >= length) return;
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t start = (offset / page) * page;
+    uint64_t end = std::min<uint64_t>(offset + size, length);
+    madvise(const_cast<char*>(base) + start, end - start, MADV_DONTNEED);
+#else
+    (void)offset;
+    (void)size;
+#endif
+}
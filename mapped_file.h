@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "platform.h"
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+private:
+    const char* base;
+    uint64_t length;
+#ifdef PLATFORM_WINDOWS
+    void* file_handle;
+    void* mapping_handle;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Hints that a range will not be read again soon so its pages can be
+    // dropped from the resident set.
+    void release(uint64_t offset, uint64_t size) const;
+
+    bool is_open() const { return base != nullptr; }
+    const char* data() const { return base; }
+    uint64_t size() const { return length; }
+};
+
+#endif // MAPPED_FILE_H
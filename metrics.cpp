@@ -0,0 +1,161 @@
+#include "metrics.h"
+#include "journal.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static size_t bucket_for(uint64_t value) {
+    size_t bucket = 0;
+    while (bucket < Histogram::BUCKETS - 1 && Histogram::bucket_bound(bucket) < value) {
+        bucket++;
+    }
+    return bucket;
+}
+
+uint64_t Histogram::bucket_bound(size_t bucket) {
+    if (bucket == 0) return 0;
+    return bucket < BUCKETS - 1 ? static_cast<uint64_t>(1) << (bucket - 1) : UINT64_MAX;
+}
+
+void Histogram::record(uint64_t value) {
+    counts[bucket_for(value)]++;
+    samples++;
+    total += value;
+    largest = std::max(largest, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+    samples += other.samples;
+    total += other.total;
+    largest = std::max(largest, other.largest);
+}
+
+double Histogram::percentile(double p) const {
+    if (samples == 0) return 0;
+    double rank = std::max(1.0, std::min(p, 100.0) / 100.0 * samples);
+    uint64_t before = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        if (before + counts[i] >= rank) {
+            // Spread the bucket's samples evenly over the integers it covers
+            double lower = i == 0 ? 0 : static_cast<double>(bucket_bound(i - 1) + 1);
+            double upper = std::max(lower, static_cast<double>(std::min(bucket_bound(i), largest)));
+            double fraction = (rank - before) / counts[i];
+            return lower + (upper - lower) * fraction;
+        }
+        before += counts[i];
+    }
+    return static_cast<double>(largest);
+}
+
+// Cumulative buckets with every bound listed, so the series stay the same
+// from one scrape to the next.
+static void render_prometheus(const MetricsSnapshot& metrics, std::ostringstream& out) {
+    for (const auto& counter : metrics.counters) {
+        out << "# TYPE " << counter.first << " counter\n"
+            << counter.first << " " << counter.second << "\n";
+    }
+    for (const auto& entry : metrics.histograms) {
+        const std::string& name = entry.first;
+        const Histogram& histogram = entry.second;
+        out << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < Histogram::BUCKETS; i++) {
+            cumulative += histogram.bucket_count(i);
+            out << name << "_bucket{le=\"";
+            if (i < Histogram::BUCKETS - 1) {
+                out << Histogram::bucket_bound(i);
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum " << histogram.sum() << "\n"
+            << name << "_count " << histogram.count() << "\n";
+    }
+}
+
+// Summary figures plus the non-empty buckets, keyed by upper bound
+static void render_json(const MetricsSnapshot& metrics, std::ostringstream& out) {
+    out << std::fixed << std::setprecision(1) << "{\"counters\":{";
+    const char* separator = "";
+    for (const auto& counter : metrics.counters) {
+        out << separator << "\"" << counter.first << "\":" << counter.second;
+        separator = ",";
+    }
+    out << "},\"histograms\":{";
+    separator = "";
+    for (const auto& entry : metrics.histograms) {
+        const Histogram& histogram = entry.second;
+        out << separator << "\"" << entry.first << "\":{\"count\":" << histogram.count()
+            << ",\"sum\":" << histogram.sum() << ",\"max\":" << histogram.max()
+            << ",\"mean\":" << histogram.mean()
+            << ",\"p50\":" << histogram.percentile(50)
+            << ",\"p90\":" << histogram.percentile(90)
+            << ",\"p99\":" << histogram.percentile(99) << ",\"buckets\":{";
+        const char* bucket_separator = "";
+        for (size_t i = 0; i < Histogram::BUCKETS; i++) {
+            if (histogram.bucket_count(i) == 0) continue;
+            out << bucket_separator << "\"";
+            if (i < Histogram::BUCKETS - 1) {
+                out << Histogram::bucket_bound(i);
+            } else {
+                out << "+Inf";
+            }
+            out << "\":" << histogram.bucket_count(i);
+            bucket_separator = ",";
+        }
+        out << "}}";
+        separator = ",";
+    }
+    out << "}}\n";
+}
+
+std::string MetricsSnapshot::render(MetricsFormat format) const {
+    std::ostringstream out;
+    if (format == MetricsFormat::Json) {
+        render_json(*this, out);
+    } else {
+        render_prometheus(*this, out);
+    }
+    return out.str();
+}
+
+void Metrics::add(const std::string& counter, uint64_t delta) {
+    std::lock_guard<std::mutex> lock(mutex);
+    data.counters[counter] += delta;
+}
+
+void Metrics::observe(const std::string& histogram, uint64_t value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    data.histograms[histogram].record(value);
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return data;
+}
+
+void Metrics::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    data = MetricsSnapshot();
+}
+
+bool Metrics::write_file(const std::string& path, MetricsFormat format) const {
+    std::string text = snapshot().render(format);
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!out) {
+            out.close();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    return replace_file(temp_path, path);
+}
@@ -0,0 +1,71 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Log-scale histogram of integer samples (microseconds, bytes, tokens).
+// Bucket 0 holds zeros and bucket i samples up to 2^(i-1), above the
+// previous bucket's bound; the last one is unbounded. Percentiles are
+// interpolated within a bucket, so they are estimates good to a factor of
+// two at worst.
+class Histogram {
+public:
+    static const size_t BUCKETS = 40;
+
+    void record(uint64_t value);
+    void merge(const Histogram& other);
+
+    uint64_t count() const { return samples; }
+    uint64_t sum() const { return total; }
+    uint64_t max() const { return largest; }
+    double mean() const { return samples ? static_cast<double>(total) / samples : 0; }
+    double percentile(double p) const;
+
+    uint64_t bucket_count(size_t bucket) const { return counts[bucket]; }
+    // Inclusive upper bound of a bucket; UINT64_MAX for the last one
+    static uint64_t bucket_bound(size_t bucket);
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t samples = 0;
+    uint64_t total = 0;
+    uint64_t largest = 0;
+};
+
+enum class MetricsFormat {
+    Prometheus,     // text exposition format
+    Json
+};
+
+// A copy of every counter and histogram, keyed by metric name.
+struct MetricsSnapshot {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, Histogram> histograms;
+
+    std::string render(MetricsFormat format) const;
+};
+
+// Named counters and histograms, safe to update from any thread. Metrics
+// spring into existence on first use.
+class Metrics {
+private:
+    mutable std::mutex mutex;
+    MetricsSnapshot data;
+
+public:
+    void add(const std::string& counter, uint64_t delta = 1);
+    void observe(const std::string& histogram, uint64_t value);
+
+    MetricsSnapshot snapshot() const;
+    void reset();
+
+    // Renders the current values to path through a temporary file, so a
+    // scraper never sees a half-written dump.
+    bool write_file(const std::string& path, MetricsFormat format) const;
+};
+
+#endif // METRICS_H
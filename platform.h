@@ -0,0 +1,20 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Platform detection
+#if defined(_WIN32) || defined(_WIN64)
+    #define PLATFORM_WINDOWS
+#elif defined(__ANDROID__)
+    #define PLATFORM_ANDROID
+#elif defined(__APPLE__)
+    #include <TargetConditionals.h>
+    #if TARGET_OS_IPHONE
+        #define PLATFORM_IOS
+    #else
+        #define PLATFORM_MACOS
+    #endif
+#elif defined(__linux__)
+    #define PLATFORM_LINUX
+#endif
+
+#endif // PLATFORM_H
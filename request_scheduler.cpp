@@ -0,0 +1,321 @@
+#include "request_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+static const double SECONDS_PER_MINUTE = 60.0;
+
+static uint64_t micros_between(TokenBucket::Clock::time_point from, TokenBucket::Clock::time_point to) {
+    if (to <= from) return 0;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+TokenBucket::TokenBucket() : capacity(0), level(0) {}
+
+void TokenBucket::refill(Clock::time_point now) {
+    if (now > updated) {
+        double elapsed = std::chrono::duration<double>(now - updated).count();
+        level = std::min(capacity, level + elapsed * capacity / SECONDS_PER_MINUTE);
+    }
+    updated = now;
+}
+
+void TokenBucket::set_limit(uint64_t per_minute, Clock::time_point now) {
+    refill(now);
+    bool was_unlimited = capacity == 0;
+    capacity = static_cast<double>(per_minute);
+    level = was_unlimited ? capacity : std::min(level, capacity);
+}
+
+uint64_t TokenBucket::limit() const {
+    return static_cast<uint64_t>(capacity);
+}
+
+TokenBucket::Clock::duration TokenBucket::wait_for(double amount, Clock::time_point now) {
+    if (capacity == 0) return Clock::duration::zero();
+    refill(now);
+    double need = std::min(amount, capacity);
+    if (level >= need) return Clock::duration::zero();
+    double seconds = (need - level) * SECONDS_PER_MINUTE / capacity;
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)) +
+           Clock::duration(1);
+}
+
+void TokenBucket::take(double amount, Clock::time_point now) {
+    if (capacity == 0) return;
+    refill(now);
+    level = std::min(capacity, level - amount);
+}
+
+void TokenBucket::cap(double remaining, Clock::time_point now) {
+    if (capacity == 0) return;
+    refill(now);
+    level = std::min(level, remaining);
+}
+
+// Figures the server sends as decimal header values
+static bool header_number(const HttpResponse& response, const char* name, double& value) {
+    const std::string* text = response.header(name);
+    if (!text || text->empty()) return false;
+    char* end = nullptr;
+    value = std::strtod(text->c_str(), &end);
+    return end != text->c_str() && value >= 0 && std::isfinite(value);
+}
+
+static bool transient(const ApiReply& reply) {
+    switch (reply.status) {
+        case 408: case 409: case 429: case 500: case 502: case 503: case 504: case 529:
+            return true;
+        default:
+            break;
+    }
+    // Errors that arrive mid-stream come with a 200
+    const std::string& type = reply.error.type;
+    return type == "transport_error" || type == "overloaded_error" ||
+           type == "rate_limit_error" || type == "api_error";
+}
+
+RequestScheduler::RequestScheduler()
+    : rng(std::random_device()()), stopping(false) {
+    thread = std::thread(&RequestScheduler::run, this);
+}
+
+RequestScheduler::~RequestScheduler() {
+    shutdown();
+}
+
+void RequestScheduler::shutdown() {
+    std::vector<std::shared_ptr<Call>> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+        abandoned.assign(ready.begin(), ready.end());
+        for (auto& entry : backing_off) {
+            abandoned.push_back(entry.second);
+        }
+        ready.clear();
+        backing_off.clear();
+    }
+    wake.notify_all();
+    thread.join();
+    for (const auto& call : abandoned) {
+        fail(call, "Request scheduler is shutting down");
+    }
+    transport.shutdown();
+}
+
+void RequestScheduler::fail(const std::shared_ptr<Call>& call, const std::string& message) {
+    ApiReply reply;
+    reply.error.type = "transport_error";
+    reply.error.message = message;
+    reply.metrics.attempts = call->attempts;
+    reply.metrics.queue_us = call->queue_us;
+    if (call->call.done) call->call.done(std::move(reply));
+}
+
+void RequestScheduler::submit(ScheduledCall call) {
+    auto pending = std::make_shared<Call>();
+    pending->call = std::move(call);
+    pending->queued_at = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            ready.push_back(pending);
+            wake.notify_one();
+            return;
+        }
+    }
+    fail(pending, "Request scheduler is shutting down");
+}
+
+void RequestScheduler::set_options(const SchedulerOptions& new_options) {
+    std::lock_guard<std::mutex> lock(mutex);
+    options = new_options;
+    options.max_attempts = std::max(1u, options.max_attempts);
+    Clock::time_point now = Clock::now();
+    if (options.requests_per_minute > 0) requests.set_limit(options.requests_per_minute, now);
+    if (options.tokens_per_minute > 0) tokens.set_limit(options.tokens_per_minute, now);
+    wake.notify_one();
+}
+
+SchedulerOptions RequestScheduler::get_options() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return options;
+}
+
+void RequestScheduler::prewarm(const std::string& url) {
+    transport.prewarm(url);
+}
+
+TransportStats RequestScheduler::transport_stats() const {
+    return transport.stats();
+}
+
+SchedulerStats RequestScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    SchedulerStats result = counters;
+    result.waiting = ready.size() + backing_off.size();
+    result.requests_per_minute = requests.limit();
+    result.tokens_per_minute = tokens.limit();
+    return result;
+}
+
+// Hands out calls in order as the limits allow, sleeping until the next
+// one can go or a backoff ends.
+void RequestScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        Clock::time_point now = Clock::now();
+
+        // Calls whose backoff is over go ahead of new ones, oldest first
+        auto due_end = backing_off.upper_bound(now);
+        std::deque<std::shared_ptr<Call>> due;
+        for (auto it = backing_off.begin(); it != due_end; ++it) {
+            it->second->queued_at = it->first;
+            due.push_back(it->second);
+        }
+        backing_off.erase(backing_off.begin(), due_end);
+        ready.insert(ready.begin(), due.begin(), due.end());
+
+        Clock::time_point wake_at = backing_off.empty() ? Clock::time_point::max() : backing_off.begin()->first;
+        if (!ready.empty()) {
+            std::shared_ptr<Call> call = ready.front();
+            double cost = static_cast<double>(call->call.tokens);
+            Clock::duration wait = std::max({paused_until - now, requests.wait_for(1, now),
+                                             tokens.wait_for(cost, now)});
+            if (wait <= Clock::duration::zero()) {
+                ready.pop_front();
+                call->held = false;
+                requests.take(1, now);
+                tokens.take(cost, now);
+                call->attempts++;
+                uint64_t queued = micros_between(call->queued_at, now);
+                call->queue_us += queued;
+                counters.attempts++;
+                if (Metrics* metrics = call->call.metrics) {
+                    metrics->observe("chatbot_request_queue_microseconds", queued);
+                }
+
+                lock.unlock();
+                dispatch(call);
+                lock.lock();
+                continue;
+            }
+            if (!call->held) {
+                call->held = true;
+                counters.throttled++;
+            }
+            wake_at = std::min(wake_at, now + wait);
+        }
+        if (wake_at == Clock::time_point::max()) {
+            wake.wait(lock);
+        } else {
+            wake.wait_until(lock, wake_at);
+        }
+    }
+}
+
+void RequestScheduler::dispatch(const std::shared_ptr<Call>& call) {
+    HttpRequest request = call->call.prepare();
+    transport.post_async(request, [this, call](HttpResponse&& response) {
+        handle_response(call, std::move(response));
+    });
+}
+
+// Runs on the transport thread
+void RequestScheduler::handle_response(const std::shared_ptr<Call>& call, HttpResponse&& response) {
+    Clock::time_point now = Clock::now();
+    double retry_after_seconds = -1;
+    if (!header_number(response, "retry-after", retry_after_seconds)) retry_after_seconds = -1;
+    Clock::duration retry_after = retry_after_seconds < 0 ? Clock::duration::zero() :
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(retry_after_seconds));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        observe_limits(response, now);
+    }
+
+    ApiReply reply = call->call.decode(std::move(response));
+    bool rate_limited = reply.status == 429 || reply.error.type == "rate_limit_error";
+    bool overloaded = reply.status == 529 || reply.error.type == "overloaded_error";
+    bool retry = !reply.ok() && transient(reply) && (!call->call.can_retry || call->call.can_retry());
+    Metrics* metrics = call->call.metrics;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (rate_limited) {
+            counters.rate_limited++;
+            if (metrics) metrics->add("chatbot_rate_limited_total");
+        }
+        if (overloaded) {
+            counters.overloaded++;
+            if (metrics) metrics->add("chatbot_overloaded_total");
+        }
+        if ((rate_limited || overloaded) && retry_after > Clock::duration::zero()) {
+            paused_until = std::max(paused_until, now + retry_after);
+        }
+
+        // Settle the attempt's estimate against what it actually used.
+        // Input read back from the prompt cache does not count against the
+        // limit. An attempt that is retried gets its estimate back in full
+        // unless it reports usage, since the next one is charged again when
+        // it goes out; a final one without usage keeps it.
+        bool retrying = retry && !stopping && call->attempts < options.max_attempts;
+        uint64_t used = reply.usage.input_tokens + reply.usage.cache_creation_input_tokens +
+                        reply.usage.output_tokens;
+        if (used > 0 || retrying) {
+            tokens.take(static_cast<double>(used) - static_cast<double>(call->call.tokens), now);
+        }
+
+        if (retrying) {
+            backing_off.emplace(now + backoff(call->attempts, retry_after), call);
+            counters.retries++;
+            if (metrics) metrics->add("chatbot_request_retries_total");
+            wake.notify_one();
+            return;
+        }
+        if (!reply.ok()) counters.failed++;
+        reply.metrics.attempts = call->attempts;
+        reply.metrics.queue_us = call->queue_us;
+        wake.notify_one();
+    }
+    call->call.done(std::move(reply));
+}
+
+// Called with mutex held. Limits set in the options win over the headers;
+// the remaining figures always apply. Accounts without a combined token
+// limit report input tokens separately.
+void RequestScheduler::observe_limits(const HttpResponse& response, Clock::time_point now) {
+    double value;
+    if (options.requests_per_minute == 0 && header_number(response, "anthropic-ratelimit-requests-limit", value)) {
+        requests.set_limit(static_cast<uint64_t>(value), now);
+    }
+    if (header_number(response, "anthropic-ratelimit-requests-remaining", value)) {
+        requests.cap(value, now);
+    }
+
+    const char* limit_header = "anthropic-ratelimit-tokens-limit";
+    const char* remaining_header = "anthropic-ratelimit-tokens-remaining";
+    if (!response.header(limit_header)) {
+        limit_header = "anthropic-ratelimit-input-tokens-limit";
+        remaining_header = "anthropic-ratelimit-input-tokens-remaining";
+    }
+    if (options.tokens_per_minute == 0 && header_number(response, limit_header, value)) {
+        tokens.set_limit(static_cast<uint64_t>(value), now);
+    }
+    if (header_number(response, remaining_header, value)) {
+        tokens.cap(value, now);
+    }
+}
+
+// Called with mutex held. Exponential in the attempts so far with "equal
+// jitter": somewhere between half and all of the step, so retries from
+// calls that failed together spread out, but never sooner than the server
+// asked.
+RequestScheduler::Clock::duration RequestScheduler::backoff(unsigned attempts, Clock::duration retry_after) {
+    double step = static_cast<double>(options.initial_backoff_ms) * std::ldexp(1.0, static_cast<int>(attempts) - 1);
+    step = std::min(step, static_cast<double>(options.max_backoff_ms));
+    std::uniform_real_distribution<double> jitter(step / 2, step);
+    Clock::duration delay = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(jitter(rng)));
+    return std::max(delay, retry_after);
+}
@@ -0,0 +1,163 @@
+#ifndef REQUEST_SCHEDULER_H
+#define REQUEST_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "api_reply.h"
+#include "http_transport.h"
+#include "metrics.h"
+
+// A per-minute allowance refilled continuously, so a full minute's worth
+// can go out in a burst and then one unit every 60/limit seconds. The level
+// may go negative: whatever was overdrawn is paid back before anyone else
+// gets through.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    double capacity;    // 0 = unlimited
+    double level;
+    Clock::time_point updated;
+
+    void refill(Clock::time_point now);
+
+public:
+    TokenBucket();
+
+    // A bucket that was unlimited starts out full; otherwise the level is
+    // kept, within the new limit. 0 makes it unlimited.
+    void set_limit(uint64_t per_minute, Clock::time_point now);
+    uint64_t limit() const;
+
+    // How long until amount can be taken, zero if right away. Amounts
+    // larger than the whole bucket wait for a full one.
+    Clock::duration wait_for(double amount, Clock::time_point now);
+    // Negative amounts give back what was taken in excess.
+    void take(double amount, Clock::time_point now);
+    // Never holds more than remaining, what the server says is left.
+    void cap(double remaining, Clock::time_point now);
+};
+
+struct SchedulerOptions {
+    uint64_t requests_per_minute = 0;   // 0 = as the rate-limit headers say
+    uint64_t tokens_per_minute = 0;
+    unsigned max_attempts = 5;          // per call, the first one included
+    uint64_t initial_backoff_ms = 500;
+    uint64_t max_backoff_ms = 30000;
+};
+
+struct SchedulerStats {
+    uint64_t attempts = 0;              // requests handed to the transport
+    uint64_t retries = 0;
+    uint64_t throttled = 0;             // attempts that waited for the limits
+    uint64_t rate_limited = 0;          // 429 / rate_limit_error
+    uint64_t overloaded = 0;            // 529 / overloaded_error
+    uint64_t failed = 0;                // calls that ended in an error
+    uint64_t waiting = 0;               // calls queued or backing off now
+    uint64_t requests_per_minute = 0;   // limits in force, 0 if none known
+    uint64_t tokens_per_minute = 0;
+};
+
+// One logical API call, which may take several attempts. prepare builds
+// each attempt's request afresh (so per-attempt decoding state starts
+// clean) and decode turns its response into a reply. can_retry, when set,
+// vetoes retrying, e.g. once part of a streamed reply has been passed on.
+// done runs exactly once, with the final reply. metrics, when set,
+// receives the call's retry, rate-limit and queueing figures.
+struct ScheduledCall {
+    uint64_t tokens = 0;                // estimated input plus output tokens
+    std::function<HttpRequest()> prepare;
+    std::function<ApiReply(HttpResponse&&)> decode;
+    std::function<bool()> can_retry;
+    std::function<void(ApiReply&&)> done;
+    Metrics* metrics = nullptr;
+};
+
+// Paces Messages API calls to the account's rate limits and retries the
+// ones that fail transiently. Calls wait in a FIFO queue until both the
+// requests-per-minute and the tokens-per-minute bucket can cover them; the
+// limits come from the options or, failing those, from the anthropic-
+// ratelimit-* response headers, whose "remaining" figures also cap the
+// buckets. Tokens are charged up front from the estimate and corrected
+// with the usage the reply reports.
+//
+// Network errors, 408/409/429/5xx/529 and streamed overloaded, rate-limit
+// and api errors are retried with jittered exponential backoff, waiting at
+// least as long as retry-after says; a retry-after on a 429 or 529 also
+// holds back every other call for that long. Retried calls go ahead of new
+// ones once their backoff is over.
+//
+// Owns the transport. Dispatching happens on a thread of its own;
+// prepare runs there and decode and done on the transport thread. Several
+// chatbots sharing an API key should share one scheduler, so they draw on
+// the same limits and connections.
+class RequestScheduler {
+public:
+    using Clock = TokenBucket::Clock;
+
+private:
+    struct Call {
+        ScheduledCall call;
+        unsigned attempts = 0;
+        uint64_t queue_us = 0;          // waiting for the limits, all attempts
+        Clock::time_point queued_at;
+        bool held = false;              // this attempt had to wait
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    SchedulerOptions options;
+    TokenBucket requests;
+    TokenBucket tokens;
+    std::deque<std::shared_ptr<Call>> ready;
+    std::multimap<Clock::time_point, std::shared_ptr<Call>> backing_off;
+    Clock::time_point paused_until;
+    SchedulerStats counters;
+    std::mt19937_64 rng;
+    bool stopping;
+    std::thread thread;
+
+    // Declared last so it is destroyed first: it fails the calls still in
+    // flight, whose completions use everything above.
+    HttpTransport transport;
+
+    void run();
+    void dispatch(const std::shared_ptr<Call>& call);
+    void handle_response(const std::shared_ptr<Call>& call, HttpResponse&& response);
+    void observe_limits(const HttpResponse& response, Clock::time_point now);
+    Clock::duration backoff(unsigned attempts, Clock::duration retry_after);
+    static void fail(const std::shared_ptr<Call>& call, const std::string& message);
+
+public:
+    RequestScheduler();
+    ~RequestScheduler();
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    void submit(ScheduledCall call);
+
+    void set_options(const SchedulerOptions& new_options);
+    SchedulerOptions get_options() const;
+
+    // Fails the calls still waiting, then the ones in flight; calls
+    // submitted afterwards fail at once. The destructor does the same. Not
+    // to be called from a completion.
+    void shutdown();
+
+    void prewarm(const std::string& url);
+    TransportStats transport_stats() const;
+    SchedulerStats stats() const;
+};
+
+#endif // REQUEST_SCHEDULER_H
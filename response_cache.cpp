@@ -0,0 +1,312 @@
+#include "response_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static const char CACHE_MAGIC[4] = {'C', 'C', 'R', '1'};
+
+enum CacheRecordType : uint8_t {
+    CACHE_PUT = 1,
+    CACHE_TOUCH = 2
+};
+
+static uint32_t checksum(const char* data, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void put_u64(std::string& buf, uint64_t value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put_string(std::string& buf, const std::string& value) {
+    put_u64(buf, value.size());
+    buf.append(value);
+}
+
+static bool get_u64(const std::string& buf, size_t& pos, uint64_t& value) {
+    if (buf.size() - pos < sizeof(value)) return false;
+    buf.copy(reinterpret_cast<char*>(&value), sizeof(value), pos);
+    pos += sizeof(value);
+    return true;
+}
+
+static bool get_string(const std::string& buf, size_t& pos, std::string& value) {
+    uint64_t len;
+    if (!get_u64(buf, pos, len) || buf.size() - pos < len) return false;
+    value.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+static uint64_t mix64(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+ResponseCache::Key ResponseCache::make_key(const char* request_body, size_t size) {
+    // Two independently seeded 64-bit FNV-style streams over the body
+    uint64_t a = 14695981039346656037ULL;
+    uint64_t b = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char byte = static_cast<unsigned char>(request_body[i]);
+        a = (a ^ byte) * 1099511628211ULL;
+        b = (b ^ byte) * 0x100000001b3ULL + 0x2545f4914f6cdd1dULL;
+    }
+    Key key;
+    key.high = mix64(a ^ size);
+    key.low = mix64(b + size);
+    return key;
+}
+
+ResponseCache::ResponseCache()
+    : file_bytes(0), live_bytes(0), max_bytes(DEFAULT_MAX_BYTES), clock(0), hits(0), misses(0) {}
+
+void ResponseCache::open(const std::string& cache_path, uint64_t limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    path = cache_path;
+    max_bytes = limit;
+    load();
+}
+
+void ResponseCache::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_open()) file.close();
+    entries.clear();
+    file_bytes = 0;
+    live_bytes = 0;
+}
+
+bool ResponseCache::is_open() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return file.is_open();
+}
+
+void ResponseCache::load() {
+    if (file.is_open()) file.close();
+    entries.clear();
+    live_bytes = 0;
+    file_bytes = 0;
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    uint64_t size = in.is_open() ? static_cast<uint64_t>(in.tellg()) : 0;
+    bool intact = false;
+    if (size >= sizeof(CACHE_MAGIC)) {
+        in.seekg(0);
+        char magic[sizeof(CACHE_MAGIC)];
+        in.read(magic, sizeof(magic));
+        intact = std::equal(magic, magic + sizeof(magic), CACHE_MAGIC);
+    }
+
+    uint64_t valid_end = sizeof(CACHE_MAGIC);
+    std::string payload;
+    while (intact) {
+        uint32_t header[2];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) break;
+        if (header[0] < 17 || header[0] > size - valid_end - sizeof(header)) break;
+        payload.resize(header[0]);
+        if (!in.read(&payload[0], header[0])) break;
+        if (checksum(payload.data(), payload.size()) != header[1]) break;
+
+        Key key;
+        size_t pos = 1;
+        get_u64(payload, pos, key.high);
+        get_u64(payload, pos, key.low);
+        uint64_t record_size = sizeof(header) + header[0];
+        if (payload[0] == CACHE_PUT) {
+            auto it = entries.find(key);
+            if (it != entries.end()) live_bytes -= it->second.size;
+            entries[key] = Entry{valid_end, record_size, ++clock};
+            live_bytes += record_size;
+        } else if (payload[0] == CACHE_TOUCH) {
+            auto it = entries.find(key);
+            if (it != entries.end()) it->second.last_used = ++clock;
+        }
+        valid_end += record_size;
+    }
+    in.close();
+
+    if (!intact) {
+        std::ofstream fresh(path, std::ios::binary | std::ios::trunc);
+        fresh.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        valid_end = sizeof(CACHE_MAGIC);
+    }
+    file_bytes = valid_end;
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::app);
+
+    // A torn tail would hide every record appended after it
+    if (intact && valid_end != size) compact(max_bytes);
+}
+
+bool ResponseCache::append_record(const std::string& payload, uint64_t& offset) {
+    if (!file.is_open()) return false;
+    uint32_t header[2] = {
+        static_cast<uint32_t>(payload.size()),
+        checksum(payload.data(), payload.size())
+    };
+    offset = file_bytes;
+    file.seekp(0, std::ios::end);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(payload.data(), payload.size());
+    file.flush();
+    if (!file) {
+        file.clear();
+        return false;
+    }
+    file_bytes += sizeof(header) + payload.size();
+    return true;
+}
+
+bool ResponseCache::read_entry(const Entry& entry, ApiReply& out) {
+    std::string record(entry.size, '\0');
+    file.seekg(static_cast<std::streamoff>(entry.offset));
+    if (!file.read(&record[0], static_cast<std::streamsize>(entry.size))) {
+        file.clear();
+        return false;
+    }
+
+    uint32_t header[2];
+    record.copy(reinterpret_cast<char*>(header), sizeof(header), 0);
+    std::string payload = record.substr(sizeof(header));
+    if (header[0] != payload.size() || checksum(payload.data(), payload.size()) != header[1]) {
+        return false;
+    }
+
+    size_t pos = 1 + 16;
+    out = ApiReply();
+    out.status = 200;
+    return get_u64(payload, pos, out.usage.input_tokens) &&
+           get_u64(payload, pos, out.usage.output_tokens) &&
+           get_string(payload, pos, out.stop_reason) &&
+           get_string(payload, pos, out.model) &&
+           get_string(payload, pos, out.text);
+}
+
+bool ResponseCache::lookup(const Key& key, ApiReply& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end() || !read_entry(it->second, out)) {
+        if (it != entries.end()) {
+            live_bytes -= it->second.size;
+            entries.erase(it);
+        }
+        misses++;
+        return false;
+    }
+    hits++;
+    it->second.last_used = ++clock;
+
+    std::string payload(1, static_cast<char>(CACHE_TOUCH));
+    put_u64(payload, key.high);
+    put_u64(payload, key.low);
+    uint64_t offset;
+    append_record(payload, offset);
+    if (file_bytes > max_bytes) compact(max_bytes / 2);
+    return true;
+}
+
+void ResponseCache::store(const Key& key, const ApiReply& reply) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!reply.ok()) return;
+
+    std::string payload(1, static_cast<char>(CACHE_PUT));
+    put_u64(payload, key.high);
+    put_u64(payload, key.low);
+    put_u64(payload, reply.usage.input_tokens);
+    put_u64(payload, reply.usage.output_tokens);
+    put_string(payload, reply.stop_reason);
+    put_string(payload, reply.model);
+    put_string(payload, reply.text);
+
+    uint64_t offset;
+    if (!append_record(payload, offset)) return;
+    auto it = entries.find(key);
+    if (it != entries.end()) live_bytes -= it->second.size;
+    uint64_t record_size = file_bytes - offset;
+    entries[key] = Entry{offset, record_size, ++clock};
+    live_bytes += record_size;
+
+    if (file_bytes > max_bytes) compact(max_bytes / 2);
+}
+
+// Keeps the most recently used entries that fit in target_bytes
+void ResponseCache::compact(uint64_t target_bytes) {
+    std::vector<std::pair<Key, Entry>> order(entries.begin(), entries.end());
+    std::sort(order.begin(), order.end(),
+        [](const auto& a, const auto& b) { return a.second.last_used > b.second.last_used; });
+
+    uint64_t kept_bytes = 0;
+    size_t kept = 0;
+    while (kept < order.size() && kept_bytes + order[kept].second.size <= target_bytes) {
+        kept_bytes += order[kept].second.size;
+        kept++;
+    }
+    order.resize(kept);
+    // Oldest first, so replaying the new file reproduces the recency order
+    std::reverse(order.begin(), order.end());
+
+    std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    uint64_t offset = sizeof(CACHE_MAGIC);
+    std::string record;
+    entries.clear();
+    for (auto& item : order) {
+        record.resize(item.second.size);
+        file.seekg(static_cast<std::streamoff>(item.second.offset));
+        if (!file.read(&record[0], static_cast<std::streamsize>(record.size()))) {
+            file.clear();
+            continue;
+        }
+        out.write(record.data(), static_cast<std::streamsize>(record.size()));
+        entries[item.first] = Entry{offset, item.second.size, item.second.last_used};
+        offset += item.second.size;
+    }
+    out.close();
+    file.close();
+
+    std::remove(path.c_str());
+    if (!out || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        // Start over empty rather than trust a half-written file
+        std::remove(temp_path.c_str());
+        std::ofstream fresh(path, std::ios::binary | std::ios::trunc);
+        fresh.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        entries.clear();
+        offset = sizeof(CACHE_MAGIC);
+    }
+    file_bytes = offset;
+    live_bytes = offset - sizeof(CACHE_MAGIC);
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::app);
+}
+
+void ResponseCache::set_max_bytes(uint64_t limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_bytes = limit;
+    if (file.is_open() && file_bytes > max_bytes) compact(max_bytes / 2);
+}
+
+void ResponseCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+    compact(0);
+}
+
+ResponseCacheStats ResponseCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    ResponseCacheStats s;
+    s.hits = hits;
+    s.misses = misses;
+    s.entries = entries.size();
+    s.bytes = file_bytes;
+    return s;
+}
@@ -0,0 +1,83 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "api_reply.h"
+
+struct ResponseCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;         // size of the cache file
+};
+
+// Content-addressed store of successful replies, keyed by a 128-bit hash
+// of the request body (which pins model, max_tokens, system prompt and
+// every message). Entries live in one append-only file, framed like the
+// journal; lookups append a small touch record so recency survives a
+// restart. When the file outgrows its cap, the most recently used entries
+// are rewritten into a fresh file and the rest are dropped. Thread-safe.
+class ResponseCache {
+public:
+    struct Key {
+        uint64_t high = 0;
+        uint64_t low = 0;
+
+        bool operator==(const Key& other) const { return high == other.high && low == other.low; }
+    };
+
+    static Key make_key(const char* request_body, size_t size);
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.low); }
+    };
+
+    struct Entry {
+        uint64_t offset;        // of the framed record
+        uint64_t size;          // framed record size
+        uint64_t last_used;
+    };
+
+    mutable std::mutex mutex;
+    std::string path;
+    std::fstream file;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    uint64_t file_bytes;
+    uint64_t live_bytes;        // framed size of the records entries point at
+    uint64_t max_bytes;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+
+    bool append_record(const std::string& payload, uint64_t& offset);
+    bool read_entry(const Entry& entry, ApiReply& out);
+    void compact(uint64_t target_bytes);
+    void load();
+
+public:
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+    ResponseCache();
+
+    // Loads (or creates) the cache file.
+    void open(const std::string& cache_path, uint64_t limit = DEFAULT_MAX_BYTES);
+    void close();
+    bool is_open() const;
+
+    void set_max_bytes(uint64_t limit);
+
+    // Counts a hit or a miss.
+    bool lookup(const Key& key, ApiReply& out);
+    void store(const Key& key, const ApiReply& reply);
+    void clear();
+
+    ResponseCacheStats stats() const;
+};
+
+#endif // RESPONSE_CACHE_H
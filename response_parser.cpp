@@ -0,0 +1,137 @@
+#include "response_parser.h"
+#include <cstdlib>
+
+ApiResponseParser::ApiResponseParser(bool stream, TextCallback on_text)
+    : on_text(std::move(on_text)), stream(stream), sniffed(false), parse_failed(false),
+      string_field(Field::None) {}
+
+ApiResponseParser::~ApiResponseParser() = default;
+
+ApiResponseParser::Field ApiResponseParser::classify() const {
+    std::string joined;
+    for (const auto& key : path) {
+        if (!joined.empty()) joined += '.';
+        joined += key;
+    }
+    // Streamed message_start events wrap the message in "message"
+    if (joined.compare(0, 8, "message.") == 0) joined.erase(0, 8);
+
+    if (joined == "id") return Field::Id;
+    if (joined == "model") return Field::Model;
+    if (joined == "content.text" || joined == "delta.text" || joined == "content_block.text") return Field::Text;
+    if (joined == "stop_reason" || joined == "delta.stop_reason") return Field::StopReason;
+    if (joined == "error.type") return Field::ErrorType;
+    if (joined == "error.message") return Field::ErrorMessage;
+    if (joined == "usage.input_tokens") return Field::InputTokens;
+    if (joined == "usage.output_tokens") return Field::OutputTokens;
+    if (joined == "usage.cache_creation_input_tokens") return Field::CacheCreationTokens;
+    if (joined == "usage.cache_read_input_tokens") return Field::CacheReadTokens;
+    return Field::None;
+}
+
+void ApiResponseParser::on_start_object() {
+    path.emplace_back();
+}
+
+void ApiResponseParser::on_end_object() {
+    path.pop_back();
+}
+
+void ApiResponseParser::on_key(const std::string& key) {
+    path.back() = key;
+}
+
+void ApiResponseParser::on_string_begin() {
+    string_field = classify();
+}
+
+void ApiResponseParser::on_string_data(const char* data, size_t size) {
+    switch (string_field) {
+        case Field::Id: result.id.append(data, size); break;
+        case Field::Model: result.model.append(data, size); break;
+        case Field::StopReason: result.stop_reason.append(data, size); break;
+        case Field::ErrorType: result.error.type.append(data, size); break;
+        case Field::ErrorMessage: result.error.message.append(data, size); break;
+        case Field::Text:
+            result.text.append(data, size);
+            if (on_text) delta.append(data, size);
+            break;
+        default: break;
+    }
+}
+
+void ApiResponseParser::on_number(const std::string& text) {
+    uint64_t value = strtoull(text.c_str(), nullptr, 10);
+    switch (classify()) {
+        case Field::InputTokens: result.usage.input_tokens = value; break;
+        case Field::OutputTokens: result.usage.output_tokens = value; break;
+        case Field::CacheCreationTokens: result.usage.cache_creation_input_tokens = value; break;
+        case Field::CacheReadTokens: result.usage.cache_read_input_tokens = value; break;
+        default: break;
+    }
+}
+
+void ApiResponseParser::handle_event(const std::string& event, const std::string& data) {
+    if (event == "ping") return;
+
+    // Each event carries one small JSON document
+    path.clear();
+    JsonStreamParser parser(*this);
+    if (!parser.feed(data.data(), data.size()) || !parser.finish()) {
+        parse_failed = true;
+    }
+    if (!delta.empty()) {
+        on_text(delta);
+        delta.clear();
+    }
+}
+
+bool ApiResponseParser::feed(const char* data, size_t size) {
+    if (!sniffed) {
+        size_t skip = 0;
+        while (skip < size && (data[skip] == ' ' || data[skip] == '\t' ||
+                               data[skip] == '\r' || data[skip] == '\n')) {
+            skip++;
+        }
+        if (skip == size) return true;
+        sniffed = true;
+        if (stream && data[skip] != '{') {
+            sse.reset(new SseParser([this](const std::string& event, const std::string& payload) {
+                handle_event(event, payload);
+            }));
+        } else {
+            json.reset(new JsonStreamParser(*this));
+        }
+    }
+
+    if (sse) {
+        sse->feed(data, size);
+    } else if (!parse_failed && !json->feed(data, size)) {
+        parse_failed = true;
+    }
+    return true;
+}
+
+void ApiResponseParser::finish(long status, const std::string& transport_error) {
+    result.status = status;
+    if (json && !parse_failed && !json->finish()) {
+        parse_failed = true;
+    }
+
+    if (!transport_error.empty()) {
+        result.error.type = "transport_error";
+        result.error.message = transport_error;
+    } else if (!result.error.type.empty()) {
+        if (result.error.message.empty()) result.error.message = result.error.type;
+    } else if (status != 200) {
+        result.error.type = "http_error";
+        result.error.message = "HTTP " + std::to_string(status);
+    } else if (!sniffed || (json && parse_failed) ||
+               (sse && result.text.empty() && result.stop_reason.empty())) {
+        result.error.type = "parse_error";
+        result.error.message = "Could not parse response";
+    } else if (json && on_text && !result.text.empty()) {
+        // Asked to stream but answered in one piece
+        on_text(result.text);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef RESPONSE_PARSER_H
+#define RESPONSE_PARSER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api_reply.h"
+#include "json_parser.h"
+#include "sse_parser.h"
+
+// Decodes a Messages API response as curl delivers it, without collecting
+// the body first. Handles both a plain JSON reply and a text/event-stream
+// one (falling back to plain JSON when a streamed request is answered with
+// an error body). Text goes straight from the network buffer into
+// reply().text; on_text, if set, additionally receives each streamed delta.
+class ApiResponseParser : private JsonStreamParser::Handler {
+public:
+    using TextCallback = std::function<void(const std::string&)>;
+
+private:
+    enum class Field : uint8_t {
+        None, Id, Model, Text, StopReason, ErrorType, ErrorMessage,
+        InputTokens, OutputTokens, CacheCreationTokens, CacheReadTokens
+    };
+
+    ApiReply result;
+    TextCallback on_text;
+    bool stream;
+    bool sniffed;               // first significant byte seen
+    bool parse_failed;
+    std::unique_ptr<JsonStreamParser> json;
+    std::unique_ptr<SseParser> sse;
+
+    // Object keys from the root to the current value; arrays add nothing,
+    // so content[i].text is "content.text".
+    std::vector<std::string> path;
+    Field string_field;
+    std::string delta;
+
+    Field classify() const;
+    void handle_event(const std::string& event, const std::string& data);
+
+    // JsonStreamParser::Handler
+    void on_start_object() override;
+    void on_end_object() override;
+    void on_key(const std::string& key) override;
+    void on_string_begin() override;
+    void on_string_data(const char* data, size_t size) override;
+    void on_number(const std::string& text) override;
+
+public:
+    explicit ApiResponseParser(bool stream, TextCallback on_text = nullptr);
+    ~ApiResponseParser() override;
+
+    // Fed from the transport's on_data callback.
+    bool feed(const char* data, size_t size);
+
+    // Call once the transfer is over; fills in status and any error.
+    void finish(long status, const std::string& transport_error);
+
+    const ApiReply& reply() const { return result; }
+    ApiReply& reply() { return result; }
+};
+
+#endif // RESPONSE_PARSER_H
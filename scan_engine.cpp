@@ -0,0 +1,255 @@
+#include "scan_engine.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <regex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define SCAN_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define SCAN_TARGET_AVX2
+    #else
+        #define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+struct FoldTable {
+    unsigned char map[256];
+    FoldTable() {
+        for (int i = 0; i < 256; i++) {
+            map[i] = static_cast<unsigned char>(i >= 'A' && i <= 'Z' ? i + ('a' - 'A') : i);
+        }
+    }
+};
+
+static const FoldTable FOLD;
+
+static inline unsigned char fold(char c) {
+    return FOLD.map[static_cast<unsigned char>(c)];
+}
+
+// needle is already folded
+static inline bool equal_folded(const char* data, const char* needle, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (fold(data[i]) != static_cast<unsigned char>(needle[i])) return false;
+    }
+    return true;
+}
+
+static bool find_scalar(const char* data, size_t size, const std::string& needle, size_t start) {
+    size_t n = needle.size();
+    unsigned char first = static_cast<unsigned char>(needle[0]);
+    unsigned char last = static_cast<unsigned char>(needle[n - 1]);
+    for (size_t i = start; i + n <= size; i++) {
+        if (fold(data[i]) == first && fold(data[i + n - 1]) == last &&
+            equal_folded(data + i + 1, needle.data() + 1, n > 2 ? n - 2 : 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef SCAN_X86
+// Folds 'A'..'Z' to lowercase: bytes shifted by 0x80 - 'A' land in the
+// lowest 26 signed values exactly when they were uppercase letters.
+static inline __m128i fold_sse2(__m128i x) {
+    __m128i shifted = _mm_add_epi8(x, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + 26)));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static bool find_sse2(const char* data, size_t size, const std::string& needle) {
+    size_t n = needle.size();
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= size; i += 16) {
+        __m128i block_first = fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        __m128i block_last = fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + n - 1)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+        while (mask) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+#else
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+            if (n <= 2 || equal_folded(data + i + bit + 1, needle.data() + 1, n - 2)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data, size, needle, i);
+}
+
+SCAN_TARGET_AVX2 static inline __m256i fold_avx2(__m256i x) {
+    __m256i shifted = _mm256_add_epi8(x, _mm256_set1_epi8(static_cast<char>(0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+SCAN_TARGET_AVX2 static bool find_avx2(const char* data, size_t size, const std::string& needle) {
+    size_t n = needle.size();
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= size; i += 32) {
+        __m256i block_first = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+        __m256i block_last = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + n - 1)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+        while (mask) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+#else
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+            if (n <= 2 || equal_folded(data + i + bit + 1, needle.data() + 1, n - 2)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data, size, needle, i);
+}
+
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // SCAN_X86
+
+CaseInsensitiveMatcher::CaseInsensitiveMatcher(const std::string& pattern)
+    : needle(pattern), isa(best_isa()) {
+    for (auto& c : needle) {
+        c = static_cast<char>(fold(c));
+    }
+}
+
+ScanIsa CaseInsensitiveMatcher::best_isa() {
+#ifdef SCAN_X86
+    static const ScanIsa detected = cpu_has_avx2() ? ScanIsa::AVX2 : ScanIsa::SSE2;
+    return detected;
+#else
+    return ScanIsa::Scalar;
+#endif
+}
+
+bool CaseInsensitiveMatcher::matches(const char* data, size_t size) const {
+    if (needle.empty()) return true;
+    if (size < needle.size()) return false;
+
+    switch (isa) {
+#ifdef SCAN_X86
+        case ScanIsa::AVX2:
+            return find_avx2(data, size, needle);
+        case ScanIsa::SSE2:
+            return find_sse2(data, size, needle);
+#endif
+        default:
+            return find_scalar(data, size, needle, 0);
+    }
+}
+
+static bool read_block_file(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    out.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(&out[0], static_cast<std::streamsize>(out.size())));
+}
+
+ScanEngine::ScanEngine(unsigned threads) {
+    thread_count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool ScanEngine::scan(const std::vector<ScanSource>& sources, const std::string& pattern,
+                      ScanMode mode, const ScanCallback& on_hit) const {
+    std::regex regex;
+    if (mode == ScanMode::Regex) {
+        try {
+            regex = std::regex(pattern, std::regex::ECMAScript | std::regex::icase);
+        } catch (const std::regex_error&) {
+            return false;
+        }
+    }
+    CaseInsensitiveMatcher matcher(pattern);
+
+    std::atomic<size_t> next_source(0);
+    std::mutex hit_mutex;
+
+    auto worker = [&]() {
+        std::regex local_regex = regex;
+        auto is_match = [&](std::string_view text) {
+            if (mode == ScanMode::Regex) {
+                return std::regex_search(text.data(), text.data() + text.size(), local_regex);
+            }
+            return matcher.matches(text.data(), text.size());
+        };
+        auto report = [&](const ScanSource& source, size_t index, const MessageView& view) {
+            std::lock_guard<std::mutex> lock(hit_mutex);
+            on_hit(*source.conversation_id, index, view);
+        };
+
+        // Blocks read from files and decompressed blocks land here; reused
+        // for every block this worker scans
+        std::string file_data;
+        MessageBlockData block_data;
+        size_t i;
+        while ((i = next_source.fetch_add(1)) < sources.size()) {
+            const ScanSource& source = sources[i];
+            if (source.messages) {
+                for (size_t j = 0; j < source.messages->size(); j++) {
+                    MessageView msg = (*source.messages)[j];
+                    if (is_match(msg.content)) {
+                        report(source, j, msg);
+                    }
+                }
+            } else if (source.block || source.block_path) {
+                const char* block = source.block;
+                uint64_t block_size = source.block_size;
+                if (source.block_path) {
+                    if (!read_block_file(*source.block_path, file_data)) continue;
+                    block = file_data.data();
+                    block_size = file_data.size();
+                }
+                if (!block_data.open(block, block_size, source.block_version)) continue;
+                MessageBlockReader reader(block_data.data(), block_data.size(), source.block_version);
+                MessageView view;
+                for (size_t j = 0; reader.next(view); j++) {
+                    if (is_match(view.content)) {
+                        report(source, j, view);
+                    }
+                }
+            }
+        }
+    };
+
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(thread_count, sources.size()));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < workers; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return true;
+}
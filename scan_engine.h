@@ -0,0 +1,71 @@
+#ifndef SCAN_ENGINE_H
+#define SCAN_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "conversation.h"
+
+enum class ScanIsa { Scalar, SSE2, AVX2 };
+
+// Case-insensitive (ASCII) substring matcher. The haystack is case-folded in
+// registers while it is scanned, so nothing is copied or allocated per call.
+// Candidate positions are found by comparing the first and last needle byte
+// across a whole vector at once and only those are verified byte by byte.
+class CaseInsensitiveMatcher {
+private:
+    std::string needle;
+    ScanIsa isa;
+
+public:
+    explicit CaseInsensitiveMatcher(const std::string& pattern);
+
+    bool matches(const char* data, size_t size) const;
+
+    // The fastest implementation the CPU supports is used by default.
+    void set_isa(ScanIsa new_isa) { isa = new_isa; }
+    ScanIsa get_isa() const { return isa; }
+
+    static ScanIsa best_isa();
+};
+
+enum class ScanMode { Substring, Regex };
+
+// A conversation to scan: its resident messages, a raw message block in
+// memory, or a file holding the block (read by the worker that scans it).
+struct ScanSource {
+    const std::string* conversation_id;
+    const MessageLog* messages;
+    const char* block;
+    uint64_t block_size;
+    uint32_t block_version;     // snapshot format the block is in
+    const std::string* block_path;
+};
+
+// Called once per matching message, serialized across worker threads. The
+// view is only valid for the duration of the call.
+using ScanCallback = std::function<void(const std::string& conversation_id,
+                                        size_t message_index,
+                                        const MessageView& message)>;
+
+// Brute-force search for queries the inverted index cannot answer. Work is
+// split across threads one conversation at a time and hits are reported as
+// soon as they are found.
+class ScanEngine {
+private:
+    unsigned thread_count;
+
+public:
+    explicit ScanEngine(unsigned threads = 0);
+
+    // Returns false if pattern is not a valid regex in ScanMode::Regex.
+    bool scan(const std::vector<ScanSource>& sources, const std::string& pattern,
+              ScanMode mode, const ScanCallback& on_hit) const;
+
+    unsigned threads() const { return thread_count; }
+};
+
+#endif // SCAN_ENGINE_H
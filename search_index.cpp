@@ -0,0 +1,341 @@
+#include "search_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+static const char INDEX_MAGIC[4] = {'C', 'C', 'I', '1'};
+static const size_t MAX_TOKEN_LENGTH = 64;
+// On-disk sizes: a document's three fields and live flag, and a term with
+// an empty name and no postings
+static const uint64_t DOCUMENT_RECORD_SIZE = 3 * sizeof(uint32_t) + 1;
+static const uint64_t MIN_TERM_RECORD_SIZE = 2 * sizeof(uint64_t);
+
+// BM25 parameters
+static const double K1 = 1.2;
+static const double B = 0.75;
+
+static void write_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void write_string(std::string& out, const std::string& value) {
+    write_u64(out, value.size());
+    out.append(value);
+}
+
+static bool read_u64(std::ifstream& file, uint64_t& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static bool read_string(std::ifstream& file, std::string& value) {
+    uint64_t len;
+    if (!read_u64(file, len) || len > (1u << 20)) return false;
+    value.resize(len);
+    return len == 0 || static_cast<bool>(file.read(&value[0], static_cast<std::streamsize>(len)));
+}
+
+// Bytes left after the read position of a file size bytes long
+static uint64_t remaining(std::ifstream& file, uint64_t size) {
+    std::streamoff position = file.tellg();
+    if (position < 0 || static_cast<uint64_t>(position) > size) return 0;
+    return size - static_cast<uint64_t>(position);
+}
+
+SearchIndex::SearchIndex() : live_documents(0), live_length(0) {}
+
+std::vector<std::string> SearchIndex::tokenize(std::string_view text) {
+    // Runs of ASCII letters/digits (lowercased) and UTF-8 bytes, so words in
+    // other scripts still index as whole tokens.
+    std::vector<std::string> tokens;
+    std::string current;
+    for (unsigned char c : text) {
+        bool word_char = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                         (c >= 'A' && c <= 'Z') || c >= 0x80;
+        if (word_char) {
+            if (current.size() < MAX_TOKEN_LENGTH) {
+                current.push_back(static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c));
+            }
+        } else if (!current.empty()) {
+            tokens.push_back(current);
+            current.clear();
+        }
+    }
+    if (!current.empty()) tokens.push_back(current);
+    return tokens;
+}
+
+uint32_t SearchIndex::conversation_slot(const std::string& conversation_id) {
+    auto it = conversation_slots.find(conversation_id);
+    if (it != conversation_slots.end()) return it->second;
+
+    uint32_t slot = static_cast<uint32_t>(conversation_ids.size());
+    conversation_ids.push_back(conversation_id);
+    conversation_documents.emplace_back();
+    conversation_slots.emplace(conversation_id, slot);
+    return slot;
+}
+
+void SearchIndex::add_message(const std::string& conversation_id, size_t message_index,
+                              std::string_view content) {
+    std::vector<std::string> tokens = tokenize(content);
+    std::sort(tokens.begin(), tokens.end());
+
+    uint32_t slot = conversation_slot(conversation_id);
+    uint32_t doc_id = static_cast<uint32_t>(documents.size());
+    documents.push_back({slot, static_cast<uint32_t>(message_index),
+                         static_cast<uint32_t>(tokens.size()), true});
+    conversation_documents[slot].push_back(doc_id);
+    live_documents++;
+    live_length += tokens.size();
+
+    for (size_t i = 0; i < tokens.size();) {
+        size_t j = i;
+        while (j < tokens.size() && tokens[j] == tokens[i]) j++;
+        postings[tokens[i]].push_back({doc_id, static_cast<uint32_t>(j - i)});
+        i = j;
+    }
+}
+
+void SearchIndex::remove_message(const std::string& conversation_id, size_t message_index) {
+    auto it = conversation_slots.find(conversation_id);
+    if (it == conversation_slots.end()) return;
+
+    // Normally the newest document, so search from the back
+    std::vector<uint32_t>& docs = conversation_documents[it->second];
+    for (size_t i = docs.size(); i-- > 0;) {
+        Document& doc = documents[docs[i]];
+        if (doc.message_index != message_index) continue;
+        if (doc.live) {
+            doc.live = false;
+            live_documents--;
+            live_length -= doc.length;
+        }
+        docs.erase(docs.begin() + i);
+        return;
+    }
+}
+
+void SearchIndex::remove_conversation(const std::string& conversation_id) {
+    auto it = conversation_slots.find(conversation_id);
+    if (it == conversation_slots.end()) return;
+
+    for (uint32_t doc_id : conversation_documents[it->second]) {
+        Document& doc = documents[doc_id];
+        if (!doc.live) continue;
+        doc.live = false;
+        live_documents--;
+        live_length -= doc.length;
+    }
+    conversation_documents[it->second].clear();
+
+    if (documents.size() > 1024 && documents.size() - live_documents > live_documents) {
+        purge_dead_documents();
+    }
+}
+
+void SearchIndex::purge_dead_documents() {
+    std::vector<uint32_t> remap(documents.size(), UINT32_MAX);
+    std::vector<Document> kept;
+    kept.reserve(static_cast<size_t>(live_documents));
+    for (size_t i = 0; i < documents.size(); i++) {
+        if (documents[i].live) {
+            remap[i] = static_cast<uint32_t>(kept.size());
+            kept.push_back(documents[i]);
+        }
+    }
+    documents.swap(kept);
+
+    for (auto it = postings.begin(); it != postings.end();) {
+        std::vector<Posting>& list = it->second;
+        size_t out = 0;
+        for (const Posting& p : list) {
+            if (remap[p.document] != UINT32_MAX) {
+                list[out++] = {remap[p.document], p.frequency};
+            }
+        }
+        list.resize(out);
+        if (list.empty()) {
+            it = postings.erase(it);
+        } else {
+            list.shrink_to_fit();
+            ++it;
+        }
+    }
+
+    for (auto& docs : conversation_documents) {
+        for (auto& doc_id : docs) doc_id = remap[doc_id];
+    }
+}
+
+std::vector<SearchHit> SearchIndex::search(const std::string& query, size_t top_k) const {
+    std::vector<SearchHit> hits;
+    if (live_documents == 0 || top_k == 0) return hits;
+
+    std::vector<std::string> terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    double doc_count = static_cast<double>(live_documents);
+    double avg_length = static_cast<double>(live_length) / doc_count;
+    std::unordered_map<uint32_t, double> scores;
+
+    for (const auto& term : terms) {
+        auto it = postings.find(term);
+        if (it == postings.end()) continue;
+
+        size_t df = 0;
+        for (const Posting& p : it->second) {
+            if (documents[p.document].live) df++;
+        }
+        if (df == 0) continue;
+
+        double idf = std::log(1.0 + (doc_count - df + 0.5) / (df + 0.5));
+        for (const Posting& p : it->second) {
+            const Document& doc = documents[p.document];
+            if (!doc.live) continue;
+            double tf = p.frequency;
+            double norm = K1 * (1.0 - B + B * doc.length / avg_length);
+            scores[p.document] += idf * tf * (K1 + 1.0) / (tf + norm);
+        }
+    }
+
+    std::vector<std::pair<double, uint32_t>> ranked;
+    ranked.reserve(scores.size());
+    for (const auto& entry : scores) {
+        ranked.emplace_back(entry.second, entry.first);
+    }
+    size_t k = std::min(top_k, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(),
+        [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+    hits.reserve(k);
+    for (size_t i = 0; i < k; i++) {
+        const Document& doc = documents[ranked[i].second];
+        hits.push_back({conversation_ids[doc.conversation], doc.message_index, ranked[i].first});
+    }
+    return hits;
+}
+
+void SearchIndex::clear() {
+    conversation_ids.clear();
+    conversation_slots.clear();
+    conversation_documents.clear();
+    documents.clear();
+    postings.clear();
+    live_documents = 0;
+    live_length = 0;
+}
+
+void SearchIndex::serialize(std::string& out, uint64_t generation) const {
+    out.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    write_u64(out, generation);
+
+    write_u64(out, conversation_ids.size());
+    for (const auto& id : conversation_ids) {
+        write_string(out, id);
+    }
+
+    write_u64(out, documents.size());
+    for (const Document& doc : documents) {
+        uint32_t fields[3] = {doc.conversation, doc.message_index, doc.length};
+        out.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+        out.push_back(doc.live ? 1 : 0);
+    }
+
+    write_u64(out, postings.size());
+    for (const auto& entry : postings) {
+        write_string(out, entry.first);
+        write_u64(out, entry.second.size());
+        out.append(reinterpret_cast<const char*>(entry.second.data()),
+                   entry.second.size() * sizeof(Posting));
+    }
+}
+
+bool write_index_file(const std::string& path, const std::string& serialized) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(serialized.data(), static_cast<std::streamsize>(serialized.size()));
+    file.close();
+    return static_cast<bool>(file);
+}
+
+bool SearchIndex::load(const std::string& path, uint64_t generation) {
+    clear();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    std::streamoff file_size = file.tellg();
+    if (file_size < 0 || !file.seekg(0)) return false;
+    uint64_t size = static_cast<uint64_t>(file_size);
+
+    char magic[sizeof(INDEX_MAGIC)];
+    uint64_t file_generation;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !read_u64(file, file_generation) || file_generation != generation) {
+        return false;
+    }
+
+    uint64_t count;
+    if (!read_u64(file, count)) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        std::string id;
+        if (!read_string(file, id)) {
+            clear();
+            return false;
+        }
+        conversation_slot(id);
+    }
+
+    // A corrupt count must not size the reservations below
+    if (!read_u64(file, count) || count > remaining(file, size) / DOCUMENT_RECORD_SIZE) {
+        clear();
+        return false;
+    }
+    documents.reserve(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t fields[3];
+        char live;
+        if (!file.read(reinterpret_cast<char*>(fields), sizeof(fields)) || !file.get(live) ||
+            fields[0] >= conversation_ids.size()) {
+            clear();
+            return false;
+        }
+        documents.push_back({fields[0], fields[1], fields[2], live != 0});
+        if (live) {
+            conversation_documents[fields[0]].push_back(static_cast<uint32_t>(i));
+            live_documents++;
+            live_length += fields[2];
+        }
+    }
+
+    if (!read_u64(file, count) || count > remaining(file, size) / MIN_TERM_RECORD_SIZE) {
+        clear();
+        return false;
+    }
+    postings.reserve(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; i++) {
+        std::string term;
+        uint64_t size;
+        if (!read_string(file, term) || !read_u64(file, size) || size > documents.size()) {
+            clear();
+            return false;
+        }
+        std::vector<Posting>& list = postings[term];
+        list.resize(static_cast<size_t>(size));
+        if (!file.read(reinterpret_cast<char*>(list.data()),
+                       static_cast<std::streamsize>(size * sizeof(Posting)))) {
+            clear();
+            return false;
+        }
+        for (const Posting& p : list) {
+            if (p.document >= documents.size()) {
+                clear();
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct SearchHit {
+    std::string conversation_id;
+    size_t message_index;
+    double score;
+};
+
+// Tokenized inverted index over message contents, ranked with BM25.
+//
+// Every message is a document identified by (conversation, message index).
+// Removing a conversation's messages only marks their documents dead; dead
+// postings are skipped while scoring and purged once they outnumber the live
+// ones. The index is saved next to the catalog and tagged with the catalog
+// generation it reflects, so a stale file is rebuilt rather than trusted.
+class SearchIndex {
+private:
+    struct Document {
+        uint32_t conversation;
+        uint32_t message_index;
+        uint32_t length;
+        bool live;
+    };
+
+    struct Posting {
+        uint32_t document;
+        uint32_t frequency;
+    };
+
+    std::vector<std::string> conversation_ids;
+    std::unordered_map<std::string, uint32_t> conversation_slots;
+    std::vector<std::vector<uint32_t>> conversation_documents;
+    std::vector<Document> documents;
+    std::unordered_map<std::string, std::vector<Posting>> postings;
+    uint64_t live_documents;
+    uint64_t live_length;
+
+    uint32_t conversation_slot(const std::string& conversation_id);
+    void purge_dead_documents();
+
+public:
+    SearchIndex();
+
+    static std::vector<std::string> tokenize(std::string_view text);
+
+    void add_message(const std::string& conversation_id, size_t message_index,
+                     std::string_view content);
+
+    // Drops one message, e.g. a turn that was rolled back.
+    void remove_message(const std::string& conversation_id, size_t message_index);
+
+    // Drops every message of the conversation (used for delete and clear).
+    void remove_conversation(const std::string& conversation_id);
+
+    std::vector<SearchHit> search(const std::string& query, size_t top_k) const;
+
+    void clear();
+    size_t document_count() const { return static_cast<size_t>(live_documents); }
+
+    // serialize() captures the index under a lock; write_index_file puts
+    // it on disk after the lock is released.
+    void serialize(std::string& out, uint64_t generation) const;
+    bool load(const std::string& path, uint64_t generation);
+};
+
+bool write_index_file(const std::string& path, const std::string& serialized);
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,215 @@
+#include "snapshot.h"
+#include <cstring>
+
+#include "lz_codec.h"
+
+static const char SNAPSHOT_MAGIC[4] = {'C', 'C', 'S', '2'};
+static const uint64_t V2_HEADER_SIZE = 4 + 4 + 8 + 8;
+static const uint64_t HEADER_SIZE = V2_HEADER_SIZE + 8;
+// Smallest index entry: id and title lengths, two timestamps (at least a
+// length or a value each), message count, block offset and block size
+static const uint64_t MIN_INDEX_ENTRY_SIZE = 7 * 8;
+
+// Bounds-checked cursor over a region of the mapping.
+struct ByteReader {
+    const char* pos;
+    const char* end;
+
+    bool read_u64(uint64_t& value) {
+        if (static_cast<uint64_t>(end - pos) < sizeof(value)) return false;
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool read_time(uint32_t version, int64_t& value) {
+        if (version >= 5) {
+            uint64_t raw;
+            if (!read_u64(raw)) return false;
+            value = static_cast<int64_t>(raw);
+            return true;
+        }
+        std::string text;
+        if (!read_string(text)) return false;
+        value = parse_timestamp(text);
+        return true;
+    }
+
+    bool read_string(std::string& value) {
+        uint64_t len;
+        if (!read_u64(len) || static_cast<uint64_t>(end - pos) < len) return false;
+        value.assign(pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+static void put_u64(std::string& buf, uint64_t value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool snapshot_is_indexed(const MappedFile& map) {
+    return map.size() >= V2_HEADER_SIZE &&
+           std::memcmp(map.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+}
+
+bool read_snapshot_index(const MappedFile& map, std::vector<Conversation>& conversations,
+                         uint64_t& generation, uint32_t& version) {
+    if (!snapshot_is_indexed(map)) return false;
+
+    std::memcpy(&version, map.data() + 4, sizeof(version));
+    if (version < 2 || version > SNAPSHOT_VERSION) return false;
+    if (version >= 3 && map.size() < HEADER_SIZE) return false;
+
+    ByteReader header{map.data() + 8, map.data() + map.size()};
+    uint64_t conv_count, index_offset;
+    if (!header.read_u64(conv_count) || !header.read_u64(index_offset)) return false;
+    generation = 0;
+    if (version >= 3 && !header.read_u64(generation)) return false;
+    if (index_offset > map.size()) return false;
+    // A corrupt count must not size the reservation below
+    if (conv_count > (map.size() - index_offset) / MIN_INDEX_ENTRY_SIZE) return false;
+
+    ByteReader reader{map.data() + index_offset, map.data() + map.size()};
+    conversations.clear();
+    conversations.reserve(conv_count);
+
+    for (uint64_t i = 0; i < conv_count; i++) {
+        Conversation conv;
+        uint64_t message_count;
+        if (!reader.read_string(conv.id) ||
+            !reader.read_string(conv.title) ||
+            !reader.read_time(version, conv.created_at) ||
+            !reader.read_time(version, conv.last_modified) ||
+            !reader.read_u64(message_count) ||
+            !reader.read_u64(conv.block_offset) ||
+            !reader.read_u64(conv.block_size)) {
+            return false;
+        }
+        if (conv.block_offset > index_offset || conv.block_size > index_offset - conv.block_offset) {
+            return false;
+        }
+        if (version >= 4) {
+            uint64_t summary_covers;
+            if (!reader.read_string(conv.summary) || !reader.read_u64(summary_covers) ||
+                summary_covers > message_count) {
+                return false;
+            }
+            conv.summary_covers = static_cast<size_t>(summary_covers);
+        }
+        conv.message_count = static_cast<size_t>(message_count);
+        conv.messages_loaded = false;
+        conv.in_snapshot = true;
+        conversations.push_back(std::move(conv));
+    }
+    return true;
+}
+
+bool MessageBlockReader::read_field(std::string_view& field) {
+    uint64_t len;
+    if (static_cast<uint64_t>(end - pos) < sizeof(len)) return false;
+    std::memcpy(&len, pos, sizeof(len));
+    pos += sizeof(len);
+    if (static_cast<uint64_t>(end - pos) < len) return false;
+    field = std::string_view(pos, static_cast<size_t>(len));
+    pos += len;
+    return true;
+}
+
+bool MessageBlockReader::next(MessageView& message) {
+    if (pos >= end) return false;
+
+    if (version < 5) {
+        std::string_view role, timestamp;
+        if (!read_field(role) || !read_field(message.content) || !read_field(timestamp)) {
+            return false;
+        }
+        message.role = role == "assistant" ? Role::Assistant : Role::User;
+        message.timestamp = parse_timestamp(timestamp);
+        return true;
+    }
+
+    int64_t timestamp;
+    if (static_cast<uint64_t>(end - pos) < 1 + sizeof(timestamp)) return false;
+    message.role = static_cast<Role>(*pos++);
+    std::memcpy(&timestamp, pos, sizeof(timestamp));
+    pos += sizeof(timestamp);
+    message.timestamp = timestamp;
+    return read_field(message.content);
+}
+
+enum BlockCodec : uint8_t {
+    CODEC_RAW = 0,
+    CODEC_LZ = 1
+};
+
+static const uint64_t BLOCK_HEADER_SIZE = 1 + 8;
+
+bool MessageBlockData::open(const char* block, uint64_t size, uint32_t version) {
+    begin = block;
+    length = size;
+    if (version < 6) return true;
+
+    uint64_t raw_size;
+    if (size < BLOCK_HEADER_SIZE) return false;
+    std::memcpy(&raw_size, block + 1, sizeof(raw_size));
+    begin = block + BLOCK_HEADER_SIZE;
+    length = size - BLOCK_HEADER_SIZE;
+
+    switch (static_cast<uint8_t>(block[0])) {
+        case CODEC_RAW:
+            return raw_size == length;
+        case CODEC_LZ:
+            // A block can never expand more than 255x
+            if (raw_size / 255 > length) return false;
+            buffer.resize(static_cast<size_t>(raw_size));
+            if (!lz_decompress(begin, static_cast<size_t>(length), &buffer[0], buffer.size())) {
+                length = 0;
+                return false;
+            }
+            begin = buffer.data();
+            length = raw_size;
+            return true;
+    }
+    length = 0;
+    return false;
+}
+
+uint64_t message_block_raw_size(const char* block, uint64_t size, uint32_t version) {
+    if (version < 6) return size;
+    uint64_t raw_size = 0;
+    if (size >= BLOCK_HEADER_SIZE) std::memcpy(&raw_size, block + 1, sizeof(raw_size));
+    return raw_size;
+}
+
+void serialize_message_block(const MessageLog& messages, std::string& out) {
+    std::string raw;
+    for (const MessageView& msg : messages) {
+        raw.push_back(static_cast<char>(msg.role));
+        put_u64(raw, static_cast<uint64_t>(msg.timestamp));
+        put_u64(raw, msg.content.size());
+        raw.append(msg.content.data(), msg.content.size());
+    }
+
+    size_t start = out.size();
+    out.push_back(static_cast<char>(CODEC_LZ));
+    put_u64(out, raw.size());
+    lz_compress(raw.data(), raw.size(), out);
+    if (out.size() - start - BLOCK_HEADER_SIZE >= raw.size()) {
+        out.resize(start);
+        out.push_back(static_cast<char>(CODEC_RAW));
+        put_u64(out, raw.size());
+        out.append(raw);
+    }
+}
+
+bool parse_message_block(const char* block, uint64_t size, uint32_t version, MessageLog& messages) {
+    MessageBlockData data;
+    if (!data.open(block, size, version)) return false;
+    MessageBlockReader reader(data.data(), data.size(), version);
+    MessageView view;
+    while (reader.next(view)) {
+        messages.push_back(view);
+    }
+    return reader.at_end();
+}
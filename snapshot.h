@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "conversation.h"
+#include "mapped_file.h"
+
+// conversations.dat, where all conversations were stored before each got a
+// file of its own (see conversation_files.h). It is only read now, to migrate
+// it; the message block format lives on in the per-conversation files.
+//
+// Indexed layout:
+//
+//   header   "CCS2" | u32 version | u64 conversation count | u64 index offset
+//            | u64 generation (version 3+)
+//   blocks   one message block per conversation: u8 codec | u64 size of the
+//            messages | the messages, LZ-compressed if codec is 1
+//            (version 6+); per message u8 role, i64 timestamp, content
+//   index    per conversation: id, title, i64 created_at, i64 last_modified,
+//            u64 message count, u64 block offset, u64 block size,
+//            summary, u64 messages summarized (version 4+)
+//
+// Strings are a u64 length and the bytes. Before version 5, roles and all
+// timestamps were stored as text; such files are still read.
+//
+// The index is small and is read eagerly; message blocks are decompressed
+// and parsed only when a conversation is loaded, searched or exported. Files written before
+// the index existed start with a raw conversation count and are read fully.
+//
+// The generation increases with every snapshot written so files derived from
+// it (such as the search index) can tell whether they are still current.
+const uint32_t SNAPSHOT_VERSION = 6;
+
+// Where a conversation's block sits in the file.
+struct SnapshotBlock {
+    uint64_t offset;
+    uint64_t size;
+};
+
+bool snapshot_is_indexed(const MappedFile& map);
+
+// Fills conversations with metadata only; messages are left unloaded.
+// version tells the message block readers below how the blocks are laid out.
+bool read_snapshot_index(const MappedFile& map, std::vector<Conversation>& conversations,
+                         uint64_t& generation, uint32_t& version);
+
+// The messages in a block: the block itself if it is stored raw, else a
+// decompressed copy. Reusable across blocks.
+class MessageBlockData {
+private:
+    std::string buffer;
+    const char* begin;
+    uint64_t length;
+
+public:
+    MessageBlockData() : begin(nullptr), length(0) {}
+
+    // False if the block is malformed.
+    bool open(const char* block, uint64_t size, uint32_t version = SNAPSHOT_VERSION);
+
+    const char* data() const { return begin; }
+    uint64_t size() const { return length; }
+};
+
+// Size of the messages in a block before compression.
+uint64_t message_block_raw_size(const char* block, uint64_t size, uint32_t version = SNAPSHOT_VERSION);
+
+// Walks the messages of an opened block without copying; views point into
+// the MessageBlockData.
+class MessageBlockReader {
+private:
+    const char* pos;
+    const char* end;
+    uint32_t version;
+
+    bool read_field(std::string_view& field);
+
+public:
+    MessageBlockReader(const char* data, uint64_t size, uint32_t version = SNAPSHOT_VERSION)
+        : pos(data), end(data + size), version(version) {}
+
+    bool next(MessageView& message);
+    bool at_end() const { return pos == end; }
+};
+
+// Appends a whole block (header included), compressed when that saves space.
+void serialize_message_block(const MessageLog& messages, std::string& out);
+bool parse_message_block(const char* block, uint64_t size, uint32_t version, MessageLog& messages);
+
+#endif // SNAPSHOT_H
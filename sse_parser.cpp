@@ -0,0 +1,46 @@
+#include "sse_parser.h"
+
+SseParser::SseParser(EventHandler on_event) : on_event(std::move(on_event)), has_data(false) {}
+
+void SseParser::feed(const char* chunk, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        char c = chunk[i];
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            process_line();
+            line.clear();
+        } else {
+            line += c;
+        }
+    }
+}
+
+void SseParser::process_line() {
+    if (line.empty()) {
+        if (has_data) {
+            on_event(event.empty() ? "message" : event, data);
+        }
+        event.clear();
+        data.clear();
+        has_data = false;
+        return;
+    }
+    if (line[0] == ':') return;
+
+    size_t colon = line.find(':');
+    std::string field = line.substr(0, colon);
+    std::string value;
+    if (colon != std::string::npos) {
+        size_t start = colon + 1;
+        if (start < line.size() && line[start] == ' ') start++;
+        value = line.substr(start);
+    }
+
+    if (field == "event") {
+        event = value;
+    } else if (field == "data") {
+        if (has_data) data += '\n';
+        data += value;
+        has_data = true;
+    }
+}
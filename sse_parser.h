@@ -0,0 +1,30 @@
+#ifndef SSE_PARSER_H
+#define SSE_PARSER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Incremental text/event-stream parser. Bytes can be fed in arbitrary chunks
+// (as curl delivers them); each complete event is dispatched once its
+// terminating blank line arrives.
+class SseParser {
+public:
+    using EventHandler = std::function<void(const std::string& event, const std::string& data)>;
+
+private:
+    EventHandler on_event;
+    std::string line;
+    std::string event;
+    std::string data;
+    bool has_data;
+
+    void process_line();
+
+public:
+    explicit SseParser(EventHandler on_event);
+
+    void feed(const char* chunk, size_t size);
+};
+
+#endif // SSE_PARSER_H